@@ -11,14 +11,31 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdint.h>
+#include "ads131m0x.h"
+#include "decimator.h"
+#include "lut.h"
+#include "stats.h"
 
 /* Config --------------------------------------------------------------------*/
 
-#define MOVAVG_SIZE		33		// one size for all (may be modified to individual...)
+#define MOVAVG_SIZE		33		// default size, for battery and at 2 kSPS
+#define MOVAVG_SIZE_MAX	128		// float filters (battery, uart samples)
+#define MOVAVG_ADS_SIZE_MAX	1024	// ADS filters are resized to keep MOVAVG_WINDOW
+#define MOVAVG_WINDOW	(MOVAVG_SIZE / 1953.125f)	// [s] 17 ms, see calibSampleRateSet()
+
+/*
+ * ADS channels go through filter pipelines (struct sFilter), configured at
+ * runtime with presets (enum eFilterPreset): Ia and Uc from UI and saved
+ * config, Ue and Uf on MCU_HIGH with FILTER_DEFAULT.
+ */
+#define FILTER_DEFAULT		FILTER_MA
+#define FILTER_MEDIAN_MAX	5
+#define FILTER_EMA_TAU		(0.008f)	// [s] the same delay as MOVAVG_WINDOW
+#define FILTER_BIQUAD_FC	(40.0f)		// [Hz] 5.6 ms delay
+#define FILTER_EMA_SHIFT	16			// EMA state fraction bits
 
-#define USE_MOVAVG_IA_FILTER
-#define USE_MOVAVG_UC_FILTER
 /*
  * NOTE: at 250 SPS samples from MCU_HIGH could be filtered on LOW side after
  * 		uart transmission. At 2 kSPS ca. 75 % samples is lost on uart throughput
@@ -29,6 +46,40 @@ extern "C" {
 //#define USE_MOVAVG_UF_MCULOW
 #define USE_MOVAVG_UF_MCUHIGH
 
+/*
+ * Ripple statistics of ADS channels, before and after filter (see stats.h).
+ * Ue and Uf received by MCU_LOW have their own ones, in samples.
+ */
+#define USE_STATS
+#define STATS_WINDOW		(0.25f)	// [s] the same as LCD refresh
+#define STATS_UART_WINDOW	128		// [samples] ca. 0.25 s of uart frames
+
+/*
+ * Offsets auto-zero (see calibAutoZeroStart()). Offset out of limit means
+ * the input wasn't shorted, it's ca. 1.5 % of full scale.
+ */
+#define AUTOZERO_TIME			(2.0f)		// [s]
+#define AUTOZERO_OFFSET_MAX		(1 << 17)	// [bit]
+
+/*
+ * Calibration tables (see calibTableSet()) are compiled to lookup tables for
+ * these input ranges: ADS code after offset, and output voltage [mV] of the
+ * pump and of the regulators feedforward.
+ */
+#define CALIB_CODE_MIN			(-(1 << 23))
+#define CALIB_CODE_LOG2_RANGE	24			// ADS codes, beyond them (by offset) clamped
+#define CALIB_PUMP_MIN			0
+#define CALIB_PUMP_LOG2_RANGE	23			// up to 8388 V
+
+/*
+ * Regulators of local channels (Ia, Uc) get anti-aliased input from decimators
+ * (see decimator.h), one per regulator period, instead of the newest moving
+ * average value. Moving average filters stay for UI and logger.
+ */
+#ifdef MCU_LOW
+	#define USE_DECIMATOR
+#endif
+
 #if defined (USE_MOVAVG_UE_MCULOW) && defined (USE_MOVAVG_UE_MCUHIGH)
 	#error "don't use the UE filter twice"
 #endif
@@ -41,14 +92,138 @@ extern "C" {
 struct sMovAvg
 {
 	float fSum;
-	float fBuff[MOVAVG_SIZE];
+	float fBuff[MOVAVG_SIZE_MAX];
 	uint32_t uIndex;
+	uint32_t uSize;
+	bool bRefill;		// set by movAvgGap(), buffer is filled with the next sample
 };
 
-extern struct sMovAvg	movAvgIa, 		\
-						movAvgUc, 		\
-						movAvgUe, 		\
-						movAvgUf,		\
+/*
+ * Moving average of raw ADS codes. Sum is exact (int64), so there's no drift
+ * to re-sum and every sample takes the same time. Buffer and its capacity are
+ * given per instance.
+ */
+struct sMovAvgInt
+{
+	int64_t iSum;
+	int32_t *iBuff;
+	uint32_t uCapacity;	// length of iBuff
+	uint32_t uIndex;
+	uint32_t uSize;
+	float fInvSize;
+	// the next uStale samples leaving the window are iStale, not iBuff content
+	// - resize and refill without touching the buffer
+	uint32_t uStale;
+	int32_t iStale;
+	bool bRefill;		// set by movAvgIntGap()
+};
+
+enum eFilterPreset
+{
+	FILTER_OFF = 0,		// raw samples
+	FILTER_MA,			// moving average of MOVAVG_WINDOW
+	FILTER_MED_MA,		// median of 3 (spikes) and moving average
+	FILTER_EMA,			// exponential, FILTER_EMA_TAU
+	FILTER_MED_EMA,		// median of 3 and exponential
+	FILTER_LP,			// 2nd order Butterworth, FILTER_BIQUAD_FC
+	FILTER_MA_LP,		// moving average and 2nd order Butterworth
+	FILTER_PRESETS_NUMBER_OF,
+};
+
+enum eFilterStage
+{
+	FILTER_STAGE_MEDIAN = 0,
+	FILTER_STAGE_MOVAVG,
+	FILTER_STAGE_EMA,
+	FILTER_STAGE_BIQUAD,
+	FILTER_STAGES_NUMBER_OF,
+};
+
+struct sFilterConfig
+{
+	const char *name;	// for UI, up to 9 chars
+	uint32_t uMedian;	// window, 1 - off
+	float fWindow;		// [s] moving average, 0 - off
+	float fTau;			// [s] EMA time constant, used only without moving average
+	float fCutoff;		// [Hz] biquad, 0 - off
+};
+
+/*
+ * Filter pipeline of one ADS channel. Stages run in fixed order:
+ *
+ *  median -> moving average or EMA -> biquad
+ *
+ * First ones work on integer codes (exact, no drift), biquad in float relative
+ * to a reference re-centred on large steps, so its rounding doesn't depend on
+ * the signal level. Output is the mean value in ADS codes, the same as from
+ * movAvgIntAddSample(). Every stage takes constant time.
+ */
+struct sFilter
+{
+	enum eFilterPreset preset;
+	bool bRefill;				// next sample fills all stages (config, gaps)
+	uint32_t uGapRefill;		// [samples] gap making filter content stale
+	float fDelay[FILTER_STAGES_NUMBER_OF];	// [s] group delay at DC
+	// median
+	uint32_t uMedianSize;
+	uint32_t uMedianIndex;
+	int32_t iMedianBuff[FILTER_MEDIAN_MAX];
+	// moving average
+	bool bMovAvg;
+	struct sMovAvgInt movAvg;
+	// EMA, state in FILTER_EMA_SHIFT fraction bits
+	uint32_t uEmaAlpha;			// 0 - off
+	int64_t iEma;
+	// biquad, transposed direct form II
+	bool bBiquad;
+	float b0, b1, b2, a1, a2;
+	float fZ1, fZ2;
+	float fRef;
+};
+
+enum eStatsChannel
+{
+	STATS_IA = 0,
+	STATS_UC,
+	STATS_UE,
+	STATS_UF,
+	STATS_CHANNELS_NUMBER_OF,
+};
+
+enum eStatsPoint
+{
+	STATS_RAW = 0,		// calibrated sample, before filter
+	STATS_FILTERED,		// as in System.meas
+	STATS_POINTS_NUMBER_OF,
+};
+
+enum eAutoZero
+{
+	AUTOZERO_IDLE = 0,
+	AUTOZERO_RUNNING,	// summing samples
+	AUTOZERO_DONE,		// measured, waiting for calibAutoZeroTask()
+	AUTOZERO_SAVED,		// applied and saved to flash
+	AUTOZERO_ERROR,		// offset out of limit or flash error, nothing applied
+};
+
+enum eCalibTable
+{
+	CALIB_TABLE_CH0 = 0,	// MCU_LOW: Ia, MCU_HIGH: Ue [bit -> A, V]
+	CALIB_TABLE_CH1,		// MCU_LOW: Uc, MCU_HIGH: Uf [bit -> V]
+	CALIB_TABLE_PUMP,		// [mV -> duty]
+	CALIB_TABLE_FF_UC,		// [mV -> duty] static models of regulated outputs,
+	CALIB_TABLE_FF_UE,		// see getFeedforwardDuty()
+	CALIB_TABLE_FF_UF,
+	CALIB_TABLES_NUMBER_OF,
+};
+
+extern struct sFilter	filterIa, 		\
+						filterUc, 		\
+						filterUe, 		\
+						filterUf;		\
+
+extern struct sMovAvg	movAvgUeUart,	\
+						movAvgUfUart,	\
 						movAvgAdcBatt;	\
 
 /* Exported functions --------------------------------------------------------*/
@@ -69,22 +244,191 @@ void initCoefficients(void);
  * Call it once at system init before receiving samples starts.
  *
  * @brief	Initializes Moving Average filter of Anode current samples.
- * 			Re-sets its variables to zero.
+ * 			Re-sets its variables to zero, size is set to MOVAVG_SIZE.
  */
 void movAvgInit(struct sMovAvg* movAvg);
 
 
+
+/*
+ * Call it when the filter is not used (samples stopped).
+ *
+ * @brief	Re-sets the filter with new length (1 - MOVAVG_SIZE_MAX).
+ */
+void movAvgResize(struct sMovAvg* movAvg, uint32_t size);
+
+
 float movAvgAddSample(struct sMovAvg* movAvg, float newSample);
 
 
 
+/*
+ * Call it before the first sample after a gap in the sample stream.
+ *
+ * @brief	If the gap is at least a quarter of the filter length, its content
+ * 			is stale and the next sample fills the whole buffer (output follows
+ * 			measurement at once). Shorter gaps just stretch the window a bit.
+ */
+void movAvgGap(struct sMovAvg* movAvg, uint32_t lost);
+
+
+
+/*
+ * Call it when the filter is not used (samples stopped), at init too.
+ *
+ * @brief	Re-sets the filter with new length (1 - uCapacity), 17 cycles,
+ * 			the buffer isn't cleared. Window starts with zeros, the same as
+ * 			movAvgResize().
+ */
+void movAvgIntResize(struct sMovAvgInt* movAvg, uint32_t size);
+
+
+
+/*
+ * Can be called from interrupts, constant time (ca. 40 cycles).
+ *
+ * @return	mean of the window in ADS codes - apply gain and offset on it
+ */
+float movAvgIntAddSample(struct sMovAvgInt* movAvg, int32_t newSample);
+
+
+
+/*
+ * @brief	The same as movAvgGap() - gaps of a quarter of the window make the
+ * 			next sample fill it, in constant time.
+ */
+void movAvgIntGap(struct sMovAvgInt* movAvg, uint32_t lost);
+
+
+
+/*
+ * Call it when the filter is not used (samples stopped), or from the same
+ * interrupt priority as filterAddSample().
+ *
+ * @brief	Sets stages of the filter for given sample rate and clears it, the
+ * 			next sample fills all stages. Moving average is limited by its
+ * 			buffer (movAvg.uCapacity).
+ */
+void filterConfigure(struct sFilter* filter, const struct sFilterConfig* config, float sampleRate);
+
+
+
+/*
+ * Can be called from interrupts, constant time.
+ *
+ * @return	filtered value in ADS codes - apply gain and offset on it
+ */
+float filterAddSample(struct sFilter* filter, int32_t newSample);
+
+
+
+/*
+ * @brief	Gaps longer than half of the filter delay make its content stale,
+ * 			the next sample fills all stages (see movAvgGap()).
+ */
+void filterGap(struct sFilter* filter, uint32_t lost);
+
+
+
+/*
+ * @return	group delay [s] of given stage, or of all of them with
+ * 			FILTER_STAGES_NUMBER_OF
+ */
+float filterGroupDelay(const struct sFilter* filter, enum eFilterStage stage);
+
+
+
+/*
+ * Can be called any time, takes a few us with interrupts disabled.
+ *
+ * @brief	Sets filter preset and configures the filter at the actual sample
+ * 			rate (if it's known, else at calibSampleRateSet()).
+ */
+void calibFilterSet(struct sFilter* filter, enum eFilterPreset preset);
+
+
+
+/*
+ * @return	name of the preset for UI
+ */
+const char* calibFilterName(enum eFilterPreset preset);
+
+
+
+/*
+ * Can be called any time, doesn't stop acquisition.
+ *
+ * @brief	Copies statistics of the last complete window of given channel, in
+ * 			its units (A, V). Ia and Uc are measured by MCU_LOW, Ue and Uf by
+ * 			MCU_HIGH - on MCU_LOW they're taken from uart frames.
+ *
+ * @return	false if there's no complete window yet
+ */
+bool calibStatsGet(enum eStatsChannel channel, enum eStatsPoint point, statsResult_t *result);
+
+
+
+/*
+ * Can be called any time, takes a few us with interrupts disabled.
+ *
+ * @brief	Sets statistics window [s] of ADS channels, in samples at the
+ * 			actual rate (at calibSampleRateSet() if it's not known yet).
+ */
+void calibStatsWindowSet(float window);
+
+
+
+/*
+ * Call it from uart receive interrupt (MCU_LOW), after System.meas is updated.
+ *
+ * @brief	Adds received Ue and Uf (before MCU_LOW filter) to statistics.
+ */
+void calibStatsUartSample(float extractVolt, float focusVolt);
+
+
+
+/*
+ * Call it when ADS data rate changes, with acquisition stopped (see
+ * adsDataRateCallback()).
+ *
+ * @brief	Configures ADS filter pipelines for the new rate with their
+ * 			presets, so moving average keeps MOVAVG_WINDOW (531 samples at
+ * 			32 kSPS) and EMA and biquad their time constants. Statistics
+ * 			windows and decimators are set for the new rate too.
+ */
+void calibSampleRateSet(float sampleRate);
+
+
+
 /*
  * Call it after receiving samples from ADS.
  *
- * @note	Data source and target is global System struct (must save samples to
- * 			System first).
+ * @note	Data is parsed in place by ADS driver (see adsSample_t), results go
+ * 			to global System struct. Samples lost before this one (data->lost)
+ * 			are reported to filters and regulator first.
+ */
+void calcualteSamples(const adsChannelData_t *data);
+
+
+
+/*
+ * Call it after receiving block of samples from ADS (ADS_SPI_USE_DMA_BLOCK).
+ *
+ * @brief	Processes samples in order, the same way as calcualteSamples() does
+ * 			for each of them. System.meas holds result of the last one.
+ */
+void calcualteSamplesBlock(const adsChannelData_t data[], uint32_t count);
+
+
+
+/*
+ * Call it from regulator tick (USE_DECIMATOR).
+ *
+ * @brief	Scales the latest decimator outputs of Ia and Uc channels.
+ *
+ * @return	false until decimators are filled after start or rate change
  */
-void calcualteSamples(void);
+bool calibDecimatedGet(float *anodeCurrent, float *cathodeVolt);
 
 
 
@@ -101,20 +445,125 @@ float getPumpDuty(float voltage);
 
 
 
-/* [DEBUG only]
- * Call it after every received samples.
+/*
+ * Can be called from interrupts, constant time.
  *
- * @brief	Sums hard-coded number of samples and averages it.
- * 			Used to measure offsets of all channels of ADS (only Ch0 and Ch1 now).
- * 			For best results, before this measurement user should short circuit
- * 			the corresponding outputs (e.g. Ia to GND, Ue to HVGND etc.).
+ * @brief	Returns PWM duty, which gives voltage magnitude at the regulated
+ * 			output in steady state (CALIB_TABLE_FF_UC, _UE or _UF). The model
+ * 			is linear as for the pump until the table is measured. Regulators
+ * 			add it to the output as feedforward, so their PI corrects only
+ * 			the residual.
+ */
+float getFeedforwardDuty(enum eCalibTable table, float voltage);
+
+
+
+/*
+ * Call it from main loop, with HV off and outputs short circuited (e.g. Ia to
+ * GND, Ue to HVGND etc.).
+ *
+ * @brief	Starts measurement of offsets of ADS channels (Ch0 and Ch1 of this
+ * 			MCU) over AUTOZERO_TIME. Samples are summed in the sample path,
+ * 			calibAutoZeroTask() applies the result and saves it to flash.
  *
- * @note	For now, there is no possibility to call it from UI and is only used
- * 			with debugger, activated by un-commenting call and outputs to SWO.
- * 			It is possible to integrate it into UI, to allow re-calibrate
- * 			offsets on demand.
+ * @return	false if it's running already or ADS rate isn't set yet
+ */
+bool calibAutoZeroStart(void);
+
+
+
+void calibAutoZeroAbort(void);
+
+
+
+/*
+ * Call it in main loop.
+ *
+ * @brief	When measurement is done, checks offsets (AUTOZERO_OFFSET_MAX),
+ * 			applies them and saves calibration record to flash, which is loaded
+ * 			by initCoefficients() at boot.
+ */
+void calibAutoZeroTask(void);
+
+
+
+/*
+ * @param	progress - 0 to 1 of the measurement, can be NULL
+ */
+enum eAutoZero calibAutoZeroState(float *progress);
+
+
+
+/*
+ * @brief	Gets offsets [bit] in use: MCU_LOW Ia and Uc, MCU_HIGH Ue and Uf.
+ */
+void calibOffsetsGet(int32_t *offsetCh0, int32_t *offsetCh1);
+
+
+
+/*
+ * Call it from main loop, flash is stalled for ca. 22 ms.
+ *
+ * @brief	Sets calibration table of given channel: points (code after
+ * 			offset, value) for ADS channels, (mV, duty) for the pump and
+ * 			feedforward. It's
+ * 			compiled to lookup table (see lut.h), swapped with interrupts
+ * 			disabled and saved to flash with offsets. Table with less than 2
+ * 			points restores the linear default.
+ *
+ * @return	false if table is invalid (nothing changed) or flash write failed
+ */
+bool calibTableSet(enum eCalibTable channel, const lutTable_t *table);
+
+
+
+/*
+ * @brief	Input of the point calibPointAdd() would add now: the latest
+ * 			decimator output after offset [bit] for ADS channels (MCU_LOW), PWM
+ * 			duty in use for the pump and duty of the regulating loop for
+ * 			feedforward tables (steady state, see regulatorDutyGet()).
+ *
+ * @return	false if it isn't known (decimator not filled yet, loop not
+ * 			regulating, other table)
+ */
+bool calibPointInput(enum eCalibTable table, float *input);
+
+
+
+/*
+ * Call it from main loop, points are collected in RAM until calibPointsSave().
+ *
+ * @brief	Adds calibration point for reference value [V, A] read from
+ * 			external meter now: (input, reference) for ADS channels and
+ * 			(reference [mV], duty) for the pump and feedforward tables, input
+ * 			from calibPointInput().
+ * 			Points are kept ascending, the one at the same input is replaced.
+ *
+ * @return	false if table is full or input isn't known
+ */
+bool calibPointAdd(enum eCalibTable table, float reference);
+
+
+
+uint32_t calibPointsCount(enum eCalibTable table);
+
+
+
+/*
+ * Call it from main loop with HV off, flash is stalled for ca. 22 ms.
+ *
+ * @brief	Sets collected points as the table of the channel (see
+ * 			calibTableSet()), with less than 2 of them the linear default is
+ * 			restored. Points are cleared then.
+ */
+bool calibPointsSave(enum eCalibTable table);
+
+
+
+/*
+ * @brief	Drops points collected for all tables, tables in use don't change.
  */
-void calibOffset(void);
+void calibPointsClear(void);
 
 
 
@@ -0,0 +1,66 @@
+/*
+ * crc.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Config --------------------------------------------------------------------*/
+
+/*
+ * Use CRC peripheral of the MCU. Both CRCs are checked with their check values
+ * at crcInit() and software tables are used if the peripheral gives different
+ * result. Comment it out to use software tables only.
+ */
+#define CRC_USE_HW_ENGINE
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * Call it once at system init, before ADS and UART communication start.
+ *
+ * @brief	Enables CRC peripheral clock and checks the hardware engine with
+ * 			check values of both CRCs. Tables are tested against bit-by-bit
+ * 			reference implementations on host (Tests/test_crc.c).
+ *
+ * @return	true if hardware engine is used
+ */
+bool crcInit(void);
+
+
+
+/*
+ * Can be called from interrupts and main loop, hardware engine is guarded by
+ * disabling interrupts for the calculation time (ca. 1 us for ADS frame).
+ *
+ * @brief	CRC-16/CCITT: polynomial 0x1021, init 0xFFFF, MSB first - the ADS131M0x
+ * 			CRC_CCITT type.
+ */
+uint16_t crc16ccitt(const uint8_t *data, uint32_t length);
+
+
+
+/*
+ * Can be called from interrupts and main loop, see crc16ccitt().
+ *
+ * @brief	CRC-8/MAXIM: polynomial 0x31 reflected (0x8C), init 0x00, LSB first.
+ * 			Used for UART frames between MCUs and config stored in flash.
+ */
+uint8_t crc8(const uint8_t *data, uint32_t length);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
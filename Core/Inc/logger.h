@@ -12,10 +12,14 @@
 #define LOGGER_250ms	// 2 kS --> 500 s = 8 min 33 s
 //#define LOGGER_10ms		// 2 kS --> 20 s
 #define LOGGER_HF
+#define LOGGER_HF_RATE_MAX	(2000.0f)	// [Hz] faster ADS rates are decimated, 4x 2 kS = 4 s
 
 //#define LOGGER_BEFORE_FILTER
 #define LOGGER_AFTER_FILTER
 
+// log setpoints from trajectory generators instead of measurement (10/250 ms)
+//#define LOGGER_LOG_SETPOINTS
+
 #ifdef MCU_LOW
 //	#define LOGGER_LOG_HF_IA
 	#define LOGGER_LOG_HF_UC
@@ -45,6 +49,8 @@ enum eLoggerMode
 void loggerInit(void);
 void loggerPeriod(void);
 void loggerHighFreqSample(void);
+void loggerSampleRateSet(float sampleRate);
+float loggerHighFreqPeriodGet(void);
 
 void sweepUeInit(void);
 void sweepUePeriod(void);
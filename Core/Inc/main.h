@@ -46,12 +46,17 @@ extern "C" {
 
 //#define ADS_SPI_USE_INT		// read ADS using SPI interrupts
 #define ADS_SPI_USE_DMA
+#define ADS_SPI_USE_DMA_BLOCK	// DMA frames into circular buffer, process them once per half-block
 #define ADS_CHECK_CRC
 
 #if (defined (MCU_LOW) && defined (MCU_HIGH)) || ( !defined (MCU_LOW) && !defined (MCU_HIGH))
 	#error "wrong MCU selected - choose MCU_LOW or MCU_HIGH"
 #endif
 
+#if defined (ADS_SPI_USE_DMA_BLOCK) && !defined (ADS_SPI_USE_DMA)
+	#error "ADS_SPI_USE_DMA_BLOCK is a variant of ADS_SPI_USE_DMA - define both"
+#endif
+
 /* USER CODE END ET */
 
 /* Exported constants --------------------------------------------------------*/
@@ -148,13 +153,29 @@ extern ADC_HandleTypeDef hadc1;
 extern I2C_HandleTypeDef hi2c1;
 extern SPI_HandleTypeDef hspi1;
 extern SPI_HandleTypeDef hspi2;
+extern DMA_HandleTypeDef hdma_spi1_rx;
+extern DMA_HandleTypeDef hdma_spi1_tx;
 extern TIM_HandleTypeDef htim1;
 extern TIM_HandleTypeDef htim6;
 extern UART_HandleTypeDef huart1;
 
+// high side power sequencer, see highSideTask()
+enum eHighSideState
+{
+	HS_OFF = 0,
+	HS_POWER_UP,		// 12 V on, waiting for frames from MCU_HIGH
+	HS_ON,				// regulators running
+	HS_RAMP_DOWN,		// setpoints ramp to 0
+	HS_DISCHARGE,		// outputs off, waiting for voltages to fall
+	HS_POWER_OFF,		// 12 V off
+	HS_UART_TEARDOWN,
+};
+
 // export functions
 void highSideStart(void);
 void highSideShutdown(void);
+void highSideTask(void);
+enum eHighSideState highSideState(uint32_t *stageTime);
 
 
 
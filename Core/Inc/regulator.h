@@ -11,9 +11,59 @@
 extern "C" {
 #endif
 
+#include "autotune.h"		// for auto-tuning states and rules
 #include "pid_controller.h"	// for PIDControl type
+#include "trajectory.h"		// for traj_t type
 #include "stm32l4xx_hal.h" // for TIM registers
 
+/* Config --------------------------------------------------------------------*/
+
+/*
+ * Regulators run every PID_PERIOD from TIM6 (decimation 0), or in the ADS
+ * sample path on every N-th sample, on filtered measurement of the sample just
+ * processed (see regulatorSyncSet()). It's a setting (System.ref.uRegSync),
+ * REGULATOR_SYNC_DECIMATION is its default.
+ *
+ * Sample path runs in PendSV with ADS_SPI_USE_DMA_BLOCK, in ADS interrupt
+ * otherwise. Decimation is limited, so regulators don't run faster than
+ * REGULATOR_SYNC_RATE_MAX: 23 us per run at O3 is 4.6 % of CPU, and at most
+ * one run per ADS_BLOCK_HALF samples (125 us) at 31250 SPS.
+ */
+#define REGULATOR_SYNC_DECIMATION		0
+#define REGULATOR_SYNC_DECIMATION_MAX	(64)
+#define REGULATOR_SYNC_RATE_MAX			(2000.0f)	// [Hz]
+
+/*
+ * Voltage loops add duty of the output model (getFeedforwardDuty()) at their
+ * setpoint, so a setpoint step lands near its final duty at once and PI only
+ * corrects the residual. Ia loop has no model, it's PI only.
+ */
+#define USE_FEEDFORWARD
+
+/*
+ * pwmSetDuty() only computes compare values, pwmCommit() applies all four at
+ * once. With the burst, pwmCommit() arms DMA1 Channel6 (TIM1_UP), which copies
+ * them to CCR1..CCR4 (DCR and DMAR) at the next update event, preload makes
+ * them valid together at the one after. A burst still running is waited for
+ * (under 1 us, interrupts disabled). Without it pwmCommit() writes CCRs one
+ * by one. The DMA channel is set up by pwmInit(), not in CubeMX - keep it free
+ * in the .ioc.
+ */
+#define USE_PWM_DMA_BURST
+
+/*
+ * PWM period shorter by PWM_DITHER_BITS (2048 ticks, 39 kHz instead of 1.2 kHz)
+ * for less ripple of the multipliers. The lost bits of the 16-bit compare
+ * value come back by first order sigma-delta over a pattern of 2^bits periods,
+ * one burst per period (see pwmCommit()). Off until checked with the drivers
+ * of the multipliers.
+ */
+//#define USE_PWM_DITHER
+#define PWM_DITHER_BITS		(5)
+#if defined (USE_PWM_DITHER) && !defined (USE_PWM_DMA_BURST)
+	#error "USE_PWM_DITHER needs USE_PWM_DMA_BURST"
+#endif
+
 /* Exported types ------------------------------------------------------------*/
 
 enum ePwmChannel
@@ -25,34 +75,25 @@ enum ePwmChannel
 	REG_IA,		// used in regulator functions, not PWM
 };
 
-extern PIDControl pidUc, pidUe, pidUf, pidIa;
+extern PIDControl pidUc, pidUe, pidUf, pidIa;	// setup (gains etc.), state is kept by the regulator
+extern traj_t trajUc, trajUe, trajUf, trajIa;	// setpoints of the loops, for logging
+
+extern uint32_t pwmCompare[4];	// CCR1..CCR4 for the next pwmCommit()
 
 /* Exported snippets ---------------------------------------------------------*/
 
+/*
+ * Output is changed by pwmCommit(), for all channels at once.
+ */
 static inline void pwmSetDuty(enum ePwmChannel PWM_CHANNEL_, float duty)
 {
-	if (duty > 1.0f)
+	if ((duty > 1.0f) || (PWM_CHANNEL_ > PWM_CHANNEL_PUMP))
 	{
 		return;
 	}
 
-	switch (PWM_CHANNEL_)
-	{
-	case PWM_CHANNEL_UC:
-		TIM1->CCR1 = (uint32_t)(65535.0 * duty);
-		break;
-	case PWM_CHANNEL_UE:
-		TIM1->CCR2 = (uint32_t)(65535.0 * duty);
-		break;
-	case PWM_CHANNEL_UF:
-		TIM1->CCR3 = (uint32_t)(65535.0 * duty);
-		break;
-	case PWM_CHANNEL_PUMP:
-		TIM1->CCR4 = (uint32_t)(65535.0 * duty);
-		break;
-	case REG_IA:
-		break;
-	}
+	// single precision, saturated to 0 .. 65535 in integer
+	pwmCompare[PWM_CHANNEL_ >> 2] = __USAT((int32_t)(65535.0f * duty), 16);	// TIM_CHANNEL_x is 4 * (x - 1)
 }
 
 /* Exported functions --------------------------------------------------------*/
@@ -60,10 +101,27 @@ static inline void pwmSetDuty(enum ePwmChannel PWM_CHANNEL_, float duty)
 void regulatorInit(void);
 void regulatorInitCurrent(void);
 void regulatorDeInit(void);
+void regulatorRampDown(void);
+bool regulatorRampDone(void);
 
 void regulatorPeriodCallback(void);
+void regulatorSample(void);
+void regulatorSampleGap(uint32_t lost);
+void regulatorSampleRateSet(float sampleRate);
+void regulatorSyncSet(uint32_t decimation);
+uint32_t regulatorSyncGet(void);
+uint32_t regulatorSyncLimit(uint32_t decimation, float sampleRate);
+float regulatorPeriodGet(void);
+bool regulatorDutyGet(enum ePwmChannel loop, float *duty);
+void pwmInit(void);
+void pwmCommit(void);
 void pwmSetVoltManual(enum ePwmChannel PWM_CHANNEL_, float voltage);
-void pidMeasOscPeriod(enum ePwmChannel PWM_CHANNEL_);	// for PID tuning
+void pidMeasOscPeriod(enum ePwmChannel PWM_CHANNEL_, uint32_t timestamp);	// for PID tuning
+bool regulatorTuneStart(enum ePwmChannel loop);
+void regulatorTuneStop(void);
+enum eAutotuneState regulatorTuneState(uint32_t *cycles, enum ePwmChannel *loop);
+bool regulatorTuneResult(enum eTuneRule rule, float *ku, float *tu, float *kp, float *ki, float *kd);
+bool regulatorTuneAccept(enum eTuneRule rule);
 
 #ifdef __cplusplus
 }
@@ -12,6 +12,7 @@ extern "C" {
 
 #include "logger.h"	// for eLoggerMode definition
 #include "ads131m0x.h"
+#include "calibration.h"	// for eFilterPreset definition
 #include "ui.h"
 
 
@@ -53,6 +54,10 @@ typedef struct
 	uint32_t uAnodeCurrent;		// 0.01 uA unit - for settings
 	enum eExtMode extMode;
 	enum eLoggerMode loggerMode;	// choose value to log
+	enum eAdsRate adsRate;			// ADS output data rate
+	enum eFilterPreset filterIa;	// ADS channel filters
+	enum eFilterPreset filterUc;
+	uint32_t uRegSync;				// regulators on every N-th ADS sample, 0 - TIM6
 } tsRegulatedVal;
 
 struct sSystem
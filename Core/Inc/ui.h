@@ -20,6 +20,12 @@ enum eScreen
 	SCREEN_1,	// UK Ia Pa
 	SCREEN_2,	// Ue Uf Up
 	SCREEN_CONTROL_UE,
+	SCREEN_ADS,	// data rate, filters
+	SCREEN_TIMING,	// ADS sample period, jitter, latency
+	SCREEN_RIPPLE,	// Uc and Ia peak-to-peak and RMS ripple
+	SCREEN_AUTOZERO,	// offsets auto-zero, entered from SCREEN_ADS
+	SCREEN_TUNE,	// PID relay auto-tuning, entered from SCREEN_1
+	SCREEN_CALIB,	// calibration table points, entered from SCREEN_AUTOZERO
 
 	// settings screens group 1
 	SCREEN_SET_IA,
@@ -33,12 +39,19 @@ enum eScreen
 	SCREEN_SET_UEMODE,
 	SCREEN_SET_LOGGER,
 
+	// settings screens group 3
+	SCREEN_SET_ADSRATE,
+	SCREEN_SET_FILTER_IA,
+	SCREEN_SET_FILTER_UC,
+	SCREEN_SET_REGSYNC,
+
 	// text only screens
 	SCREEN_POWERON_1,
 	SCREEN_POWERON_2,
 	SCREEN_POWEROFF,
 	SCREEN_AUTOPOWEROFF,
 	SCREEN_LOWBATT,
+	SCREEN_DISCHARGE,	// HV shutdown progress, back to SCREEN_1 when off
 };
 
 /* Exported functions --------------------------------------------------------*/
@@ -48,6 +61,7 @@ void uiInit(void);
 void uiScreenChange(enum eScreen newScreen);
 uint32_t uiGetScreenTime(void);
 void uiScreenUpdate(void);
+void uiPowerOff(enum eScreen screen, bool bSaveConfig);
 
 void encoderKnob_buttonCallback(void);
 void encoderKnob_turnCallback(void);
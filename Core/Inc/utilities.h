@@ -11,6 +11,7 @@
 #include "main.h"	// for GPIO's name definition, HAL lib, System struct
 #include "printf.h"	// for SPAM macro
 #include "typedefs.h"	// for tsRegulatedVal definition
+#include "calibration.h"	// for calibration tables
 
 /* Exported types ------------------------------------------------------------*/
 
@@ -38,6 +39,32 @@ typedef union
 
 extern tuFlashData uFlashData;
 
+/*
+ * Calibration record, stored in its own page (FLASHSTORAGE1), so it isn't
+ * lost when tsRegulatedVal changes. Tables with less than 2 points aren't set,
+ * linear defaults are used then.
+ */
+typedef struct
+{
+	int32_t offsetCh0;	// [bit] MCU_LOW: Ia, MCU_HIGH: Ue
+	int32_t offsetCh1;	// [bit] MCU_LOW: Uc, MCU_HIGH: Uf
+	lutTable_t table[CALIB_TABLES_NUMBER_OF];	// see enum eCalibTable
+} tsCalibRecord;
+
+#define FLASH_CALIB_PARTS	((uint32_t)((sizeof(tsCalibRecord)/sizeof(uint64_t))+1))
+
+typedef union
+{
+	struct
+	{
+		tsCalibRecord data;
+		uint8_t crc;
+	} flashData;
+
+	uint64_t buff64[FLASH_CALIB_PARTS];
+	uint8_t buff8[FLASH_CALIB_PARTS * sizeof(uint64_t)];
+} tuFlashCalib;
+
 /* Exported inline snippets --------------------------------------------------*/
 
 static inline void HAL_GPIO_WritePinLow(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
@@ -142,12 +169,21 @@ static inline void testpin29(bool state)
 void delay_us(uint32_t us);
 static inline void delay_ms(uint32_t ms) { while ( ms-- ) delay_us(1000); }
 
-uint8_t crc8(const uint8_t *, uint32_t);
+/*
+ * Enables DWT cycle counter (DWT->CYCCNT, 80 MHz) used for time measurements.
+ */
+static inline void dwtInit(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
 
 void ledDemo(void);
 void ledError(uint32_t);
 
 bool flashReadConfig(void);
 void flashSaveConfig(void);
+bool flashReadCalib(tsCalibRecord *record);
+bool flashSaveCalib(const tsCalibRecord *record);
 
 /************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -5,18 +5,23 @@
  *      Author: Lukasz Sitarek
  */
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include "calibration.h"
 #include "communication.h"
 #include "main.h"
 #include "regulator.h"	// for debug defines PWM_CHANNEL_
 #include "typedefs.h"
+#include "utilities.h"	// for flash calibration record
 
 /* Private defines -----------------------------------------------------------*/
 
 typedef struct
 {
-	float gain;
-	int32_t offset;
+	float gain;			// linear default, if there's no calibration table
+	int32_t offset;		// [bit] subtracted before lookup
+	lut_t *lut;			// NULL - channel of the other MCU
 } tsCoeff;
 
 // default coefficients
@@ -26,16 +31,136 @@ static const float fCoeffUfDefault = 1.2f * (100e+3/24e+3) * (100e+6/76744.2f) /
 static const float fCoeffIaDefault = (-1.0f) * 1.2f * (100e+3/47e+3) * (1.0f/51e+3) / ((float)(1u << 23));	// [A/bit] // 1.1985 V on ADC at 50 uA in
 static const float fCoeffUpDefault = 1.0f/((6000.0f/12.0f) * (16300.0f/4300.0f) * 3.3f);	// [duty/V] // 0.959286 duty at 6 kV out and 3.3V ref
 
+// lookup tables of ADS channels of this MCU, see enum eCalibTable
+static lut_t lutCh0, lutCh1;
+
 // coeff variables (init with above values)
-static tsCoeff fCoeffUc = {0.000794728636f, 0};
-static tsCoeff fCoeffUe = {0.000776666449f, 0};
-static tsCoeff fCoeffUf = {0.000776666449f, 0};
-static tsCoeff fCoeffIa = {-5.96792451e-12, 0};
+#ifdef MCU_HIGH
+static tsCoeff fCoeffUc = {.gain = 0.000794728636f, .offset = 0, .lut = NULL};
+static tsCoeff fCoeffUe = {.gain = 0.000776666449f, .offset = 0, .lut = &lutCh0};
+static tsCoeff fCoeffUf = {.gain = 0.000776666449f, .offset = 0, .lut = &lutCh1};
+static tsCoeff fCoeffIa = {.gain = -5.96792451e-12, .offset = 0, .lut = NULL};
+#else
+static tsCoeff fCoeffUc = {.gain = 0.000794728636f, .offset = 0, .lut = &lutCh1};
+static tsCoeff fCoeffUe = {.gain = 0.000776666449f, .offset = 0, .lut = NULL};
+static tsCoeff fCoeffUf = {.gain = 0.000776666449f, .offset = 0, .lut = NULL};
+static tsCoeff fCoeffIa = {.gain = -5.96792451e-12, .offset = 0, .lut = &lutCh0};
+#endif
 //static tsCoeff fCoeffUp = {0.000159881019f, 0};
 static struct {
-	float gain;
-	float offset;
-} fCoeffUp = {0.000159881019f, 0};
+	float gain;		// [duty/V]
+	float offset;	// [V]
+	lut_t lut;		// [mV -> duty]
+} fCoeffUp = {.gain = 0.000159881019f, .offset = 0};
+
+// static models of regulated outputs, linear as fCoeffUpDefault if not measured
+static lut_t lutFeedUc, lutFeedUe, lutFeedUf;	// [mV -> duty]
+
+// offsets and tables as in flash
+static tsCalibRecord calibRecord;
+
+// points being collected by calibPointAdd(), not in use until calibPointsSave()
+static lutTable_t calibPoints[CALIB_TABLES_NUMBER_OF];
+
+// auto-zero, samples are summed by ADS interrupt
+static struct
+{
+	volatile enum eAutoZero state;
+	uint32_t samples;	// to sum
+	uint32_t count;
+	int64_t sumCh0;
+	int64_t sumCh1;
+	int32_t offsetCh0;	// result
+	int32_t offsetCh1;
+} autoZero;
+
+/* Private functions ---------------------------------------------------------*/
+
+/*
+ * Compiles table, or linear default if it isn't set, and swaps the lookup
+ * table with interrupts disabled.
+ * @return 0 - table is invalid, lut not changed
+ */
+static bool lutSwap(lut_t *lut, const lutTable_t *table, float gain, int32_t xMin, uint32_t log2Range)
+{
+	static lut_t lutNew;	// 1 kB, not on stack
+	lutTable_t linear;
+	uint32_t primask;
+
+	if (table->count < 2)
+	{
+		lutLinear(&linear, gain, xMin, log2Range);
+		table = &linear;
+	}
+	if (!lutCompile(&lutNew, table, xMin, log2Range))
+		return false;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*lut = lutNew;
+	__set_PRIMASK(primask);
+	return true;
+}
+
+
+
+static bool calibTableCompile(enum eCalibTable channel, const lutTable_t *table)
+{
+	switch (channel)
+	{
+#ifdef MCU_HIGH
+	case CALIB_TABLE_CH0:
+		return lutSwap(fCoeffUe.lut, table, fCoeffUe.gain, CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE);
+	case CALIB_TABLE_CH1:
+		return lutSwap(fCoeffUf.lut, table, fCoeffUf.gain, CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE);
+#else
+	case CALIB_TABLE_CH0:
+		return lutSwap(fCoeffIa.lut, table, fCoeffIa.gain, CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE);
+	case CALIB_TABLE_CH1:
+		return lutSwap(fCoeffUc.lut, table, fCoeffUc.gain, CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE);
+#endif
+	case CALIB_TABLE_PUMP:
+		return lutSwap(&fCoeffUp.lut, table, fCoeffUp.gain / 1000.0f, CALIB_PUMP_MIN, CALIB_PUMP_LOG2_RANGE);
+	case CALIB_TABLE_FF_UC:
+		return lutSwap(&lutFeedUc, table, fCoeffUpDefault / 1000.0f, CALIB_PUMP_MIN, CALIB_PUMP_LOG2_RANGE);
+	case CALIB_TABLE_FF_UE:
+		return lutSwap(&lutFeedUe, table, fCoeffUpDefault / 1000.0f, CALIB_PUMP_MIN, CALIB_PUMP_LOG2_RANGE);
+	case CALIB_TABLE_FF_UF:
+		return lutSwap(&lutFeedUf, table, fCoeffUpDefault / 1000.0f, CALIB_PUMP_MIN, CALIB_PUMP_LOG2_RANGE);
+	default:
+		return false;
+	}
+}
+
+
+
+/*
+ * Output voltage [V] to the table input [mV], within its range.
+ */
+static inline int32_t voltToTable(float voltage)
+{
+	float mV = 1000.0f * voltage;
+
+	// below 0 it's clamped anyway, above the range float conversion is UB
+	if (mV >= (float)((CALIB_PUMP_MIN + (1 << CALIB_PUMP_LOG2_RANGE)) - 1))
+		mV = (float)((CALIB_PUMP_MIN + (1 << CALIB_PUMP_LOG2_RANGE)) - 1);
+	else if (mV < 0.0f)
+		mV = 0.0f;
+
+	return (int32_t)(mV + 0.5f);
+}
+
+
+
+/*
+ * Rounds filtered code after offset to the table input.
+ */
+static inline float coeffEval(const tsCoeff *coeff, float code)
+{
+	float x = code - (float)coeff->offset;
+
+	return lutEval(coeff->lut, (int32_t)(x + ((x >= 0.0f) ? 0.5f : -0.5f)));
+}
 
 /* Exported functions --------------------------------------------------------*/
 
@@ -44,6 +169,8 @@ static struct {
  */
 void initCoefficients(void)
 {
+	tsCalibRecord record;
+
 	// MCU_LOW Ch0
 	fCoeffIa.gain = fCoeffIaDefault * (10.0f/9.62f);	// (meas external ref / meas ADS)	// [A/bit]
 	fCoeffIa.offset = -37850;			// [bit]
@@ -62,39 +189,38 @@ void initCoefficients(void)
 
 	fCoeffUp.gain = fCoeffUpDefault;	// [duty/V]
 	fCoeffUp.offset = 0;				// [V]
-}
-
 
+	memset(&calibRecord, 0, sizeof(calibRecord));
+#ifdef MCU_HIGH
+	calibRecord.offsetCh0 = fCoeffUe.offset;
+	calibRecord.offsetCh1 = fCoeffUf.offset;
+#else
+	calibRecord.offsetCh0 = fCoeffIa.offset;
+	calibRecord.offsetCh1 = fCoeffUc.offset;
+#endif
 
-/*
- * Call this function after every received samples.
- */
-void calibOffset(void)
-{
-	static int32_t sumCh0 = 0, sumCh1 = 0;
-	static int32_t index = 0;
-	const int32_t samplesNo = 10000;
-
-	sumCh0 += System.ads.data.channel0;
-	sumCh1 += System.ads.data.channel1;
-	index++;
-
-	if (index > samplesNo)
+	// offsets measured by auto-zero and tables override the above ones
+	if (flashReadCalib(&record) == false)
 	{
-		__NOP();
-		sumCh0 /= samplesNo;
-		sumCh1 /= samplesNo;
+		calibRecord = record;
 #ifdef MCU_HIGH
-		SPAM(("Ue (MCU_HIGH Ch0) offset: %i\n", sumCh0));	// MCU_LOW: Ia, MCU_HIGH: Ue
-		SPAM(("Uf (MCU_HIGH Ch1) offset: %i\n", sumCh1)); // MCU_LOW: Uc, MCU_HIGH: Uf
+		fCoeffUe.offset = record.offsetCh0;
+		fCoeffUf.offset = record.offsetCh1;
 #else
-		SPAM(("Ia (MCU_LOW Ch0) offset: %i\n", sumCh0));	// MCU_LOW: Ia, MCU_HIGH: Ue
-		SPAM(("Uc (MCU_LOW Ch1) offset: %i\n", sumCh1)); // MCU_LOW: Uc, MCU_HIGH: Uf
+		fCoeffIa.offset = record.offsetCh0;
+		fCoeffUc.offset = record.offsetCh1;
 #endif
-		// reset variables
-		sumCh0 = 0;
-		sumCh1 = 0;
-		index = 0;
+		SPAM(("Offsets loaded from flash: %i, %i\n", record.offsetCh0, record.offsetCh1));
+	}
+
+	for (uint32_t i = 0; i < CALIB_TABLES_NUMBER_OF; i++)
+	{
+		if (!calibTableCompile(i, &calibRecord.table[i]))
+		{
+			SPAM(("Calibration table %u invalid, linear default used\n", i));
+			calibRecord.table[i].count = 0;
+			calibTableCompile(i, &calibRecord.table[i]);
+		}
 	}
 }
 
@@ -102,19 +228,76 @@ void calibOffset(void)
 
 /* Moving average filter -----------------------------------------------------*/
 
-struct sMovAvg	movAvgIa, 		\
-				movAvgUc, 		\
-				movAvgUe, 		\
-				movAvgUf,		\
+struct sMovAvg	movAvgUeUart,	\
+				movAvgUfUart,	\
 				movAvgAdcBatt;	\
 
+// ADS filters, only the local channels have moving average buffers
+#ifdef MCU_HIGH
+static int32_t movAvgUeBuff[MOVAVG_ADS_SIZE_MAX];
+static int32_t movAvgUfBuff[MOVAVG_ADS_SIZE_MAX];
+struct sFilter filterIa, filterUc;
+struct sFilter filterUe = { .movAvg = { .iBuff = movAvgUeBuff, .uCapacity = MOVAVG_ADS_SIZE_MAX } };
+struct sFilter filterUf = { .movAvg = { .iBuff = movAvgUfBuff, .uCapacity = MOVAVG_ADS_SIZE_MAX } };
+#else
+static int32_t movAvgIaBuff[MOVAVG_ADS_SIZE_MAX];
+static int32_t movAvgUcBuff[MOVAVG_ADS_SIZE_MAX];
+struct sFilter filterIa = { .movAvg = { .iBuff = movAvgIaBuff, .uCapacity = MOVAVG_ADS_SIZE_MAX } };
+struct sFilter filterUc = { .movAvg = { .iBuff = movAvgUcBuff, .uCapacity = MOVAVG_ADS_SIZE_MAX } };
+struct sFilter filterUe, filterUf;
+#endif
+
+static const struct sFilterConfig filterPresets[FILTER_PRESETS_NUMBER_OF] =
+{
+	[FILTER_OFF]	 = { "Off",		1, 0.0f,			0.0f,			0.0f },
+	[FILTER_MA]		 = { "MA",		1, MOVAVG_WINDOW,	0.0f,			0.0f },
+	[FILTER_MED_MA]	 = { "Med+MA",	3, MOVAVG_WINDOW,	0.0f,			0.0f },
+	[FILTER_EMA]	 = { "EMA",		1, 0.0f,			FILTER_EMA_TAU,	0.0f },
+	[FILTER_MED_EMA] = { "Med+EMA",	3, 0.0f,			FILTER_EMA_TAU,	0.0f },
+	[FILTER_LP]		 = { "LP2",		1, 0.0f,			0.0f,			FILTER_BIQUAD_FC },
+	[FILTER_MA_LP]	 = { "MA+LP2",	1, MOVAVG_WINDOW,	0.0f,			FILTER_BIQUAD_FC },
+};
+
+static float fSampleRate;	// actual ADS rate, 0 until calibSampleRateSet()
+
+#ifdef USE_STATS
+static float fStatsWindow = STATS_WINDOW;
+	#ifdef MCU_HIGH
+static stats_t stats[STATS_CHANNELS_NUMBER_OF][STATS_POINTS_NUMBER_OF];
+	#else
+static stats_t stats[STATS_CHANNELS_NUMBER_OF][STATS_POINTS_NUMBER_OF] =
+{
+	[STATS_UE] = { { .size = STATS_UART_WINDOW }, { .size = STATS_UART_WINDOW } },
+	[STATS_UF] = { { .size = STATS_UART_WINDOW }, { .size = STATS_UART_WINDOW } },
+};
+	#endif
+#endif
+
+#ifdef USE_DECIMATOR
+static decimator_t decimIa, decimUc;
+#endif
+
 void movAvgInit(struct sMovAvg* movAvg)
 {
+	movAvgResize(movAvg, MOVAVG_SIZE);
+}
+
+
+
+void movAvgResize(struct sMovAvg* movAvg, uint32_t size)
+{
+	if (size < 1)
+		size = 1;
+	else if (size > MOVAVG_SIZE_MAX)
+		size = MOVAVG_SIZE_MAX;
+
 	movAvg->fSum = 0.0f;
 	movAvg->uIndex = 0;
+	movAvg->uSize = size;
+	movAvg->bRefill = false;
 
 	// set buff to 0.0 float (not 0x00 hex)
-	for (uint32_t i=0; i<MOVAVG_SIZE; i++)
+	for (uint32_t i=0; i<MOVAVG_SIZE_MAX; i++)
 		movAvg->fBuff[i] = 0.0f;
 }
 
@@ -122,6 +305,16 @@ void movAvgInit(struct sMovAvg* movAvg)
 
 float movAvgAddSample(struct sMovAvg* movAvg, float newSample)
 {
+	if (movAvg->bRefill)
+	{
+		for (uint32_t i=0; i<movAvg->uSize; i++)
+			movAvg->fBuff[i] = newSample;
+		movAvg->fSum = newSample * (float)movAvg->uSize;
+		movAvg->uIndex = 0;
+		movAvg->bRefill = false;
+		return newSample;
+	}
+
 	// remove oldest sample from sum
 	movAvg->fSum -= movAvg->fBuff[movAvg->uIndex];
 	// replace the old sample with new
@@ -131,17 +324,703 @@ float movAvgAddSample(struct sMovAvg* movAvg, float newSample)
 	// point to next (oldest) sample
 	movAvg->uIndex++;
 	// wrap buffer
-	if (movAvg->uIndex >= MOVAVG_SIZE)
+	if (movAvg->uIndex >= movAvg->uSize)
 	{
 		// numeric error may accumulate and it may be necessary to re-calculate the sum after some time
 		movAvg->fSum = 0.0f;
-		for (uint32_t i=0; i<MOVAVG_SIZE; i++)
+		for (uint32_t i=0; i<movAvg->uSize; i++)
 			movAvg->fSum += movAvg->fBuff[i];
 
 		movAvg->uIndex = 0;
 	}
 
-	return movAvg->fSum / ((float)MOVAVG_SIZE);
+	return movAvg->fSum / ((float)movAvg->uSize);
+}
+
+
+
+void movAvgGap(struct sMovAvg* movAvg, uint32_t lost)
+{
+	if (4 * lost >= movAvg->uSize)
+		movAvg->bRefill = true;
+}
+
+
+
+void movAvgIntResize(struct sMovAvgInt* movAvg, uint32_t size)
+{
+	if (size < 1)
+		size = 1;
+	else if (size > movAvg->uCapacity)
+		size = movAvg->uCapacity;
+
+	movAvg->iSum = 0;
+	movAvg->uIndex = 0;
+	movAvg->uSize = size;
+	movAvg->fInvSize = 1.0f / (float)size;
+	movAvg->uStale = size;
+	movAvg->iStale = 0;
+	movAvg->bRefill = false;
+}
+
+
+
+_OPT_O3 float movAvgIntAddSample(struct sMovAvgInt* movAvg, int32_t newSample)
+{
+	int32_t oldest;
+
+	if (movAvg->bRefill)
+	{
+		movAvg->bRefill = false;
+		movAvg->uStale = movAvg->uSize;
+		movAvg->iStale = newSample;
+		movAvg->iSum = (int64_t)newSample * movAvg->uSize;
+	}
+
+	if (movAvg->uStale > 0)
+	{
+		movAvg->uStale--;
+		oldest = movAvg->iStale;
+	}
+	else
+		oldest = movAvg->iBuff[movAvg->uIndex];
+
+	movAvg->iSum += newSample - oldest;
+	movAvg->iBuff[movAvg->uIndex] = newSample;
+	if (++movAvg->uIndex >= movAvg->uSize)
+		movAvg->uIndex = 0;
+
+	return (float)movAvg->iSum * movAvg->fInvSize;
+}
+
+
+
+void movAvgIntGap(struct sMovAvgInt* movAvg, uint32_t lost)
+{
+	if (4 * lost >= movAvg->uSize)
+		movAvg->bRefill = true;
+}
+
+
+
+/* Filter pipeline -----------------------------------------------------------*/
+
+/*
+ * Designs stages without touching their state (and buffers).
+ */
+static void filterDesign(struct sFilter* filter, const struct sFilterConfig* config, float sampleRate)
+{
+	float delay = 0.0f;	// [samples]
+
+	memset(filter->fDelay, 0, sizeof(filter->fDelay));
+
+	filter->uMedianSize = config->uMedian;
+	if (filter->uMedianSize > FILTER_MEDIAN_MAX)
+		filter->uMedianSize = FILTER_MEDIAN_MAX;
+	else if (filter->uMedianSize < 1)
+		filter->uMedianSize = 1;
+	filter->fDelay[FILTER_STAGE_MEDIAN] = (float)(filter->uMedianSize - 1) / 2.0f;
+
+	filter->bMovAvg = (config->fWindow > 0.0f) && (filter->movAvg.uCapacity > 0);
+	filter->uEmaAlpha = 0;
+	if (filter->bMovAvg)
+	{
+		uint32_t size = (uint32_t)(sampleRate * config->fWindow + 0.5f);
+		if (size > filter->movAvg.uCapacity)
+			size = filter->movAvg.uCapacity;
+		else if (size < 1)
+			size = 1;
+		filter->movAvg.uSize = size;
+		filter->fDelay[FILTER_STAGE_MOVAVG] = (float)(size - 1) / 2.0f;
+	}
+	else if (config->fTau > 0.0f)
+	{	// y += alpha * (x - y), delay (1 - alpha) / alpha
+		float alpha = 1.0f - expf(-1.0f / (config->fTau * sampleRate));
+		filter->uEmaAlpha = (uint32_t)(alpha * (float)(1u << FILTER_EMA_SHIFT) + 0.5f);
+		if (filter->uEmaAlpha < 1)
+			filter->uEmaAlpha = 1;
+		alpha = (float)filter->uEmaAlpha / (float)(1u << FILTER_EMA_SHIFT);
+		filter->fDelay[FILTER_STAGE_EMA] = (1.0f - alpha) / alpha;
+	}
+
+	filter->bBiquad = (config->fCutoff > 0.0f);
+	if (filter->bBiquad)
+	{	// Butterworth low pass, bilinear transform with prewarping
+		float fc = fminf(config->fCutoff, 0.4f * sampleRate);
+		float k = tanf(3.14159265f * fc / sampleRate);
+		float norm = 1.0f / (1.0f + 1.41421356f * k + k * k);
+
+		filter->a1 = 2.0f * (k * k - 1.0f) * norm;
+		filter->a2 = (1.0f - 1.41421356f * k + k * k) * norm;
+		// b0 = k^2 * norm, but taken from rounded a1, a2 (exact sum), so DC
+		// gain is exactly 1 - with poles close to 1 it's off by 0.1 % else
+		filter->b0 = (1.0f + filter->a1 + filter->a2) / 4.0f;
+		filter->b1 = 2.0f * filter->b0;
+		filter->b2 = filter->b0;
+		// delay at DC: sum(k * b[k]) / sum(b[k]) - sum(k * a[k]) / sum(a[k])
+		filter->fDelay[FILTER_STAGE_BIQUAD] =
+				(filter->b1 + 2.0f * filter->b2) / (filter->b0 + filter->b1 + filter->b2)
+				- (filter->a1 + 2.0f * filter->a2) / (1.0f + filter->a1 + filter->a2);
+	}
+
+	for (uint32_t i = 0; i < FILTER_STAGES_NUMBER_OF; i++)
+	{
+		delay += filter->fDelay[i];
+		filter->fDelay[i] /= sampleRate;
+	}
+	filter->uGapRefill = (uint32_t)(delay / 2.0f);
+	if (filter->uGapRefill < 1)
+		filter->uGapRefill = 1;
+}
+
+
+
+static void filterRefill(struct sFilter* filter, int32_t sample)
+{
+	for (uint32_t i = 0; i < FILTER_MEDIAN_MAX; i++)
+		filter->iMedianBuff[i] = sample;
+	filter->movAvg.bRefill = true;
+	filter->iEma = (int64_t)sample << FILTER_EMA_SHIFT;
+	// biquad state is relative to fRef
+	filter->fRef = (float)sample;
+	filter->fZ1 = 0.0f;
+	filter->fZ2 = 0.0f;
+	filter->bRefill = false;
+}
+
+
+
+/*
+ * Insertion sort of a copy, up to FILTER_MEDIAN_MAX elements.
+ */
+static inline int32_t filterMedian(const int32_t buff[], uint32_t size)
+{
+	int32_t sorted[FILTER_MEDIAN_MAX];
+
+	for (uint32_t i = 0; i < size; i++)
+	{
+		int32_t x = buff[i];
+		uint32_t j = i;
+
+		for (; (j > 0) && (sorted[j - 1] > x); j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = x;
+	}
+	return sorted[size / 2];
+}
+
+
+
+void filterConfigure(struct sFilter* filter, const struct sFilterConfig* config, float sampleRate)
+{
+	filterDesign(filter, config, sampleRate);
+
+	if (filter->bMovAvg)
+		movAvgIntResize(&filter->movAvg, filter->movAvg.uSize);
+	filter->uMedianIndex = 0;
+	filter->bRefill = true;
+}
+
+
+
+_OPT_O3 float filterAddSample(struct sFilter* filter, int32_t newSample)
+{
+	int32_t x = newSample;
+	float y;
+
+	if (filter->bRefill)
+		filterRefill(filter, newSample);
+
+	if (filter->uMedianSize > 1)
+	{
+		filter->iMedianBuff[filter->uMedianIndex] = newSample;
+		if (++filter->uMedianIndex >= filter->uMedianSize)
+			filter->uMedianIndex = 0;
+		x = filterMedian(filter->iMedianBuff, filter->uMedianSize);
+	}
+
+	if (filter->bMovAvg)
+		y = movAvgIntAddSample(&filter->movAvg, x);
+	else if (filter->uEmaAlpha != 0)
+	{	// at most 41 bits difference times 17 bits alpha
+		filter->iEma += ((((int64_t)x << FILTER_EMA_SHIFT) - filter->iEma) * filter->uEmaAlpha) >> FILTER_EMA_SHIFT;
+		y = (float)filter->iEma * (1.0f / (float)(1u << FILTER_EMA_SHIFT));
+	}
+	else
+		y = (float)x;
+
+	if (filter->bBiquad)
+	{
+		float u = y - filter->fRef;
+		float v = filter->b0 * u + filter->fZ1;
+
+		filter->fZ1 = filter->b1 * u - filter->a1 * v + filter->fZ2;
+		filter->fZ2 = filter->b2 * u - filter->a2 * v;
+		y = filter->fRef + v;
+
+		// keep state small: move the reference to the input and remove steady
+		// state of the step from it (filter is linear, output doesn't change).
+		// Float deadband is ca. |u| * 1e-3 codes at 32 kSPS.
+		if (fabsf(u) > 256.0f)
+		{
+			filter->fRef += u;
+			filter->fZ1 -= (filter->b1 - filter->a1 + filter->b2 - filter->a2) * u;
+			filter->fZ2 -= (filter->b2 - filter->a2) * u;
+		}
+	}
+
+	return y;
+}
+
+
+
+void filterGap(struct sFilter* filter, uint32_t lost)
+{
+	if (lost >= filter->uGapRefill)
+		filter->bRefill = true;
+}
+
+
+
+float filterGroupDelay(const struct sFilter* filter, enum eFilterStage stage)
+{
+	float delay = 0.0f;
+
+	if (stage < FILTER_STAGES_NUMBER_OF)
+		return filter->fDelay[stage];
+
+	for (uint32_t i = 0; i < FILTER_STAGES_NUMBER_OF; i++)
+		delay += filter->fDelay[i];
+	return delay;
+}
+
+
+
+void calibFilterSet(struct sFilter* filter, enum eFilterPreset preset)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	if (preset >= FILTER_PRESETS_NUMBER_OF)
+		preset = FILTER_DEFAULT;
+
+	__disable_irq();
+	filter->preset = preset;
+	if (fSampleRate > 0.0f)
+		filterConfigure(filter, &filterPresets[preset], fSampleRate);
+	__set_PRIMASK(primask);
+}
+
+
+
+const char* calibFilterName(enum eFilterPreset preset)
+{
+	if (preset >= FILTER_PRESETS_NUMBER_OF)
+		return "?";
+	return filterPresets[preset].name;
+}
+
+
+
+/* Ripple statistics ---------------------------------------------------------*/
+
+#ifdef USE_STATS
+/*
+ * Channels sampled by ADS of this MCU.
+ */
+static void statsConfigure(void)
+{
+	uint32_t size = (uint32_t)(fSampleRate * fStatsWindow + 0.5f);
+
+	for (uint32_t point = 0; point < STATS_POINTS_NUMBER_OF; point++)
+	{
+	#ifdef MCU_HIGH
+		statsInit(&stats[STATS_UE][point], size);
+		statsInit(&stats[STATS_UF][point], size);
+	#else
+		statsInit(&stats[STATS_IA][point], size);
+		statsInit(&stats[STATS_UC][point], size);
+	#endif
+	}
+}
+
+
+
+/*
+ * Windows with a gap would mix ripple with the step over it.
+ */
+static inline void statsGap(void)
+{
+	for (uint32_t point = 0; point < STATS_POINTS_NUMBER_OF; point++)
+	{
+	#ifdef MCU_HIGH
+		statsRestart(&stats[STATS_UE][point]);
+		statsRestart(&stats[STATS_UF][point]);
+	#else
+		statsRestart(&stats[STATS_IA][point]);
+		statsRestart(&stats[STATS_UC][point]);
+	#endif
+	}
+}
+#endif
+
+
+
+bool calibStatsGet(enum eStatsChannel channel, enum eStatsPoint point, statsResult_t *result)
+{
+#ifdef USE_STATS
+	if ((channel >= STATS_CHANNELS_NUMBER_OF) || (point >= STATS_POINTS_NUMBER_OF))
+		return false;
+	return statsRead(&stats[channel][point], result);
+#else
+	UNUSED(channel);
+	UNUSED(point);
+	UNUSED(result);
+	return false;
+#endif
+}
+
+
+
+void calibStatsWindowSet(float window)
+{
+#ifdef USE_STATS
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	fStatsWindow = window;
+	if (fSampleRate > 0.0f)
+		statsConfigure();
+	__set_PRIMASK(primask);
+#else
+	UNUSED(window);
+#endif
+}
+
+
+
+void calibStatsUartSample(float extractVolt, float focusVolt)
+{
+#if defined (USE_STATS) && defined (MCU_LOW)
+	statsAddSample(&stats[STATS_UE][STATS_RAW], extractVolt);
+	statsAddSample(&stats[STATS_UF][STATS_RAW], focusVolt);
+	statsAddSample(&stats[STATS_UE][STATS_FILTERED], System.meas.fExtractVolt);
+	statsAddSample(&stats[STATS_UF][STATS_FILTERED], System.meas.fFocusVolt);
+#else
+	UNUSED(extractVolt);
+	UNUSED(focusVolt);
+#endif
+}
+
+
+
+/* Offsets auto-zero ---------------------------------------------------------*/
+
+static inline void autoZeroSample(const adsChannelData_t *data)
+{
+	autoZero.sumCh0 += data->channel0;
+	autoZero.sumCh1 += data->channel1;
+
+	if (++autoZero.count >= autoZero.samples)
+		autoZero.state = AUTOZERO_DONE;
+}
+
+
+
+/*
+ * Rounded to the nearest, for both signs.
+ */
+static int32_t autoZeroMean(int64_t sum, uint32_t count)
+{
+	if (sum >= 0)
+		return (int32_t)((sum + count / 2) / count);
+	else
+		return (int32_t)((sum - count / 2) / count);
+}
+
+
+
+bool calibAutoZeroStart(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	bool bStarted = false;
+
+	__disable_irq();
+	if ((autoZero.state != AUTOZERO_RUNNING) && (fSampleRate > 0.0f))
+	{
+		autoZero.samples = (uint32_t)(AUTOZERO_TIME * fSampleRate);
+		autoZero.count = 0;
+		autoZero.sumCh0 = 0;
+		autoZero.sumCh1 = 0;
+		autoZero.state = AUTOZERO_RUNNING;
+		bStarted = true;
+	}
+	__set_PRIMASK(primask);
+
+	return bStarted;
+}
+
+
+
+void calibAutoZeroAbort(void)
+{
+	if (autoZero.state == AUTOZERO_RUNNING)
+		autoZero.state = AUTOZERO_IDLE;
+}
+
+
+
+void calibAutoZeroTask(void)
+{
+	uint32_t primask;
+
+	if (autoZero.state != AUTOZERO_DONE)
+		return;
+
+	autoZero.offsetCh0 = autoZeroMean(autoZero.sumCh0, autoZero.count);
+	autoZero.offsetCh1 = autoZeroMean(autoZero.sumCh1, autoZero.count);
+	SPAM(("Auto-zero offsets: %i, %i\n", autoZero.offsetCh0, autoZero.offsetCh1));
+
+	if ((abs(autoZero.offsetCh0) > AUTOZERO_OFFSET_MAX) || (abs(autoZero.offsetCh1) > AUTOZERO_OFFSET_MAX))
+	{
+		SPAM(("Auto-zero: offset out of limit, inputs not shorted?\n"));
+		autoZero.state = AUTOZERO_ERROR;
+		return;
+	}
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+#ifdef MCU_HIGH
+	fCoeffUe.offset = autoZero.offsetCh0;
+	fCoeffUf.offset = autoZero.offsetCh1;
+#else
+	fCoeffIa.offset = autoZero.offsetCh0;
+	fCoeffUc.offset = autoZero.offsetCh1;
+#endif
+	__set_PRIMASK(primask);
+
+	calibRecord.offsetCh0 = autoZero.offsetCh0;
+	calibRecord.offsetCh1 = autoZero.offsetCh1;
+	if (flashSaveCalib(&calibRecord))
+	{
+		SPAM(("Auto-zero: flash error\n"));
+		autoZero.state = AUTOZERO_ERROR;
+	}
+	else
+		autoZero.state = AUTOZERO_SAVED;
+}
+
+
+
+enum eAutoZero calibAutoZeroState(float *progress)
+{
+	enum eAutoZero state = autoZero.state;
+
+	if (progress != NULL)
+	{
+		if (state == AUTOZERO_RUNNING)
+			*progress = (float)autoZero.count / (float)autoZero.samples;
+		else
+			*progress = (state == AUTOZERO_IDLE) ? 0.0f : 1.0f;
+	}
+	return state;
+}
+
+
+
+void calibOffsetsGet(int32_t *offsetCh0, int32_t *offsetCh1)
+{
+#ifdef MCU_HIGH
+	*offsetCh0 = fCoeffUe.offset;
+	*offsetCh1 = fCoeffUf.offset;
+#else
+	*offsetCh0 = fCoeffIa.offset;
+	*offsetCh1 = fCoeffUc.offset;
+#endif
+}
+
+/* Calibration tables --------------------------------------------------------*/
+
+bool calibTableSet(enum eCalibTable channel, const lutTable_t *table)
+{
+	if ((channel >= CALIB_TABLES_NUMBER_OF) || !calibTableCompile(channel, table))
+		return false;
+
+	calibRecord.table[channel] = *table;
+	if (table->count < 2)
+		calibRecord.table[channel].count = 0;
+
+	if (flashSaveCalib(&calibRecord))
+	{
+		SPAM(("Calibration table: flash error\n"));
+		return false;
+	}
+	return true;
+}
+
+
+
+bool calibPointInput(enum eCalibTable table, float *input)
+{
+	switch (table)
+	{
+#ifdef USE_DECIMATOR
+	case CALIB_TABLE_CH0:
+	case CALIB_TABLE_CH1:
+	{
+		const tsCoeff *coeff = (table == CALIB_TABLE_CH0) ? &fCoeffIa : &fCoeffUc;
+		bool bValid;
+		// block mode writes decimators in PendSV
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		bValid = decimOutput((table == CALIB_TABLE_CH0) ? &decimIa : &decimUc, input);
+		__set_PRIMASK(primask);
+
+		if (bValid)
+			*input -= (float)coeff->offset;
+		return bValid;
+	}
+#endif
+	case CALIB_TABLE_PUMP:
+		// open loop, see regulatorPeriodCallback()
+		*input = System.bHighSidePowered ? getPumpDuty(System.ref.fPumpVolt) : 0.0f;
+		return true;
+
+	case CALIB_TABLE_FF_UC:
+		return regulatorDutyGet(PWM_CHANNEL_UC, input);
+	case CALIB_TABLE_FF_UE:
+		return regulatorDutyGet(PWM_CHANNEL_UE, input);
+	case CALIB_TABLE_FF_UF:
+		return regulatorDutyGet(PWM_CHANNEL_UF, input);
+
+	default:
+		return false;
+	}
+}
+
+
+
+bool calibPointAdd(enum eCalibTable table, float reference)
+{
+	lutTable_t *points;
+	lutPoint_t point;
+	float input;
+	uint32_t j = 0;
+
+	if ((table >= CALIB_TABLES_NUMBER_OF) || !calibPointInput(table, &input))
+		return false;
+	points = &calibPoints[table];
+
+	if (table >= CALIB_TABLE_PUMP)
+	{	// output models: voltage magnitude -> duty
+		point.x = voltToTable(fabsf(reference));
+		point.y = input;
+	}
+	else
+	{
+		point.x = (int32_t)(input + ((input >= 0.0f) ? 0.5f : -0.5f));
+		point.y = reference;
+	}
+
+	// ascending, the one at the same input is replaced
+	while ((j < points->count) && (points->point[j].x < point.x))
+		j++;
+	if ((j < points->count) && (points->point[j].x == point.x))
+	{
+		points->point[j] = point;
+		return true;
+	}
+	if (points->count >= LUT_POINTS_MAX)
+		return false;
+
+	memmove(&points->point[j + 1], &points->point[j], (points->count - j) * sizeof(lutPoint_t));
+	points->point[j] = point;
+	points->count++;
+	return true;
+}
+
+
+
+uint32_t calibPointsCount(enum eCalibTable table)
+{
+	return (table < CALIB_TABLES_NUMBER_OF) ? calibPoints[table].count : 0;
+}
+
+
+
+bool calibPointsSave(enum eCalibTable table)
+{
+	if ((table >= CALIB_TABLES_NUMBER_OF) || !calibTableSet(table, &calibPoints[table]))
+		return false;
+
+	calibPoints[table].count = 0;
+	return true;
+}
+
+
+
+void calibPointsClear(void)
+{
+	memset(calibPoints, 0, sizeof(calibPoints));
+}
+
+/* Samples processing --------------------------------------------------------*/
+
+void calibSampleRateSet(float sampleRate)
+{
+	fSampleRate = sampleRate;
+	calibAutoZeroAbort();	// sample count is for the old rate
+
+#ifdef USE_STATS
+	statsConfigure();
+#endif
+
+#ifdef MCU_HIGH
+	#ifdef USE_MOVAVG_UE_MCUHIGH
+		filterConfigure(&filterUe, &filterPresets[filterUe.preset], sampleRate);
+	#endif
+	#ifdef USE_MOVAVG_UF_MCUHIGH
+		filterConfigure(&filterUf, &filterPresets[filterUf.preset], sampleRate);
+	#endif
+#else
+	filterConfigure(&filterIa, &filterPresets[filterIa.preset], sampleRate);
+	filterConfigure(&filterUc, &filterPresets[filterUc.preset], sampleRate);
+	// Ue and Uf filters on MCU_LOW work at uart rate, not ADS one
+
+	#ifdef USE_DECIMATOR
+		decimInit(&decimIa, decimRatio(sampleRate));
+		decimInit(&decimUc, decimRatio(sampleRate));
+		SPAM(("Decimator: CIC ratio %u, delay %.1f ms\n", decimRatio(sampleRate), 1000.0f * decimGroupDelay(sampleRate)));
+	#endif
+#endif
+}
+
+
+
+/*
+ * Samples were lost before the current one (ADS recovery, CRC errors).
+ */
+static void calcualteSamplesGap(uint32_t lost)
+{
+#ifdef USE_STATS
+	statsGap();
+#endif
+
+#ifdef MCU_HIGH
+	#ifdef USE_MOVAVG_UE_MCUHIGH
+		filterGap(&filterUe, lost);
+	#endif
+	#ifdef USE_MOVAVG_UF_MCUHIGH
+		filterGap(&filterUf, lost);
+	#endif
+#else
+	filterGap(&filterIa, lost);
+	filterGap(&filterUc, lost);
+	#ifdef USE_DECIMATOR
+		decimGap(&decimIa, lost);
+		decimGap(&decimUc, lost);
+	#endif
+	regulatorSampleGap(lost);
+#endif
 }
 
 
@@ -154,38 +1033,58 @@ float movAvgAddSample(struct sMovAvg* movAvg, float newSample)
  * 			variable, but then logger must be modified to log variable given in
  * 			parameter instead the global System.meas.
  */
-void calcualteSamples(void)
+static inline void calcualteSample(const adsChannelData_t *data)
 {
+	if (data->lost != 0)
+		calcualteSamplesGap(data->lost);
+
+	if (autoZero.state == AUTOZERO_RUNNING)
+		autoZeroSample(data);
+
 #ifdef MCU_HIGH
 
+	System.meas.fExtractVolt = lutEval(fCoeffUe.lut, data->channel0 - fCoeffUe.offset);
+	System.meas.fFocusVolt = lutEval(fCoeffUf.lut, data->channel1 - fCoeffUf.offset);
+
+	#ifdef USE_STATS
+		statsAddSample(&stats[STATS_UE][STATS_RAW], System.meas.fExtractVolt);
+		statsAddSample(&stats[STATS_UF][STATS_RAW], System.meas.fFocusVolt);
+	#endif
+
 	#ifdef USE_MOVAVG_UE_MCUHIGH
-		System.meas.fExtractVolt = movAvgAddSample(&movAvgUe, fCoeffUe.gain * (System.ads.data.channel0 - fCoeffUe.offset));
-	#else
-		System.meas.fExtractVolt = fCoeffUe.gain * (System.ads.data.channel0 - fCoeffUe.offset);
+		System.meas.fExtractVolt = coeffEval(&fCoeffUe, filterAddSample(&filterUe, data->channel0));
 	#endif
 
 	#ifdef USE_MOVAVG_UF_MCUHIGH
-		System.meas.fFocusVolt = movAvgAddSample(&movAvgUf, fCoeffUf.gain * (System.ads.data.channel1 - fCoeffUf.offset));
-	#else
-		System.meas.fFocusVolt = fCoeffUf.gain * (System.ads.data.channel1 - fCoeffUf.offset);
+		System.meas.fFocusVolt = coeffEval(&fCoeffUf, filterAddSample(&filterUf, data->channel1));
+	#endif
+
+	#ifdef USE_STATS
+		statsAddSample(&stats[STATS_UE][STATS_FILTERED], System.meas.fExtractVolt);
+		statsAddSample(&stats[STATS_UF][STATS_FILTERED], System.meas.fFocusVolt);
 	#endif
 
 #else // MCU_LOW
 
-	System.meas.fAnodeCurrent = fCoeffIa.gain * (System.ads.data.channel0 - fCoeffIa.offset);
-	System.meas.fCathodeVolt = fCoeffUc.gain * (System.ads.data.channel1 - fCoeffUc.offset);
+	System.meas.fAnodeCurrent = lutEval(fCoeffIa.lut, data->channel0 - fCoeffIa.offset);
+	System.meas.fCathodeVolt = lutEval(fCoeffUc.lut, data->channel1 - fCoeffUc.offset);
+
+	#ifdef USE_STATS
+		statsAddSample(&stats[STATS_IA][STATS_RAW], System.meas.fAnodeCurrent);
+		statsAddSample(&stats[STATS_UC][STATS_RAW], System.meas.fCathodeVolt);
+	#endif
 
 	#ifdef LOGGER_BEFORE_FILTER
 		if ((System.ref.loggerMode == LOGGER_HF_UC_STEADY)||(System.ref.loggerMode == LOGGER_HF_UC_STARTUP))
 			loggerHighFreqSample(); /* Turn this on for sampling BEFORE filter */
 	#endif
 
-	#ifdef USE_MOVAVG_IA_FILTER
-		System.meas.fAnodeCurrent = movAvgAddSample(&movAvgIa, System.meas.fAnodeCurrent);
-	#endif
+	System.meas.fAnodeCurrent = coeffEval(&fCoeffIa, filterAddSample(&filterIa, data->channel0));
+	System.meas.fCathodeVolt = coeffEval(&fCoeffUc, filterAddSample(&filterUc, data->channel1));
 
-	#ifdef USE_MOVAVG_UC_FILTER
-		System.meas.fCathodeVolt = movAvgAddSample(&movAvgUc, System.meas.fCathodeVolt);
+	#ifdef USE_STATS
+		statsAddSample(&stats[STATS_IA][STATS_FILTERED], System.meas.fAnodeCurrent);
+		statsAddSample(&stats[STATS_UC][STATS_FILTERED], System.meas.fCathodeVolt);
 	#endif
 
 	#ifdef LOGGER_AFTER_FILTER
@@ -193,20 +1092,98 @@ void calcualteSamples(void)
 			loggerHighFreqSample(); /* Turn this on for sampling AFTER filter */
 	#endif
 
-    //pidMeasOscPeriod(PWM_CHANNEL_UC);
-	//pidMeasOscPeriod(REG_IA);
+	regulatorSample();	// if in sample synchronous mode
+
+    //pidMeasOscPeriod(PWM_CHANNEL_UC, data->timestamp);
+	//pidMeasOscPeriod(REG_IA, data->timestamp);
 
 #endif // MCU_HIGH
 }
 
 
 
+void calcualteSamples(const adsChannelData_t *data)
+{
+	calcualteSample(data);
+
+#ifdef USE_DECIMATOR
+	decimProcessBlock(&decimIa, &data->channel0, 1);
+	decimProcessBlock(&decimUc, &data->channel1, 1);
+#endif
+}
+
+
+
+_OPT_O3 void calcualteSamplesBlock(const adsChannelData_t data[], uint32_t count)
+{
+#ifdef USE_DECIMATOR
+	int32_t ia[ADS_BLOCK_HALF];
+	int32_t uc[ADS_BLOCK_HALF];
+
+	if (count > ADS_BLOCK_HALF)
+		count = ADS_BLOCK_HALF;
+#endif
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		calcualteSample(&data[i]);
+#ifdef USE_DECIMATOR
+		ia[i] = data[i].channel0;
+		uc[i] = data[i].channel1;
+#endif
+	}
+
+#ifdef USE_DECIMATOR
+	// block mode runs in PendSV, TIM6 reads decimOutput() meanwhile
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	decimProcessBlock(&decimIa, ia, count);
+	decimProcessBlock(&decimUc, uc, count);
+	__set_PRIMASK(primask);
+#endif
+}
+
+
+
+#ifdef USE_DECIMATOR
+_OPT_O3 bool calibDecimatedGet(float *anodeCurrent, float *cathodeVolt)
+{
+	float ia, uc;
+
+	if (!decimOutput(&decimIa, &ia) || !decimOutput(&decimUc, &uc))
+		return false;
+
+	*anodeCurrent = coeffEval(&fCoeffIa, ia);
+	*cathodeVolt = coeffEval(&fCoeffUc, uc);
+	return true;
+}
+#endif
+
+
+
 /*
  * Just scale, do not use PID regulator
  */
 float getPumpDuty(float voltage)
 {
-	return (voltage - fCoeffUp.offset) * fCoeffUp.gain;
+	return lutEval(&fCoeffUp.lut, voltToTable(voltage - fCoeffUp.offset));
+}
+
+
+
+_OPT_O3 float getFeedforwardDuty(enum eCalibTable table, float voltage)
+{
+	const lut_t *lut;
+
+	switch (table)
+	{
+	case CALIB_TABLE_FF_UC:	lut = &lutFeedUc;	break;
+	case CALIB_TABLE_FF_UE:	lut = &lutFeedUe;	break;
+	case CALIB_TABLE_FF_UF:	lut = &lutFeedUf;	break;
+	default:				return 0.0f;
+	}
+
+	return lutEval(lut, voltToTable(fabsf(voltage)));
 }
 
 /************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -8,6 +8,7 @@
 #include <string.h>
 #include "calibration.h"
 #include "communication.h"
+#include "crc.h"
 #include "main.h"		// for uart handle
 #include "regulator.h"
 #include "stm32l4xx_hal.h"
@@ -253,19 +254,21 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 		}
 
 #ifdef USE_MOVAVG_UE_MCULOW
-		System.meas.fExtractVolt = movAvgAddSample(&movAvgUe, commFrame.data.values.fExtVolt);
+		System.meas.fExtractVolt = movAvgAddSample(&movAvgUeUart, commFrame.data.values.fExtVolt);
 #else
 		memcpy(&System.meas.fExtractVolt, &commFrame.data.values.fExtVolt, sizeof(float));
 #endif
 
 #ifdef USE_MOVAVG_UF_MCULOW
-		System.meas.fFocusVolt = movAvgAddSample(&movAvgUf, commFrame.data.values.fFocusVolt);
+		System.meas.fFocusVolt = movAvgAddSample(&movAvgUfUart, commFrame.data.values.fFocusVolt);
 #else
 		memcpy(&System.meas.fFocusVolt, &commFrame.data.values.fFocusVolt, sizeof(float));
 #endif
 
-//		pidMeasOscPeriod(PWM_CHANNEL_UE);
-//		pidMeasOscPeriod(PWM_CHANNEL_UF);
+		calibStatsUartSample(commFrame.data.values.fExtVolt, commFrame.data.values.fFocusVolt);
+
+//		pidMeasOscPeriod(PWM_CHANNEL_UE, DWT->CYCCNT);
+//		pidMeasOscPeriod(PWM_CHANNEL_UF, DWT->CYCCNT);
 	}
 
 #ifndef CUSTOM_RX
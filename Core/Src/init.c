@@ -11,6 +11,7 @@
 #include "ads131m0x.h"
 #include "calibration.h"
 #include "communication.h"
+#include "crc.h"
 #include "hd44780_i2c.h"
 #include "init.h"
 #include "main.h"
@@ -30,6 +31,8 @@ void init_user( void )
 {
 	memset(&System, 0x00, sizeof(System));
 
+	crcInit();
+
 	initCoefficients();
 
 	HAL_ADC_Start_IT(&hadc1);
@@ -37,11 +40,12 @@ void init_user( void )
 #ifdef MCU_HIGH
 
 	#ifdef USE_MOVAVG_UE_MCUHIGH
-		movAvgInit(&movAvgUe);
+		calibFilterSet(&filterUe, FILTER_DEFAULT);
 	#endif
 	#ifdef USE_MOVAVG_UF_MCUHIGH
-		movAvgInit(&movAvgUf);
+		calibFilterSet(&filterUf, FILTER_DEFAULT);
 	#endif
+	adsSetDataRate(ADS_RATE_DEFAULT);
 	InitADC();
 
 #else // MCU_LOW
@@ -54,17 +58,11 @@ void init_user( void )
 	System.bSweepOn = false;
 
 		movAvgInit(&movAvgAdcBatt);
-	#ifdef USE_MOVAVG_IA_FILTER
-		movAvgInit(&movAvgIa);
-	#endif
-	#ifdef USE_MOVAVG_UC_FILTER
-		movAvgInit(&movAvgUc);
-	#endif
 	#ifdef USE_MOVAVG_UE_MCULOW
-		movAvgInit(&movAvgUe);
+		movAvgInit(&movAvgUeUart);
 	#endif
 	#ifdef USE_MOVAVG_UF_MCULOW
-		movAvgInit(&movAvgUf);
+		movAvgInit(&movAvgUfUart);
 	#endif
 
 	System.meas.uAnodeCurrent = 0;
@@ -94,6 +92,10 @@ void init_user( void )
 		System.ref.fExtractVoltLimit = 500.0f;
 		System.ref.fFocusVolt = 0.0f;
 		System.ref.fPumpVolt = 0.0f;
+		System.ref.adsRate = ADS_RATE_DEFAULT;
+		System.ref.filterIa = FILTER_DEFAULT;
+		System.ref.filterUc = FILTER_DEFAULT;
+		System.ref.uRegSync = REGULATOR_SYNC_DECIMATION;
 	}
 	else
 	{	// settings from flash loaded - apply
@@ -106,6 +108,7 @@ void init_user( void )
 	pwmSetDuty(PWM_CHANNEL_UE, 0.0f);
 	pwmSetDuty(PWM_CHANNEL_UF, 0.0f);
 	pwmSetDuty(PWM_CHANNEL_PUMP, 0.0f);
+	pwmInit();
 
 	HAL_TIMEx_PWMN_Start(&htim1, PWM_CHANNEL_UC);
 	HAL_TIM_PWM_Start(&htim1, PWM_CHANNEL_UE);
@@ -117,6 +120,16 @@ void init_user( void )
 	// display module, screen variables
 	uiInit();
 
+	// filters are configured for the rate by adsSetDataRate()
+	calibFilterSet(&filterIa, System.ref.filterIa);
+	calibFilterSet(&filterUc, System.ref.filterUc);
+	System.ref.filterIa = filterIa.preset;	// limited to FILTER_PRESETS_NUMBER_OF
+	System.ref.filterUc = filterUc.preset;
+	if (System.ref.uRegSync > REGULATOR_SYNC_DECIMATION_MAX)
+		System.ref.uRegSync = REGULATOR_SYNC_DECIMATION_MAX;
+	regulatorSyncSet(System.ref.uRegSync);	// applied at the rate set below
+	adsSetDataRate(System.ref.adsRate);
+	System.ref.adsRate = adsGetDataRate();	// limited to ADS_RATE_MAX
 	InitADC();
 
 //	// UART - trigger first receiving
@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include "logger.h"
+#include "regulator.h"	// for trajectories
 #include "typedefs.h"
 
 /*
@@ -35,6 +36,9 @@ static float loggerBuffUc[LOGGER_BUFF_SIZE];	// increase buffer size for high fr
 static float loggerBuffUe[LOGGER_BUFF_SIZE];
 static float loggerBuffUf[LOGGER_BUFF_SIZE];
 static float fUserValueBackup;
+static uint32_t highFreqDecimation = 1;	// log every n-th ADS sample
+static uint32_t highFreqDecimationCnt;
+static float highFreqPeriod;			// [s] between HF records - time base of the log
 
 /* Exported functions --------------------------------------------------------*/
 
@@ -156,10 +160,17 @@ void loggerPeriod(void)
 			if (loggerBuffIndex < LOGGER_BUFF_SIZE)
 			{
 				//if (System.ref.loggerMode == LOGGER_UE)
+			#ifdef LOGGER_LOG_SETPOINTS
+				loggerBuffIa[loggerBuffIndex] = trajIa.position;
+				loggerBuffUc[loggerBuffIndex] = trajUc.position;
+				loggerBuffUe[loggerBuffIndex] = trajUe.position;
+				loggerBuffUf[loggerBuffIndex] = trajUf.position;
+			#else
 				loggerBuffIa[loggerBuffIndex] = System.meas.fAnodeCurrent;
 				loggerBuffUc[loggerBuffIndex] = System.meas.fCathodeVolt;
 				loggerBuffUe[loggerBuffIndex] = System.meas.fExtractVolt;
 				loggerBuffUf[loggerBuffIndex] = System.meas.fFocusVolt;
+			#endif
 				loggerBuffIndex++;
 			}
 			else
@@ -191,6 +202,10 @@ void loggerHighFreqSample(void)
 			uTimeConsoleText = HAL_GetTick();
 			ITM_SendChar('.');
 		}
+		if (++highFreqDecimationCnt < highFreqDecimation)
+			return;
+		highFreqDecimationCnt = 0;
+
 		// save sample
 		if (loggerBuffIndex < LOGGER_BUFF_SIZE)
 		{
@@ -238,6 +253,33 @@ void loggerHighFreqSample(void)
 
 
 
+/*
+ * Call it when ADS data rate changes, with acquisition stopped.
+ * High frequency logger records at most LOGGER_HF_RATE_MAX, so the buffers
+ * cover similar time at any rate.
+ */
+void loggerSampleRateSet(float sampleRate)
+{
+	highFreqDecimation = (uint32_t)(sampleRate / LOGGER_HF_RATE_MAX + 0.5f);
+	if (highFreqDecimation < 1)
+		highFreqDecimation = 1;
+
+	highFreqDecimationCnt = 0;
+	highFreqPeriod = (float)highFreqDecimation / sampleRate;
+}
+
+
+
+/*
+ * @return	time between high frequency logger records [s]
+ */
+float loggerHighFreqPeriodGet(void)
+{
+	return highFreqPeriod;
+}
+
+
+
 void sweepUeExit(bool success)
 {
 	SPAM(("%s\n", __func__));
@@ -23,6 +23,7 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include <math.h>
+#include "calibration.h"
 #include "communication.h"
 #include "hd44780_i2c.h"
 #include "init.h"
@@ -39,6 +40,11 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define HS_TASK_INTERVAL		10		// [ms]
+#define HS_POWER_UP_TIMEOUT		3000	// [ms] for the first frame from MCU_HIGH
+#define HS_RAMP_TIMEOUT			3000	// [ms] trajectories take 1.3 s from 2500 V
+#define HS_DISCHARGE_TIMEOUT	5000	// [ms]
+#define HS_DISCHARGE_VOLT		100.0f	// [V] all outputs below it - discharged
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -84,6 +90,11 @@ UART_HandleTypeDef huart1;
 
 struct sSystem System;
 
+static volatile enum eHighSideState hsState = HS_OFF;
+static volatile bool bHsStartRequest, bHsShutdownRequest;
+static uint32_t uHsStageTick;		// entry to the stage
+static uint32_t uHsShutdownTick;	// start of shutdown
+
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -195,6 +206,9 @@ int main(void)
 
     /* USER CODE BEGIN 3 */
 #ifdef MCU_HIGH
+	  calibAutoZeroTask();
+
+	  adsRecoveryWatchdog();
 	  if (System.ads.error)
 	  {
 		  InitADC();
@@ -204,16 +218,17 @@ int main(void)
 
 	uiScreenUpdate();
 
-	if (System.battVolt < 3.0f)
+	calibAutoZeroTask();
+
+	highSideTask();
+
+	if ((System.battVolt < 3.0f) && (System.bLowBatt == false))
 	{
 		System.bLowBatt = true;
-		uiScreenChange(SCREEN_LOWBATT);
-		HAL_Delay(1000);
-		highSideShutdown();
-		powerLockOff();
-		while(0xDEADBABE);
+		uiPowerOff(SCREEN_LOWBATT, false);	// when HV is discharged
 	}
 
+	adsRecoveryWatchdog();
 	if (System.ads.error)
 	{
 		InitADC();
@@ -768,58 +783,169 @@ static void MX_GPIO_Init(void)
 
 
 
+static void highSideStageSet(enum eHighSideState state)
+{
+	hsState = state;
+	uHsStageTick = HAL_GetTick();
+}
+
+
+
+static bool highSideDischarged(void)
+{
+	// NAN (no measurement) counts as discharged
+	return !(fabsf(System.meas.fCathodeVolt) > HS_DISCHARGE_VOLT)
+		&& !(fabsf(System.meas.fExtractVolt) > HS_DISCHARGE_VOLT)
+		&& !(fabsf(System.meas.fFocusVolt) > HS_DISCHARGE_VOLT)
+		&& !(fabsf(System.meas.fPumpVolt) > HS_DISCHARGE_VOLT);
+}
+
+
+
+/*
+ * Requests power-up, done by highSideTask(). Can be called from interrupts.
+ */
 void highSideStart(void)
 {
-	System.bHighSidePowered = true;
-	power12Von();
-#ifdef CUSTOM_RX
-	uartCustomRxInit();
-#else
-	uartReceiveFrameIT();
-#endif
-	regulatorInit();
-	regulatorInitCurrent();
+	bHsShutdownRequest = false;
+	bHsStartRequest = true;
 }
 
 
 
 /*
- * Don't use in interrupts because of hard delay.
+ * Requests shutdown, done by highSideTask(). Can be called from interrupts.
  */
 void highSideShutdown(void)
 {
-	const uint32_t timeout = 5000;
+	bHsStartRequest = false;
+	bHsShutdownRequest = true;
+}
+
+
+
+/*
+ * @param	stageTime - [ms] in the stage, can be NULL
+ */
+enum eHighSideState highSideState(uint32_t *stageTime)
+{
+	if (stageTime != NULL)
+		*stageTime = HAL_GetTick() - uHsStageTick;
+	return hsState;
+}
+
+
+
+/*
+ * Call in main loop. Execution period is controlled internally (HS_TASK_INTERVAL).
+ *
+ * High side power sequencer, one step per tick, never waits:
+ *  power-up:	12 V and UART on, regulators start with the first frame from
+ *  			MCU_HIGH (so Ue and Uf have measurement from the start)
+ *  shutdown:	ramp-down of the setpoints by the trajectories, discharge
+ *  			(outputs off) until all voltages are below HS_DISCHARGE_VOLT,
+ *  			12 V off, UART teardown
+ * Each waiting stage has a timeout, shutdown goes on after it anyway.
+ */
+void highSideTask(void)
+{
+	static uint32_t uTimeTick;
+	uint32_t stageTime;
 
-	regulatorDeInit();
+	if (HAL_GetTick() - uTimeTick < HS_TASK_INTERVAL)
+		return;
+	uTimeTick = HAL_GetTick();
+	stageTime = uTimeTick - uHsStageTick;
 
-	uint32_t uTimestamp = HAL_GetTick();
-	while (HAL_GetTick() - uTimestamp < timeout)
+	switch (hsState)
 	{
-		bool exit = true;
-		if (fabsf(System.meas.fCathodeVolt) > 100.0f)
-			exit = false;
-		if (fabsf(System.meas.fExtractVolt) > 100.0f)
-			exit = false;
-		if (fabsf(System.meas.fFocusVolt) > 100.0f)
-			exit = false;
-		if (fabsf(System.meas.fPumpVolt) > 100.0f)
-			exit = false;
-
-		if (exit)
-			break;
+	case HS_OFF:
+		bHsShutdownRequest = false;		// nothing to shut down
+		if (bHsStartRequest)
+		{
+			bHsStartRequest = false;
+			System.bHighSidePowered = true;
+			power12Von();
+#ifdef CUSTOM_RX
+			uartCustomRxInit();
+#else
+			uartReceiveFrameIT();
+#endif
+			highSideStageSet(HS_POWER_UP);
+		}
+		break;
+
+	case HS_POWER_UP:
+		if (bHsShutdownRequest)
+		{	// regulators didn't start, nothing to discharge
+			bHsShutdownRequest = false;
+			uHsShutdownTick = uTimeTick;
+			highSideStageSet(HS_POWER_OFF);
+		}
+		else if (System.bCommunicationOk)
+		{
+			regulatorInit();
+			regulatorInitCurrent();
+			SPAM(("High side up: %u ms\n", stageTime));
+			highSideStageSet(HS_ON);
+		}
+		else if (stageTime > HS_POWER_UP_TIMEOUT)
+		{
+			SPAM(("High side not responding\n"));
+			uHsShutdownTick = uTimeTick;
+			highSideStageSet(HS_POWER_OFF);
+		}
+		break;
+
+	case HS_ON:
+		if (bHsShutdownRequest)
+		{
+			bHsShutdownRequest = false;
+			uHsShutdownTick = uTimeTick;
+			regulatorRampDown();
+			highSideStageSet(HS_RAMP_DOWN);
+		}
+		break;
+
+	case HS_RAMP_DOWN:
+		if (regulatorRampDone() || (stageTime > HS_RAMP_TIMEOUT))
+		{
+			if (stageTime > HS_RAMP_TIMEOUT)
+				SPAM(("Ramp-down timeout\n"));
+			regulatorDeInit();
+			highSideStageSet(HS_DISCHARGE);
+		}
+		break;
+
+	case HS_DISCHARGE:
+		if (highSideDischarged() || (stageTime > HS_DISCHARGE_TIMEOUT))
+		{
+			if (stageTime > HS_DISCHARGE_TIMEOUT)
+				SPAM(("Discharge timeout\n"));
+			highSideStageSet(HS_POWER_OFF);
+		}
+		break;
+
+	case HS_POWER_OFF:
+		System.bHighSidePowered = false;
+		power12Voff();
+		highSideStageSet(HS_UART_TEARDOWN);
+		break;
+
+	case HS_UART_TEARDOWN:
+		HAL_UART_AbortReceive_IT(&huart1);	// returns always HAL_OK
+		CLEAR_BIT(USART1->CR1, USART_CR1_UE);		// uart disable
+		System.bCommunicationOk = false;
+		// reset values from uart
+		System.meas.fExtractVolt = NAN;
+		System.meas.fFocusVolt = NAN;
+
+		ledRed(OFF);
+		ledGreen(OFF);
+		SPAM(("Shutdown time: %u ms\n", (uTimeTick - uHsShutdownTick) ));
+		highSideStageSet(HS_OFF);
+		break;
 	}
-	System.bHighSidePowered = false;
-	power12Voff();
-	HAL_UART_AbortReceive_IT(&huart1);	// returns always HAL_OK
-	CLEAR_BIT(USART1->CR1, USART_CR1_UE);		// uart disable
-	System.bCommunicationOk = false;
-	// reset values from uart
-	System.meas.fExtractVolt = NAN;
-	System.meas.fFocusVolt = NAN;
-
-	ledRed(OFF);
-	ledGreen(OFF);
-	SPAM(("Discharge time: %u ms\n", (HAL_GetTick() - uTimestamp) ));
 }
 
 
@@ -7,9 +7,12 @@
 
 #include <math.h>
 #include <string.h>
+#include "autotune.h"
 #include "calibration.h"
+#include "gain_schedule.h"
 #include "main.h"		// for MCU_x definition before "regulator.h" header
 #include "stm32l4xx_hal.h"
+#include "pid_batch.h"
 #include "pid_controller.h"
 #include "regulator.h"
 #include "typedefs.h"
@@ -20,6 +23,15 @@
 #define PID_PERIOD	(0.01f)		// 10 ms
 #define PID_OUT_PWM_MIN	(0.0f)
 
+/*
+ * PID extensions, see pid_controller.h. Tracking time of back-calculation
+ * anti-windup (PID_xx_TT) is about Ti = Kp / Ki of the loop. Derivative is
+ * filtered, if some loop gets Kd. Setpoint weight 1 - setpoint steps are
+ * smoothed by trajectories already.
+ */
+#define PID_D_FILTER	(0.02f)		// [s] 2 periods
+#define PID_SETPOINT_WEIGHT	(1.0f)
+
 /* **** U cathode regulator tuning *********************************************
  * Kp (0.0001f) gives stable, but 50% of value set
  * Kp (0.001f) gives oscillations, 2800-3900 V (4 kV set), SW meas 50 ms period.
@@ -37,10 +49,19 @@
  * (gain changed after calibration and caused unstability)
  * With load 12||10 MOhm, ca 800 V out:
  * Ku = (0.00038f), Tu = 98 ms --> Kp = 0.000171, Ki = 0.0020938
+ *
+ * Unloaded and 12||10 MOhm points make the gain schedule, 12 MOhm one is from
+ * before calibration. Voltage dependence wasn't measured apart from the load,
+ * so both setpoint rows start the same and get refined by auto-tuning.
+ * Unloaded ZN PI from Ku 0.00045, Tu 50 ms (the numbers above are mistyped):
+ * Kp = 0.45 * Ku = 0.0002025, Ki = 0.54 * Ku / Tu = 0.00486.
  */
 #define PID_UC_KP	(0.000171)
 #define PID_UC_KI	(0.0020938f)
 #define PID_UC_KD	(0.0f)
+#define PID_UC_KP_NOLOAD	(0.0002025f)
+#define PID_UC_KI_NOLOAD	(0.00486f)
+#define PID_UC_TT	(0.05f)		// [s] Ti 42 - 82 ms
 #define PID_OUT_MAX_UC	(0.9f)
 
 /* **** U extract regulator tuning *********************************************
@@ -52,6 +73,7 @@
 #define PID_UE_KP	(0.000135f)
 #define PID_UE_KI	(0.0010125f)
 #define PID_UE_KD	(0.0f)
+#define PID_UE_TT	(0.1f)		// [s] Ti 133 ms
 #define PID_OUT_MAX_UE	(0.5f)	// max 3 kV
 
 /* **** U focus regulator tuning ***********************************************
@@ -65,6 +87,7 @@
 #define PID_UF_KP	(0.00017f)
 #define PID_UF_KI	(0.0027f)
 #define PID_UF_KD	(0.0f)
+#define PID_UF_TT	(0.05f)		// [s] Ti 63 ms
 #define PID_OUT_MAX_UF	(0.9f)	// same as for Uc
 
 /* **** Anode current regulator tuning *****************************************
@@ -86,44 +109,460 @@
 #define PID_IA_KP	(15750000.0f)	//#define PID_IA_KP	(67500000.0f)
 #define PID_IA_KI	(42000000.0f)	//	(300000000.0f)	//#define PID_IA_KI	(540000000.0f)
 #define PID_IA_KD	(0.0f)
+#define PID_IA_TT	(0.3f)		// [s] Ti 375 ms
 #define PID_OUT_MAX_IA	(System.ref.fExtractVoltLimit)			//(2500.0f)	// max UE ref - TODO set it dynamically from variable
 
-//
+/* **** Gain scheduling ********************************************************
+ * Load of the supply is estimated as Ia / Uc conductance, filtered, so noise
+ * of Ia doesn't modulate gains. Below GSCHED_UC_MIN it's held.
+ */
+#define GSCHED_LOAD_TAU	(0.5f)		// [s]
+#define GSCHED_UC_MIN	(100.0f)	// [V]
+
+/* **** Setpoint trajectories **************************************************
+ * References from System.ref go to the loops through trajectory generators
+ * (see trajectory.h): 0 -> 2500 V takes 1.25 s. Ue follows the Ia loop
+ * directly when it's regulated (no lag inside the cascade).
+ * Ue magnitude is kept below the Uc one (times ratio), also at startup and
+ * shutdown - so both ramp together. Comment TRAJ_UE_UC_RATIO out to release.
+ */
+#define TRAJ_UC_SLEW	(2500.0f)	// [V/s]
+#define TRAJ_UC_ACCEL	(10000.0f)	// [V/s^2]
+#define TRAJ_UE_SLEW	(2500.0f)
+#define TRAJ_UE_ACCEL	(10000.0f)
+#define TRAJ_UF_SLEW	(2500.0f)
+#define TRAJ_UF_ACCEL	(10000.0f)
+#define TRAJ_IA_SLEW	(2.0e-6f)	// [A/s]
+#define TRAJ_IA_ACCEL	(10.0e-6f)	// [A/s^2]
+#define TRAJ_UE_UC_RATIO	(1.0f)
+
+/* **** Relay auto-tuning ******************************************************
+ * Instead of raising Kp till the loop oscillates (notes above), relay drives
+ * the loop output around its value before tuning, see autotune.h. Relay
+ * amplitude makes the oscillation, hysteresis must be above noise of the
+ * measurement and error over limit aborts tuning.
+ */
+#define TUNE_UC_RELAY	(0.05f)		// [duty] ca. 350 V p-p open loop
+#define TUNE_UC_HYST	(5.0f)		// [V]
+#define TUNE_UC_LIMIT	(500.0f)	// [V]
+#define TUNE_UE_RELAY	(0.03f)
+#define TUNE_UE_HYST	(5.0f)
+#define TUNE_UE_LIMIT	(300.0f)
+#define TUNE_UF_RELAY	(0.03f)
+#define TUNE_UF_HYST	(5.0f)
+#define TUNE_UF_LIMIT	(300.0f)
+#define TUNE_IA_RELAY	(100.0f)	// [V] of Ue reference
+#define TUNE_IA_HYST	(0.02e-6f)	// [A]
+#define TUNE_IA_LIMIT	(1.0e-6f)	// [A]
+#define TUNE_TIMEOUT	(10.0f)		// [s]
 
 /* Private variables ---------------------------------------------------------*/
 
-PIDControl pidUc, pidUe, pidUf, pidIa;
+PIDControl pidUc, pidUe, pidUf, pidIa;		// setup of the loops, state is in the batch
+traj_t trajUc, trajUe, trajUf, trajIa;
+uint32_t pwmCompare[4];
+#ifdef USE_PWM_DITHER
+	#define PWM_DITHER_LENGTH	(1UL << PWM_DITHER_BITS)	// [periods] of the pattern
+	static uint32_t pwmBurst[PWM_DITHER_LENGTH * 4];	// read by DMA, 4 channels per period
+	#define PWM_BURST_CIRC		DMA_CCR_CIRC
+#elif defined (USE_PWM_DMA_BURST)
+	static uint32_t pwmBurst[4];	// read by DMA, see pwmCommit()
+	#define PWM_BURST_CIRC		0	// armed by every commit
+#endif
+
+/*
+ * All loops are computed by batch engine (see pid_batch.h), in two stages:
+ * Ue setpoint is Ia output, so Ue goes after Ia.
+ */
+enum eLoop
+{
+	LOOP_UC = 0,
+	LOOP_UE,
+	LOOP_UF,
+	LOOP_IA,
+	LOOPS_NUMBER_OF,
+};
+#define LOOPS_STAGE1	3	// of loopOrder[]
+
+static const uint8_t loopOrder[LOOPS_NUMBER_OF] = { LOOP_UC, LOOP_UF, LOOP_IA, LOOP_UE };
+static pidBatch_t loops;
+static PIDControl *const loopPid[LOOPS_NUMBER_OF] = { &pidUc, &pidUe, &pidUf, &pidIa };
+
+// gains in use, accepted auto-tuning results survive regulatorDeInit()
+// Uc grid: unloaded and 12||10 MOhm tunings (notes above), the same at both
+// setpoints until regulatorTuneAccept() replaces the entry of the operating
+// point it was tuned at. Other loops have 1x1 tables - fixed gains.
+static gschedTable_t scheduleUc =
+{
+	.setpoints = 2,
+	.loads = 2,
+	.setpoint = { 800.0f, 3000.0f },			// [V]
+	.load = { 0.0f, 1.0f / 5.45e6f },			// [S] unloaded, 12||10 MOhm
+	.gains =
+	{
+		{ { PID_UC_KP_NOLOAD, PID_UC_KI_NOLOAD, PID_UC_KD }, { PID_UC_KP, PID_UC_KI, PID_UC_KD } },
+		{ { PID_UC_KP_NOLOAD, PID_UC_KI_NOLOAD, PID_UC_KD }, { PID_UC_KP, PID_UC_KI, PID_UC_KD } },
+	},
+};
+static gschedTable_t scheduleUe = { .setpoints = 1, .loads = 1, .gains = { { { PID_UE_KP, PID_UE_KI, PID_UE_KD } } } };
+static gschedTable_t scheduleUf = { .setpoints = 1, .loads = 1, .gains = { { { PID_UF_KP, PID_UF_KI, PID_UF_KD } } } };
+static gschedTable_t scheduleIa = { .setpoints = 1, .loads = 1, .gains = { { { PID_IA_KP, PID_IA_KI, PID_IA_KD } } } };
+static gschedTable_t *const loopSchedule[LOOPS_NUMBER_OF] = { &scheduleUc, &scheduleUe, &scheduleUf, &scheduleIa };
+static float fLoad;							// [S] estimated, for scheduling
+
+// feedforward models and feedforward in the output now, see regulatorFeedforward()
+static const enum eCalibTable loopFeedTable[LOOPS_NUMBER_OF] =
+{
+	CALIB_TABLE_FF_UC, CALIB_TABLE_FF_UE, CALIB_TABLE_FF_UF,
+	CALIB_TABLES_NUMBER_OF		// Ia - none
+};
+static float loopFeed[LOOPS_NUMBER_OF];
+
+// relay auto-tuning of one loop, see regulatorTuneStart()
+static struct
+{
+	autotune_t relay;
+	enum ePwmChannel loop;
+	enum eLoop index;
+} tune;
+
+// local ADS samples were lost since the last period, see regulatorSampleGap()
+static volatile bool bSampleGap;
+
+// sample synchronous mode, see regulatorSyncSet()
+static volatile bool bRunning;				// between regulatorInit() and DeInit()
+static volatile bool bRampDown;				// setpoints to 0, see regulatorRampDown()
+static uint32_t uSyncRequested = REGULATOR_SYNC_DECIMATION;
+static volatile uint32_t uSyncDecimation;	// in use, 0 - TIM6
+static uint32_t uSyncCount;
+static float fSampleRate;					// ADS, 0 until regulatorSampleRateSet()
+static float fPidPeriod = PID_PERIOD;		// [s] of all regulators
+
+/* Private functions ---------------------------------------------------------*/
+
+static enum eLoop regulatorLoop(enum ePwmChannel channel)
+{
+	switch (channel)
+	{
+	case PWM_CHANNEL_UC:	return LOOP_UC;
+	case PWM_CHANNEL_UE:	return LOOP_UE;
+	case PWM_CHANNEL_UF:	return LOOP_UF;
+	case REG_IA:			return LOOP_IA;
+	default:				return LOOPS_NUMBER_OF;
+	}
+}
+
+
+
+/*
+ * PIDInit() with gains scheduled at zero setpoint and the extensions, then
+ * into the batch.
+ */
+static void regulatorPidInit(enum eLoop i, float outMin, float outMax, PIDDirection direction, float trackingTime)
+{
+	PIDControl *pid = loopPid[i];
+	gschedGains_t gains;
+
+	gschedEval(loopSchedule[i], 0.0f, fLoad, &gains);
+	PIDInit(pid, gains.kp, gains.ki, gains.kd, fPidPeriod, outMin, outMax, AUTOMATIC, direction);
+	PIDAntiWindupSet(pid, trackingTime);
+	PIDDerivativeFilterSet(pid, PID_D_FILTER);
+	PIDSetpointWeightSet(pid, PID_SETPOINT_WEIGHT);
+	pidBatchLoad(&loops, i, pid);
+	loopFeed[i] = 0.0f;		// iTerm is 0
+}
+
+
+
+/*
+ * Sets gains scheduled at the actual setpoint and load. Call it with the new
+ * input and setpoint, before pidBatchCompute(). Integral is moved by the change
+ * of proportional term, so the output continues from where it was (bumpless).
+ */
+static inline void regulatorSchedule(enum eLoop i)
+{
+	PIDControl *pid = loopPid[i];
+	gschedGains_t gains;
+	float error, pTerm;
+
+	gschedEval(loopSchedule[i], fabsf(loops.setpoint[i]), fLoad, &gains);
+	if ((gains.kp == pid->dispKp) && (gains.ki == pid->dispKi) && (gains.kd == pid->dispKd))
+		return;
+
+	error = loops.beta[i] * loops.setpoint[i] - loops.input[i];		// of P term
+	pTerm = loops.kp[i] * error;
+	PIDTuningsSet(pid, gains.kp, gains.ki, gains.kd);
+	pidBatchConfigLoad(&loops, i, pid);
+	loops.iTerm[i] += pTerm - loops.kp[i] * error;
+	if (loops.iTerm[i] > loops.outMax[i])
+		loops.iTerm[i] = loops.outMax[i];
+	else if (loops.iTerm[i] < loops.outMin[i])
+		loops.iTerm[i] = loops.outMin[i];
+}
+
+
+
+/*
+ * Back to PID with its gains, from the output before tuning. Call it with
+ * interrupts disabled or from the regulator itself.
+ */
+static void regulatorTuneRestore(void)
+{
+	pidBatchOutputTrack(&loops, tune.index, tune.relay.bias);
+	pidBatchModeSet(&loops, tune.index, AUTOMATIC);	// bumpless
+}
+
+
+
+/*
+ * Feedforward goes through the integral: its change since the last period is
+ * added to iTerm, so the output follows the model at once and integral holds
+ * the model plus the residual. The output then stays the whole duty - limits,
+ * relay bias and bumpless mode changes work unchanged. Outside of AUTOMATIC
+ * only the reference is updated, mode change takes iTerm from the output.
+ */
+static inline void regulatorFeedforward(enum eLoop i)
+{
+#ifdef USE_FEEDFORWARD
+	if (loopFeedTable[i] == CALIB_TABLES_NUMBER_OF)
+		return;
+
+	float feed = getFeedforwardDuty(loopFeedTable[i], loops.setpoint[i]);
+
+	if (pidBatchIsActive(&loops, i))
+		loops.iTerm[i] += feed - loopFeed[i];
+	loopFeed[i] = feed;
+#else
+	UNUSED(i);
+#endif
+}
+
+
+
+/*
+ * Ue setpoint within the Uc trajectory, see TRAJ_UE_UC_RATIO.
+ */
+static inline float regulatorUeLimit(float setpoint)
+{
+#ifdef TRAJ_UE_UC_RATIO
+	float limit = TRAJ_UE_UC_RATIO * fabsf(trajUc.position);
+
+	if (setpoint > limit)
+		return limit;
+	if (setpoint < -limit)
+		return -limit;
+#endif
+	return setpoint;
+}
+
+
+
+/*
+ * New input and setpoint of the loop.
+ */
+static inline void regulatorLoopSet(enum eLoop i, float input, float setpoint, bool bResync)
+{
+	loops.input[i] = input;
+	if (bResync)
+		loops.lastInput[i] = input;		// no derivative kick over the gap
+	loops.setpoint[i] = setpoint;
+}
+
+
+
+/*
+ * Call it after regulatorLoopSet(), before pidBatchCompute(): feedforward and
+ * scheduled gains, or relay if the loop is being tuned (it's in MANUAL then,
+ * so the batch keeps relay output).
+ */
+static inline void regulatorPrepare(enum eLoop i)
+{
+	regulatorFeedforward(i);
+
+	if ((tune.relay.state == AUTOTUNE_RELAY) && (tune.index == i))
+	{
+		loops.output[i] = autotuneStep(&tune.relay, loops.setpoint[i] - loops.input[i]);
+		loops.lastInput[i] = loops.input[i];
+		if (tune.relay.state != AUTOTUNE_RELAY)
+			regulatorTuneRestore();
+	}
+	else if (pidBatchIsActive(&loops, i))
+		regulatorSchedule(i);
+}
+
+
+
+static void pidPeriodSet(enum eLoop i, float period)
+{
+	PIDControl *pid = loopPid[i];
+
+	// not initialized yet, PIDInit() takes fPidPeriod
+	if (pid->sampleTime > 0.0f)
+	{
+		PIDSampleTimeSet(pid, period);
+		pidBatchConfigLoad(&loops, i, pid);
+	}
+}
+
+
+
+/*
+ * Applies uSyncRequested at the actual sample rate and rescales integral and
+ * derivative gains of all regulators to the new period.
+ */
+static void regulatorSyncApply(void)
+{
+	uint32_t decimation = regulatorSyncLimit(uSyncRequested, fSampleRate);
+	float period = PID_PERIOD;
+	uint32_t primask;
+
+	if (decimation != 0)
+		period = (float)decimation / fSampleRate;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (tune.relay.state == AUTOTUNE_RELAY)
+	{	// relay period changes
+		tune.relay.state = AUTOTUNE_FAILED;
+		regulatorTuneRestore();
+	}
+	for (uint32_t i = 0; i < LOOPS_NUMBER_OF; i++)
+		pidPeriodSet(i, period);
+	fPidPeriod = period;
+	uSyncCount = 0;
+	uSyncDecimation = decimation;
+	__set_PRIMASK(primask);
+
+	SPAM(("Regulator: %s, period %.3f ms\n", (decimation != 0) ? "ADS sync" : "TIM6", 1000.0f * period));
+}
+
+
+
+/*
+ * One step of all regulators: inputs and setpoints of the loops, then the
+ * batch computes them, Ue in the second stage with Ia output as setpoint.
+ */
+static inline void regulatorStep(float fCathodeVolt, float fAnodeCurrent, bool bLocalMeasOk)
+{
+	bool bResync = bSampleGap;
+	bool bIaMode = (System.ref.extMode == EXT_REGULATE_IA) && !bRampDown;
+	bool bIaTuned = (tune.relay.state == AUTOTUNE_RELAY) && (tune.index == LOOP_IA);
+	uint32_t mask = 0;		// loops computed now
+	bSampleGap = false;
+
+	/* Load estimate */
+	if (bLocalMeasOk && (fabsf(fCathodeVolt) > GSCHED_UC_MIN))
+		fLoad += (fabsf(fAnodeCurrent / fCathodeVolt) - fLoad) * fPidPeriod * (1.0f / GSCHED_LOAD_TAU);
+
+	/* Cathode voltage */
+	if (bLocalMeasOk)
+	{
+		regulatorLoopSet(LOOP_UC, fCathodeVolt, trajStep(&trajUc, bRampDown ? 0.0f : System.ref.fCathodeVolt, fPidPeriod), bResync);
+		regulatorPrepare(LOOP_UC);
+		mask |= (1u << LOOP_UC);
+	}
+
+	// Run following regulator only, when there are valid samples from High side. Else, stay on previous value.
+	if (System.bCommunicationOk == true)
+	{
+		/* Focus voltage */
+		regulatorLoopSet(LOOP_UF, System.meas.fFocusVolt, trajStep(&trajUf, bRampDown ? 0.0f : System.ref.fFocusVolt, fPidPeriod), false);
+		regulatorPrepare(LOOP_UF);
+		mask |= (1u << LOOP_UF) | (1u << LOOP_UE);
+
+		/* Anode current */
+		if (bIaMode && bLocalMeasOk)
+		{
+			regulatorLoopSet(LOOP_IA, fAnodeCurrent, trajStep(&trajIa, System.ref.fAnodeCurrent, fPidPeriod), bResync);
+			if (!pidBatchIsActive(&loops, LOOP_IA) && !bIaTuned)
+				pidBatchModeSet(&loops, LOOP_IA, AUTOMATIC);	// from Ue tracked meanwhile
+			regulatorPrepare(LOOP_IA);
+			mask |= (1u << LOOP_IA);
+		}
+		else if (!bIaMode && (pidIa.sampleTime > 0.0f) && !bIaTuned)
+		{	// Ia loop is off, it follows Ue to start from it when enabled (bumpless)
+			pidBatchModeSet(&loops, LOOP_IA, MANUAL);
+			loops.input[LOOP_IA] = fAnodeCurrent;
+			pidBatchOutputTrack(&loops, LOOP_IA, trajUe.position);
+			trajReset(&trajIa, fAnodeCurrent);
+		}
+	}
+
+	pidBatchCompute(&loops, 0, LOOPS_STAGE1, mask);
+
+	/* Extract voltage */
+	if (System.bCommunicationOk == true)
+	{
+		if (bIaMode)
+		{
+			if (mask & (1u << LOOP_IA))
+			{
+				System.ref.fExtractVoltIaRef = loops.output[LOOP_IA];
+				// Ue limited by Uc trajectory is a limit of Ia loop too
+				if (regulatorUeLimit(System.ref.fExtractVoltIaRef) != System.ref.fExtractVoltIaRef)
+					pidBatchOutputTrack(&loops, LOOP_IA, regulatorUeLimit(System.ref.fExtractVoltIaRef));
+			}
+			// user ref then ramps from here
+			trajReset(&trajUe, regulatorUeLimit(System.ref.fExtractVoltIaRef));
+		}
+		else
+			trajStep(&trajUe, bRampDown ? 0.0f : regulatorUeLimit(System.ref.fExtractVoltUserRef), fPidPeriod);
+		regulatorLoopSet(LOOP_UE, System.meas.fExtractVolt, trajUe.position, false);
+		regulatorPrepare(LOOP_UE);
+	}
+
+	pidBatchCompute(&loops, LOOPS_STAGE1, LOOPS_NUMBER_OF, mask);
+
+	/* Outputs */
+	if (bLocalMeasOk)
+		pwmSetDuty(PWM_CHANNEL_UC, loops.output[LOOP_UC]);
+
+	/* Pump voltage - set open loop, it is not regulated */
+	pwmSetVoltManual(PWM_CHANNEL_PUMP, bRampDown ? 0.0f : System.ref.fPumpVolt);
+
+	if (System.bCommunicationOk == true)
+	{
+		pwmSetDuty(PWM_CHANNEL_UE, loops.output[LOOP_UE]);
+		pwmSetDuty(PWM_CHANNEL_UF, loops.output[LOOP_UF]);
+		// for offset calibration
+//		pwmSetDuty(PWM_CHANNEL_UE, 0.0f);
+//		pwmSetDuty(PWM_CHANNEL_UF, 0.0f);
+		// for gain calibration
+//		pwmSetVoltManual(PWM_CHANNEL_UE, System.ref.fPumpVolt);
+//		pwmSetVoltManual(PWM_CHANNEL_UF, System.ref.fFocusVolt);
+	}
+
+	pwmCommit();	// all outputs in the same PWM period
+}
 
 /* Exported functions --------------------------------------------------------*/
 
 void regulatorInit(void)
 {
-	PIDInit(&pidUc,
-			PID_UC_KP,	PID_UC_KI,	PID_UC_KD,
-			PID_PERIOD,
+	pidBatchInit(&loops, loopOrder, LOOPS_NUMBER_OF);	// all in MANUAL
+
+	regulatorPidInit(LOOP_UC,
 			PID_OUT_PWM_MIN,	PID_OUT_MAX_UC,
-			AUTOMATIC,	// mode
-			REVERSE);	// direction
+			REVERSE,	// direction
+			PID_UC_TT);
 
-	PIDInit(&pidUe,
-			PID_UE_KP,	PID_UE_KI,	PID_UE_KD,
-			PID_PERIOD,
+	regulatorPidInit(LOOP_UE,
 			PID_OUT_PWM_MIN,	PID_OUT_MAX_UE,
-			AUTOMATIC,	// mode
-			DIRECT);	// direction
+			DIRECT,		// direction
+			PID_UE_TT);
 
-	PIDInit(&pidUf,
-			PID_UF_KP,	PID_UF_KI,	PID_UF_KD,
-			PID_PERIOD,
+	regulatorPidInit(LOOP_UF,
 			PID_OUT_PWM_MIN,	PID_OUT_MAX_UF,
-			AUTOMATIC,	// mode
-			DIRECT);	// direction
+			DIRECT,		// direction
+			PID_UF_TT);
 
-	PIDSetpointSet(&pidUc, 0.0f);
-	PIDSetpointSet(&pidUe, 0.0f);
-	PIDSetpointSet(&pidUf, 0.0f);
+	trajInit(&trajUc, TRAJ_UC_SLEW, TRAJ_UC_ACCEL, 0.0f);	// from 0 V
+	trajInit(&trajUe, TRAJ_UE_SLEW, TRAJ_UE_ACCEL, 0.0f);
+	trajInit(&trajUf, TRAJ_UF_SLEW, TRAJ_UF_ACCEL, 0.0f);
 
-	HAL_TIM_Base_Start_IT(&htim6);
+	bRampDown = false;
+	bRunning = true;
+	HAL_TIM_Base_Start_IT(&htim6);	// for sweep and logger in sync mode
 }
 
 
@@ -134,118 +573,496 @@ void regulatorInit(void)
  */
 void regulatorInitCurrent(void)
 {
-	PIDInit(&pidIa,
-			PID_IA_KP,	PID_IA_KI,	PID_IA_KD,
-			PID_PERIOD,
+	regulatorPidInit(LOOP_IA,
 			100.0f,	PID_OUT_MAX_IA,	// minimum Ext ref: 100 V
-			AUTOMATIC,	// mode
-			DIRECT);	// direction
+			DIRECT,		// direction
+			PID_IA_TT);
 
-	PIDSetpointSet(&pidIa, 0.0f);
+	trajInit(&trajIa, TRAJ_IA_SLEW, TRAJ_IA_ACCEL, 0.0f);
 }
 
 
 
 void regulatorDeInit(void)
 {
-	PIDModeSet(&pidUc, MANUAL);
-	PIDModeSet(&pidUe, MANUAL);
-	PIDModeSet(&pidUf, MANUAL);
-	PIDModeSet(&pidIa, MANUAL);
+	bRunning = false;
+	tune.relay.state = AUTOTUNE_IDLE;
+	for (uint32_t i = 0; i < LOOPS_NUMBER_OF; i++)
+		pidBatchModeSet(&loops, i, MANUAL);
+	pidBatchOutputTrack(&loops, LOOP_UC, 0.0f);	// outputs really are off, not last ones
+	pidBatchOutputTrack(&loops, LOOP_UE, 0.0f);
+	pidBatchOutputTrack(&loops, LOOP_UF, 0.0f);
 	HAL_TIM_Base_Stop_IT(&htim6);
 	pwmSetDuty(PWM_CHANNEL_UC, 0.0f);
 	pwmSetDuty(PWM_CHANNEL_UE, 0.0f);
 	pwmSetDuty(PWM_CHANNEL_UF, 0.0f);
 	pwmSetDuty(PWM_CHANNEL_PUMP, 0.0f);
+	pwmCommit();
+}
+
+
+
+/*
+ * Loops keep running, their setpoints ramp to 0 by the trajectories (Ue by its
+ * own, Ia loop off). Pump goes to 0 at once, it's open loop. Tuning is stopped.
+ * Ends with regulatorDeInit(), regulatorInit() starts from 0 again.
+ */
+void regulatorRampDown(void)
+{
+	regulatorTuneStop();
+	bRampDown = true;
 }
 
 
 
 /*
- * Call every PID_PERIOD s
+ * @return	true when trajectories of Uc, Ue and Uf are at 0, or the regulator
+ * 			isn't running
+ */
+bool regulatorRampDone(void)
+{
+	if (!bRunning)
+		return true;
+
+	return trajDone(&trajUc) && (trajUc.position == 0.0f)
+		&& trajDone(&trajUe) && (trajUe.position == 0.0f)
+		&& trajDone(&trajUf) && (trajUf.position == 0.0f);
+}
+
+
+
+/*
+ * Call every PID_PERIOD s, does nothing in sample synchronous mode.
  * 32 us not optimized.
  * 23 us at O3
  */
 _OPT_O3 void regulatorPeriodCallback(void)
 {
-	/* Cathode voltage */
-	PIDInputSet(&pidUc, System.meas.fCathodeVolt);	// TODO to moze lepiej powiazac jakos z przerwaniem od ADS. Tylko te przerwania nie moga sie wcinac jedno w drugie. Teraz to ok, ale jak zrobie ADS na DMA to chyba bedzie sie wcinac.
-	PIDSetpointSet(&pidUc, System.ref.fCathodeVolt);
-	PIDCompute(&pidUc);
-	pwmSetDuty(PWM_CHANNEL_UC, PIDOutputGet(&pidUc));
+	// Local ADS (Uc, Ia) doesn't deliver samples during fault recovery - hold
+	// outputs of its loops instead of integrating stale measurement.
+	bool bLocalMeasOk = System.ads.ready;
+	float fCathodeVolt = System.meas.fCathodeVolt;
+	float fAnodeCurrent = System.meas.fAnodeCurrent;
 
-	/* Pump voltage - set open loop, it is not regulated */
-	pwmSetVoltManual(PWM_CHANNEL_PUMP, System.ref.fPumpVolt);
+	if (uSyncDecimation != 0)
+		return;
 
-	// Run following regulator only, when there are valid samples from High side. Else, stay on previous value.
-	if (System.bCommunicationOk == true)
+#ifdef USE_DECIMATOR
+	// anti-aliased, one new value per period
+	if (!calibDecimatedGet(&fAnodeCurrent, &fCathodeVolt))
+		bLocalMeasOk = false;
+#endif
+
+	regulatorStep(fCathodeVolt, fAnodeCurrent, bLocalMeasOk);
+}
+
+
+
+/*
+ * Called after the sample is processed (MCU_LOW), so System.meas holds its
+ * filtered Uc and Ia. It's PendSV in block mode, ADS interrupt otherwise (see
+ * REGULATOR_SYNC_RATE_MAX). Ue and Uf are the latest ones received from
+ * MCU_HIGH.
+ */
+_OPT_O3 void regulatorSample(void)
+{
+	if ((uSyncDecimation == 0) || !bRunning)
+		return;
+	if (++uSyncCount < uSyncDecimation)
+		return;
+	uSyncCount = 0;
+
+	regulatorStep(System.meas.fCathodeVolt, System.meas.fAnodeCurrent, true);
+}
+
+
+
+/*
+ * Called from ADS interrupt with the first sample after lost ones (fault
+ * recovery, CRC errors), filters are already told about the gap. Outputs were
+ * held meanwhile, so regulators just restart derivative from new measurement.
+ */
+void regulatorSampleGap(uint32_t lost)
+{
+	UNUSED(lost);
+	bSampleGap = true;
+}
+
+
+
+/*
+ * Called when ADS data rate changes, with acquisition stopped.
+ */
+void regulatorSampleRateSet(float sampleRate)
+{
+	fSampleRate = sampleRate;
+	regulatorSyncApply();
+}
+
+
+
+/*
+ * Sets regulators to run on every decimation-th ADS sample, 0 - from TIM6
+ * every PID_PERIOD. Decimation is limited by REGULATOR_SYNC_RATE_MAX and
+ * gains are rescaled to the new period (PIDSampleTimeSet()), so the loops keep
+ * their time constants.
+ */
+void regulatorSyncSet(uint32_t decimation)
+{
+	if (decimation > REGULATOR_SYNC_DECIMATION_MAX)
+		decimation = REGULATOR_SYNC_DECIMATION_MAX;
+	uSyncRequested = decimation;
+	regulatorSyncApply();
+}
+
+
+
+/*
+ * @return	decimation regulatorSyncSet() ends with at sampleRate, 0 - TIM6
+ * 			(also if the rate isn't known)
+ */
+uint32_t regulatorSyncLimit(uint32_t decimation, float sampleRate)
+{
+	uint32_t decimationMin;
+
+	if ((decimation == 0) || (sampleRate <= 0.0f))
+		return 0;
+
+	decimationMin = (uint32_t)ceilf(sampleRate / REGULATOR_SYNC_RATE_MAX);
+	if (decimation > REGULATOR_SYNC_DECIMATION_MAX)
+		decimation = REGULATOR_SYNC_DECIMATION_MAX;
+	return (decimation < decimationMin) ? decimationMin : decimation;
+}
+
+
+
+/*
+ * @return	decimation in use, 0 - TIM6 (also until ADS rate is known)
+ */
+uint32_t regulatorSyncGet(void)
+{
+	return uSyncDecimation;
+}
+
+
+
+/*
+ * @return	period [s] of regulators
+ */
+float regulatorPeriodGet(void)
+{
+	return fPidPeriod;
+}
+
+
+
+/*
+ * Output of a voltage loop regulating in closed loop, for its feedforward
+ * table (see calibPointInput()). Read it when the output has settled.
+ * @return	false if the loop isn't regulating (off, manual, being tuned)
+ */
+bool regulatorDutyGet(enum ePwmChannel loop, float *duty)
+{
+	enum eLoop i = regulatorLoop(loop);
+
+	if ((i == LOOPS_NUMBER_OF) || (i == LOOP_IA) || !bRunning || !pidBatchIsActive(&loops, i)
+			|| ((tune.relay.state == AUTOTUNE_RELAY) && (tune.index == i)))
+		return false;
+
+	*duty = loops.output[i];
+	return true;
+}
+
+
+
+#ifdef USE_PWM_DITHER
+/*
+ * Pattern of compare values at the short period: coarse part of pwmCompare[]
+ * and +1 in fine / 2^bits of the periods, spread evenly (first order
+ * sigma-delta). Average over the pattern is exactly the 16-bit value.
+ */
+_OPT_O3 static void pwmDitherFill(void)
+{
+	for (uint32_t ch = 0; ch < 4; ch++)
 	{
-		/* Anode current */
-		if (System.ref.extMode == EXT_REGULATE_IA)
+		uint32_t coarse = pwmCompare[ch] >> PWM_DITHER_BITS;
+		uint32_t fine = pwmCompare[ch] & (PWM_DITHER_LENGTH - 1);
+		uint32_t acc = PWM_DITHER_LENGTH / 2;	// +1s in the middle of their slots
+
+		for (uint32_t n = 0; n < PWM_DITHER_LENGTH; n++)
 		{
-			PIDInputSet(&pidIa, System.meas.fAnodeCurrent);
-			PIDSetpointSet(&pidIa, System.ref.fAnodeCurrent);
-			PIDCompute(&pidIa);
-			System.ref.fExtractVoltIaRef = PIDOutputGet(&pidIa);
+			acc += fine;
+			pwmBurst[4 * n + ch] = coarse + (acc >> PWM_DITHER_BITS);
+			acc &= PWM_DITHER_LENGTH - 1;
 		}
+	}
+}
+#endif
 
-		/* Extract voltage */
-		PIDInputSet(&pidUe, System.meas.fExtractVolt);
-		if (System.ref.extMode == EXT_REGULATE_IA)
-			PIDSetpointSet(&pidUe, System.ref.fExtractVoltIaRef);
-		else
-			PIDSetpointSet(&pidUe, System.ref.fExtractVoltUserRef);
-		PIDCompute(&pidUe);
-		pwmSetDuty(PWM_CHANNEL_UE, PIDOutputGet(&pidUe));
 
-		/* Focus voltage */
-		PIDInputSet(&pidUf, System.meas.fFocusVolt);
-		PIDSetpointSet(&pidUf, System.ref.fFocusVolt);
-		PIDCompute(&pidUf);
-		pwmSetDuty(PWM_CHANNEL_UF, PIDOutputGet(&pidUf));
-		// for offset calibration
-//		pwmSetDuty(PWM_CHANNEL_UE, 0.0f);
-//		pwmSetDuty(PWM_CHANNEL_UF, 0.0f);
-		// for gain calibration
-//		pwmSetVoltManual(PWM_CHANNEL_UE, System.ref.fPumpVolt);
-//		pwmSetVoltManual(PWM_CHANNEL_UF, System.ref.fFocusVolt);
-	}
+
+/*
+ * Call it once, before PWM is started.
+ *
+ * DMA of pwmBurst[] into TIM1 DMAR on update request, DCR sets the burst to
+ * CCR1..CCR4. Preload of the CCRs is on already (HAL), just to be sure. It's
+ * one burst, armed again by every pwmCommit(). With dither the period is
+ * shortened here and DMA is circular, the whole pattern goes round, one burst
+ * per period.
+ */
+void pwmInit(void)
+{
+#ifdef USE_PWM_DMA_BURST
+#ifdef USE_PWM_DITHER
+	__HAL_TIM_SET_AUTORELOAD(&htim1, (65536UL >> PWM_DITHER_BITS) - 1);
+	TIM1->EGR = TIM_EGR_UG;		// counter restarts at the new period
+	pwmDitherFill();
+#else
+	memcpy(pwmBurst, pwmCompare, sizeof(pwmBurst));
+#endif
+
+	__HAL_RCC_DMA1_CLK_ENABLE();
+	DMA1_Channel6->CCR = 0;
+	DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~DMA_CSELR_C6S) | (7UL << DMA_CSELR_C6S_Pos);	// TIM1_UP
+	DMA1_Channel6->CPAR = (uint32_t)&TIM1->DMAR;
+	DMA1_Channel6->CMAR = (uint32_t)pwmBurst;
+	DMA1_Channel6->CNDTR = sizeof(pwmBurst) / sizeof(pwmBurst[0]);
+	DMA1_Channel6->CCR = DMA_CCR_PL_1		// high priority
+			| DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1	// 32 bit
+			| DMA_CCR_MINC | PWM_BURST_CIRC | DMA_CCR_DIR	// memory to TIM
+			| DMA_CCR_EN;
+
+	TIM1->CCMR1 |= TIM_CCMR1_OC1PE | TIM_CCMR1_OC2PE;
+	TIM1->CCMR2 |= TIM_CCMR2_OC3PE | TIM_CCMR2_OC4PE;
+	TIM1->DCR = TIM_DMABURSTLENGTH_4TRANSFERS | TIM_DMABASE_CCR1;
+	__HAL_TIM_ENABLE_DMA(&htim1, TIM_DMA_UPDATE);
+#endif
 }
 
 
 
 /*
- * Manually set duty based on required output voltage.
+ * Applies pwmCompare[] to all channels in the same PWM period.
+ *
+ * Burst is armed again with the new values, update events are disabled (UDIS)
+ * meanwhile, so no burst starts while pwmBurst[] is rewritten. A burst already
+ * running isn't cut, it's waited for with interrupts disabled: at most its 4
+ * transfers, ca. 8 cycles each plus one transfer of SPI1 DMA (lower priority)
+ * in between - under 70 cycles (1 us). If the update event falls into the
+ * disabled part, the period keeps the previous values - all of them.
+ *
+ * With dither there's an update event every 25 us, pattern is rewritten while
+ * DMA goes round it - each period still gets whole compare values, of the old
+ * pattern or of the new one. The change is spread over one pattern (0.8 ms).
  */
-void pwmSetVoltManual(enum ePwmChannel PWM_CHANNEL_, float voltage)
+_OPT_O3 void pwmCommit(void)
 {
-	const float fGain = (6000.0f/12.0f) * (16300.0f/4300.0f) * 3.3f;
+#ifdef USE_PWM_DITHER
+	pwmDitherFill();
+#elif defined (USE_PWM_DMA_BURST)
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();	// called from main and from the regulator
+	TIM1->CR1 |= TIM_CR1_UDIS;
+	while ((DMA1_Channel6->CNDTR % 4) != 0)
+		;	// burst of the last update event running, < 70 cycles (see above)
+	DMA1_Channel6->CCR &= ~DMA_CCR_EN;
+	pwmBurst[0] = pwmCompare[0];
+	pwmBurst[1] = pwmCompare[1];
+	pwmBurst[2] = pwmCompare[2];
+	pwmBurst[3] = pwmCompare[3];
+	DMA1_Channel6->CNDTR = 4;
+	DMA1_Channel6->CCR |= DMA_CCR_EN;
+	TIM1->CR1 &= ~TIM_CR1_UDIS;
+	__set_PRIMASK(primask);
+#else
+	TIM1->CCR1 = pwmCompare[0];
+	TIM1->CCR2 = pwmCompare[1];
+	TIM1->CCR3 = pwmCompare[2];
+	TIM1->CCR4 = pwmCompare[3];
+#endif
+}
 
-	float duty = voltage / fGain;
 
-	if (PWM_CHANNEL_ == PWM_CHANNEL_PUMP)
+
+/*
+ * Manually set duty based on required output voltage, from the same models as
+ * feedforward of the regulators.
+ */
+void pwmSetVoltManual(enum ePwmChannel PWM_CHANNEL_, float voltage)
+{
+	switch (PWM_CHANNEL_)
 	{
+	case PWM_CHANNEL_PUMP:
 		pwmSetDuty(PWM_CHANNEL_PUMP, getPumpDuty(voltage));
+		break;
+	case PWM_CHANNEL_UC:
+		pwmSetDuty(PWM_CHANNEL_UC, getFeedforwardDuty(CALIB_TABLE_FF_UC, voltage));
+		break;
+	case PWM_CHANNEL_UE:
+		pwmSetDuty(PWM_CHANNEL_UE, getFeedforwardDuty(CALIB_TABLE_FF_UE, voltage));
+		break;
+	case PWM_CHANNEL_UF:
+		pwmSetDuty(PWM_CHANNEL_UF, getFeedforwardDuty(CALIB_TABLE_FF_UF, voltage));
+		break;
+	default:
+		break;
 	}
-	else
-		pwmSetDuty(PWM_CHANNEL_, duty);
 }
 
 
 
 /*
- * Used to tune PID regulator (Ziegler-Nichols method).
- * Call every time after collecting adc sample.
+ * Call it from main loop, with the loop in steady state at its setpoint.
+ *
+ * Starts relay auto-tuning of the loop (PWM_CHANNEL_UC, _UE, _UF or REG_IA).
+ * Ue can't be tuned while Ia loop drives its setpoint, Ia only then. Loop
+ * returns to its PID (old gains) when relay is done - result waits for
+ * regulatorTuneAccept() or regulatorTuneStop().
+ * @return 0 - loop isn't running or another one is being tuned
+ */
+bool regulatorTuneStart(enum ePwmChannel loop)
+{
+	PIDControl *pid;
+	enum eLoop i;
+	float relay, hysteresis, limit;
+	uint32_t primask;
+
+	if (!bRunning || (tune.relay.state == AUTOTUNE_RELAY))
+		return false;
+
+	switch (loop)
+	{
+	case PWM_CHANNEL_UC:
+		relay = TUNE_UC_RELAY;	hysteresis = TUNE_UC_HYST;	limit = TUNE_UC_LIMIT;
+		break;
+	case PWM_CHANNEL_UE:
+		if (!System.bCommunicationOk || (System.ref.extMode == EXT_REGULATE_IA))
+			return false;
+		relay = TUNE_UE_RELAY;	hysteresis = TUNE_UE_HYST;	limit = TUNE_UE_LIMIT;
+		break;
+	case PWM_CHANNEL_UF:
+		if (!System.bCommunicationOk)
+			return false;
+		relay = TUNE_UF_RELAY;	hysteresis = TUNE_UF_HYST;	limit = TUNE_UF_LIMIT;
+		break;
+	case REG_IA:
+		if (!System.bCommunicationOk || (System.ref.extMode != EXT_REGULATE_IA))
+			return false;
+		relay = TUNE_IA_RELAY;	hysteresis = TUNE_IA_HYST;	limit = TUNE_IA_LIMIT;
+		break;
+	default:
+		return false;
+	}
+	i = regulatorLoop(loop);
+	pid = loopPid[i];
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	pidBatchModeSet(&loops, i, MANUAL);	// output held, relay takes it over
+	tune.index = i;
+	tune.loop = loop;
+	autotuneStart(&tune.relay, loops.output[i], relay, hysteresis,
+			pid->outMin, pid->outMax, (pid->controllerDirection == REVERSE),
+			fPidPeriod, limit, TUNE_TIMEOUT);
+	if (tune.relay.state != AUTOTUNE_RELAY)
+		regulatorTuneRestore();
+	__set_PRIMASK(primask);
+
+	return (tune.relay.state == AUTOTUNE_RELAY);
+}
+
+
+
+/*
+ * Aborts relay (back to PID, bumpless) or discards the result.
+ */
+void regulatorTuneStop(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (tune.relay.state == AUTOTUNE_RELAY)
+		regulatorTuneRestore();
+	tune.relay.state = AUTOTUNE_IDLE;
+	__set_PRIMASK(primask);
+}
+
+
+
+/*
+ * @return	state of tuning, cycles measured so far and the loop
+ */
+enum eAutotuneState regulatorTuneState(uint32_t *cycles, enum ePwmChannel *loop)
+{
+	if (cycles != NULL)
+		*cycles = tune.relay.cycles;
+	if (loop != NULL)
+		*loop = tune.loop;
+	return tune.relay.state;
+}
+
+
+
+/*
+ * Preview of the result with given tuning rule.
+ * @return 0 - there's no result
+ */
+bool regulatorTuneResult(enum eTuneRule rule, float *ku, float *tu, float *kp, float *ki, float *kd)
+{
+	if (tune.relay.state != AUTOTUNE_DONE)
+		return false;
+
+	*ku = tune.relay.ku;
+	*tu = tune.relay.tu;
+	autotuneGains(rule, *ku, *tu, kp, ki, kd);
+	return true;
+}
+
+
+
+/*
+ * Applies the result with given tuning rule to the gain schedule entry nearest
+ * to the operating point it was measured at, the loop gets it bumpless in the
+ * next period. Gains are kept till reset, also over HV restart.
+ * @return 0 - there's no result
  */
-void pidMeasOscPeriod(enum ePwmChannel PWM_CHANNEL_)
+bool regulatorTuneAccept(enum eTuneRule rule)
 {
-	static uint32_t uTimetick;
-	static float fLastSample;
-	static bool bLastSlope;
-	static uint32_t period;
-	static uint32_t index = 0;
-	const uint32_t samplesNo = 10;
-	// measure period between rising slopes
+	float ku, tu;
+	gschedGains_t result;
+	uint32_t primask;
+
+	if (!regulatorTuneResult(rule, &ku, &tu, &result.kp, &result.ki, &result.kd))
+		return false;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	gschedEntrySet(loopSchedule[tune.index], fabsf(loops.setpoint[tune.index]), fLoad, &result);
+	tune.relay.state = AUTOTUNE_IDLE;
+	__set_PRIMASK(primask);
+
+	SPAM(("Tuned %s: Ku %e, Tu %.1f ms -> Kp %e, Ki %e, Kd %e\n", autotuneRuleName(rule),
+			ku, 1000.0f * tu, result.kp, result.ki, result.kd));
+	return true;
+}
+
+
+
+/*
+ * Used to tune PID regulator by hand (Ziegler-Nichols method), see also
+ * regulatorTuneStart().
+ * Call every time after collecting adc sample, with its timestamp (DWT cycles,
+ * adsChannelData_t.timestamp or DWT->CYCCNT for samples from uart). Prints mean
+ * period and amplitude of 10 cycles.
+ */
+void pidMeasOscPeriod(enum ePwmChannel PWM_CHANNEL_, uint32_t timestamp)
+{
+	static oscDetector_t osc;
+	static bool bInit = false;
+	static enum ePwmChannel channel;
+	static uint32_t uTimestamp;
+	static float fTime;
 	float value;
 
 	if (PWM_CHANNEL_ == PWM_CHANNEL_UC)
@@ -256,32 +1073,23 @@ void pidMeasOscPeriod(enum ePwmChannel PWM_CHANNEL_)
 		value = System.meas.fFocusVolt;
 	else if (PWM_CHANNEL_ == PWM_CHANNEL_PUMP)
 		value = System.meas.fPumpVolt;
-	else if (PWM_CHANNEL_ == REG_IA)
+	else
 		value = System.meas.fAnodeCurrent;
 
-
-	if (value - fLastSample > 0.0f)
-	{	// rising slope
-		if (bLastSlope == false)
-		{
-			period += HAL_GetTick() - uTimetick;
-			if (index++ >= samplesNo)
-			{
-				period = period/samplesNo;
-				SPAM(("osc: %u\n", period));
-				period = 0;
-				index = 0;
-			}
-			uTimetick = HAL_GetTick();
-		}
-		bLastSlope = true;
-	}
-	else
-	{	// falling slope
-		//if (bLastSlope == true)
-		bLastSlope = false;
+	if (!bInit || (channel != PWM_CHANNEL_))
+	{	// no hysteresis - feed it with filtered values
+		oscInit(&osc, 0.0f, 10);
+		channel = PWM_CHANNEL_;
+		uTimestamp = timestamp;
+		fTime = 0.0f;
+		bInit = true;
 	}
-	fLastSample = value;
+
+	fTime += (float)(timestamp - uTimestamp) / (float)SystemCoreClock;	// [s]
+	uTimestamp = timestamp;
+
+	if (oscAddSample(&osc, value, fTime))
+		SPAM(("osc: %u us, amplitude %e\n", (uint32_t)(1e6f * osc.period), osc.amplitude));
 }
 
 /************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
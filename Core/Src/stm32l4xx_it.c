@@ -183,7 +183,9 @@ void DebugMon_Handler(void)
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+#ifdef ADS_SPI_USE_DMA_BLOCK
+	adsReadDataBlockProcess();
+#endif
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
 
@@ -253,7 +255,7 @@ void EXTI2_IRQHandler(void)
 void EXTI4_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI4_IRQn 0 */
-
+	adsDrdyTimestamp();		// ADS DRDY, before anything else
   /* USER CODE END EXTI4_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_4);
   /* USER CODE BEGIN EXTI4_IRQn 1 */
@@ -267,11 +269,13 @@ void EXTI4_IRQHandler(void)
 void DMA1_Channel2_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel2_IRQn 0 */
-
+#ifdef ADS_SPI_USE_DMA_BLOCK
+	adsReadDataBlockIRQHandler();
+#else
   /* USER CODE END DMA1_Channel2_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_spi1_rx);
   /* USER CODE BEGIN DMA1_Channel2_IRQn 1 */
-
+#endif
   /* USER CODE END DMA1_Channel2_IRQn 1 */
 }
 
@@ -425,22 +429,29 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
 	if (GPIO_Pin == ADC_DRDY_EXTI4_Pin)
 	{
+		// DRDY edges clock fault recovery, its last step sets ready again
+		if (System.ads.ready == false)
+			adsRecoveryStep();
+
 		if (System.ads.ready == true)
 		{
 #ifdef MCU_HIGH
 	#ifdef ADS_SPI_USE_INT
 			adsReadDataIT();
+	#elif defined (ADS_SPI_USE_DMA_BLOCK)
+			adsReadDataBlockDMA();
 	#elif defined (ADS_SPI_USE_DMA)
 			adsReadDataDMA();
 	#else
-			//adsReadDataOptimized(&System.ads.data);
+			//adsReadDataOptimized();
 			static uint32_t cntSent;
 			static uint32_t cntSkipped;
 			static uint32_t cntWrong;
+			const adsSample_t *sample = adsReadDataITcallback();
 
-			if (true == adsReadDataITcallback(&System.ads.data))
+			if (sample != NULL)
 			{
-				calcualteSamples();
+				calcualteSamples(&sample->data);
 				ledRed(OFF);
 				ledBlue(BLINK);
 				if (uartIsIdle())
@@ -462,14 +473,17 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 
 	#ifdef ADS_SPI_USE_INT
 			adsReadDataIT();
+	#elif defined (ADS_SPI_USE_DMA_BLOCK)
+			adsReadDataBlockDMA();
 	#elif defined (ADS_SPI_USE_DMA)
 			adsReadDataDMA();
 	#else
-			if (true == adsReadDataOptimized(&System.ads.data))
+			const adsSample_t *sample = adsReadDataOptimized();
+
+			if (sample != NULL)
 			{
 				ledBlue(BLINK);
-//				calibOffset();
-				calcualteSamples();
+				calcualteSamples(&sample->data);
 			}
 			else
 			{
@@ -503,10 +517,11 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
 		static uint32_t cntSent;
 		static uint32_t cntSkipped;
 		static uint32_t cntWrong;
+		const adsSample_t *sample = adsReadDataITcallback();
 
-		if (true == adsReadDataITcallback(&System.ads.data))
+		if (sample != NULL)
 		{
-			calcualteSamples();
+			calcualteSamples(&sample->data);
 
 			if (uartIsIdle())
 			{
@@ -536,10 +551,11 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
 	#if defined (ADS_SPI_USE_INT) || defined (ADS_SPI_USE_DMA)
 
 //		adsSyncPulse();		// prevent occasionally Overrun error
-		if (true == adsReadDataITcallback(&System.ads.data))
+		const adsSample_t *sample = adsReadDataITcallback();
+
+		if (sample != NULL)
 		{
-//			calibOffset();
-			calcualteSamples();
+			calcualteSamples(&sample->data);
 			if (bLedSetBySPI)
 			{
 				ledRed(OFF);
@@ -562,6 +578,54 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
 
 
 
+#ifdef ADS_SPI_USE_DMA_BLOCK
+/*
+ * Called from PendSV every half of ADS circular buffer (ADS_BLOCK_HALF frames),
+ * samples with wrong CRC are already skipped. DRDY, DMA and TIM6 interrupts
+ * preempt it.
+ */
+void adsReadDataBlockCallback(const adsChannelData_t data[], uint32_t count, uint32_t crcErrors)
+{
+	if (count > 0)
+	{
+		calcualteSamplesBlock(data, count);
+	#ifdef MCU_HIGH
+		// latest filtered values, once per block
+		if (uartIsIdle())
+			sendResults();
+	#endif
+		ledBlue(BLINK);
+	}
+
+	if (crcErrors > 0)
+	{
+		ledRed(ON);
+		bLedSetBySPI = true;
+	}
+	else if (bLedSetBySPI)
+	{
+		ledRed(OFF);
+		bLedSetBySPI = false;
+	}
+}
+#endif
+
+
+
+/*
+ * Called by adsSetDataRate() with acquisition stopped, retunes everything
+ * which depends on sample rate. Sweep runs from TIM6 (10 ms), independent of
+ * it, regulators too unless they're in sample synchronous mode.
+ */
+void adsDataRateCallback(float sampleRate)
+{
+	calibSampleRateSet(sampleRate);
+	loggerSampleRateSet(sampleRate);
+	regulatorSampleRateSet(sampleRate);
+}
+
+
+
 #if defined (ADS_SPI_USE_INT) || defined (ADS_SPI_USE_DMA)
 /*
  * 115 - 216 us with printf (!)
@@ -597,15 +661,8 @@ void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
 //		SPAM(("ABORT, "));		/* error during Abort procedure */
 //	SPAM((".\n"));
 
-#ifdef ADS_SPI_USE_DMA
-	if (HAL_OK != HAL_SPI_DMAStop(&hspi1))
-#elif defined (ADS_SPI_USE_INT)
-	if (HAL_OK != HAL_SPI_Abort_IT(&hspi1))
-#endif
-	{
-		SPAM(("HAL_SPI_Abort error\n"));
-	}
-	adsSyncPulse(); // according to ADS datasheet it doesnt do much, but somehow helps here
+	// stops transfer, sync pulse and re-arm follow on next DRDY edges
+	adsRecoveryStart();
 
 }
 #endif
@@ -624,7 +681,7 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 	else if (System.ref.loggerMode == LOGGER_IA_UE_UF)
 		loggerPeriod();
 
-	// regulator takes 23 us
+	// regulator takes 23 us, unless it runs in ADS sample path
 	regulatorPeriodCallback();
 }
 
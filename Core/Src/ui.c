@@ -5,6 +5,7 @@
  *      Author: Lukasz Sitarek
  */
 #include <string.h>
+#include "calibration.h"
 #include "communication.h"
 #include "hd44780_i2c.h"
 #include "main.h"
@@ -22,12 +23,20 @@ static enum eScreen actualScreen;
 static enum eScreen returnScreen;		// save screen to return to - f.ex. from settings
 static enum eScreen settingsScreenGr1;	// save last settings screen (group 1) - to enter always last setted value
 static enum eScreen settingsScreenGr2;	// save last settings screen (group 2) - to enter always last setted value
+static enum eScreen settingsScreenGr3;	// save last settings screen (group 3) - to enter always last setted value
 static uint32_t uScreenTimer;			// measure time from last screenChange
 static bool bBlink;						// helper variable for blinking text on screen
 static int printedCharsLine[4] = {0};	// save number of value digits plotted in each line
 
 static tsRegulatedVal localRef;			// local copy of values changed at settings
 static int32_t setDigit = 1;
+static enum ePwmChannel tuneLoop = PWM_CHANNEL_UC;	// selected at SCREEN_TUNE
+static enum eTuneRule tuneRule = TUNE_ZN_PI;
+static enum eCalibTable calibTable = CALIB_TABLE_CH1;	// selected at SCREEN_CALIB
+static int32_t calibRef;				// external meter reading at SCREEN_CALIB: [V], IA [10 nA]
+static const char *calibStatus = "";	// result of the last action at SCREEN_CALIB
+static bool bPowerOffPending;			// after HV shutdown, see uiPowerOff()
+static bool bPowerOffSave;
 
 /* config / constants --------------------------------------------------------*/
 
@@ -37,6 +46,7 @@ static int32_t setDigit = 1;
 #define LCD_UPDATERATE_MS		250	// 4 Hz
 #define LCD_BLINK_TIME			333	// ms per state. NOTE: possible blinking pe-
 									// riod is limited down to LCD_UPDATERATE_MS
+#define POWEROFF_SCREEN_MS		1000	// min. time of power off message
 
 
 
@@ -50,7 +60,12 @@ static int32_t setDigit = 1;
 									|| (actualScreen == SCREEN_SET_UEMODE)	\
 									|| (actualScreen == SCREEN_SET_LOGGER))	\
 
-#define IS_SETTINGS_SCREEN		( IS_SETTINGS_SCREEN_GROUP_1 || IS_SETTINGS_SCREEN_GROUP_2 )
+#define IS_SETTINGS_SCREEN_GROUP_3	(  (actualScreen == SCREEN_SET_ADSRATE)		\
+									|| (actualScreen == SCREEN_SET_FILTER_IA)	\
+									|| (actualScreen == SCREEN_SET_FILTER_UC)	\
+									|| (actualScreen == SCREEN_SET_REGSYNC))	\
+
+#define IS_SETTINGS_SCREEN		( IS_SETTINGS_SCREEN_GROUP_1 || IS_SETTINGS_SCREEN_GROUP_2 || IS_SETTINGS_SCREEN_GROUP_3 )
 
 /* Private types -------------------------------------------------------------*/
 
@@ -76,7 +91,7 @@ static void _changeScreenLeftRight(enum eKey key)
 	if (actualScreen == SCREEN_1)
 	{
 		if (key == KEY_LEFT)
-			uiScreenChange(SCREEN_CONTROL_UE);
+			uiScreenChange(SCREEN_RIPPLE);
 		else if (key == KEY_RIGHT)
 			uiScreenChange(SCREEN_2);
 	}
@@ -91,10 +106,44 @@ static void _changeScreenLeftRight(enum eKey key)
 	{
 		if (key == KEY_LEFT)
 			uiScreenChange(SCREEN_2);
+		else if (key == KEY_RIGHT)
+			uiScreenChange(SCREEN_ADS);
+	}
+	else if (actualScreen == SCREEN_ADS)
+	{
+		if (key == KEY_LEFT)
+			uiScreenChange(SCREEN_CONTROL_UE);
+		else if (key == KEY_RIGHT)
+			uiScreenChange(SCREEN_TIMING);
+	}
+	else if (actualScreen == SCREEN_TIMING)
+	{
+		if (key == KEY_LEFT)
+			uiScreenChange(SCREEN_ADS);
+		else if (key == KEY_RIGHT)
+			uiScreenChange(SCREEN_RIPPLE);
+	}
+	else if (actualScreen == SCREEN_RIPPLE)
+	{
+		if (key == KEY_LEFT)
+			uiScreenChange(SCREEN_TIMING);
 		else if (key == KEY_RIGHT)
 			uiScreenChange(SCREEN_1);
 	}
 
+	// Switch table at calibration screen //////////////////////////////////////
+	else if (actualScreen == SCREEN_CALIB)
+	{
+		if (key == KEY_LEFT)
+			calibTable = (calibTable == CALIB_TABLE_CH0) ? (CALIB_TABLES_NUMBER_OF - 1) : (calibTable - 1);
+		else if (key == KEY_RIGHT)
+			calibTable = (calibTable == CALIB_TABLES_NUMBER_OF - 1) ? CALIB_TABLE_CH0 : (calibTable + 1);
+		calibRef = 0;
+		setDigit = 1;
+		calibStatus = "";
+		uiScreenChange(SCREEN_CALIB);
+	}
+
 	// Switch SETTINGS group 1 screens /////////////////////////////////////////
 	else if (actualScreen == SCREEN_SET_UC)
 	{
@@ -155,6 +204,36 @@ static void _changeScreenLeftRight(enum eKey key)
 			uiScreenChange(SCREEN_SET_UE);
 	}
 
+	// Switch SETTINGS group 3 screens /////////////////////////////////////////
+	else if (actualScreen == SCREEN_SET_ADSRATE)
+	{
+		if (key == KEY_LEFT)
+			uiScreenChange(SCREEN_SET_REGSYNC);
+		else if (key == KEY_RIGHT)
+			uiScreenChange(SCREEN_SET_FILTER_IA);
+	}
+	else if (actualScreen == SCREEN_SET_FILTER_IA)
+	{
+		if (key == KEY_LEFT)
+			uiScreenChange(SCREEN_SET_ADSRATE);
+		else if (key == KEY_RIGHT)
+			uiScreenChange(SCREEN_SET_FILTER_UC);
+	}
+	else if (actualScreen == SCREEN_SET_FILTER_UC)
+	{
+		if (key == KEY_LEFT)
+			uiScreenChange(SCREEN_SET_FILTER_IA);
+		else if (key == KEY_RIGHT)
+			uiScreenChange(SCREEN_SET_REGSYNC);
+	}
+	else if (actualScreen == SCREEN_SET_REGSYNC)
+	{
+		if (key == KEY_LEFT)
+			uiScreenChange(SCREEN_SET_FILTER_UC);
+		else if (key == KEY_RIGHT)
+			uiScreenChange(SCREEN_SET_ADSRATE);
+	}
+
 //	if (IS_SETTINGS_SCREEN)
 //		setDigit = 1;
 }
@@ -200,6 +279,33 @@ static void _clearField(int8_t x, uint8_t y, uint8_t len)
 
 
 
+/*
+ * HV shutdown stage, its time and the highest voltage left, in the whole row.
+ * Nothing when HV is off or on.
+ */
+static void _printShutdown(uint8_t row)
+{
+	static const char *const names[] = { "", "Start", "", "Ramp", "Disch.", "Off", "Off" };
+	uint32_t stageTime;
+	enum eHighSideState state = highSideState(&stageTime);
+	float volt = 0.0f;
+
+	_clearField(0, row, printedCharsLine[row]);
+	printedCharsLine[row] = 0;
+	if ((state == HS_OFF) || (state == HS_ON))
+		return;
+
+	// fmaxf() skips NAN - outputs without measurement
+	volt = fmaxf(volt, fabsf(System.meas.fCathodeVolt));
+	volt = fmaxf(volt, fabsf(System.meas.fExtractVolt));
+	volt = fmaxf(volt, fabsf(System.meas.fFocusVolt));
+	volt = fmaxf(volt, fabsf(System.meas.fPumpVolt));
+	printedCharsLine[row] = snprintf_(LCD_buff, sizeof(LCD_buff), "%-6s %5.0fV %4.1fs", names[state], volt, 0.001f * stageTime);
+	HD44780_Puts(0, row, LCD_buff);
+}
+
+
+
 /*
  * Used to blink text in settings.
  * NOTE: the texts blinked now are the same length. Function was not tested for
@@ -255,6 +361,101 @@ static int32_t _printCurrent(float current, char* buff, uint8_t buffSize)
 
 
 
+static int32_t _printRate(enum eAdsRate rate, char* buff, uint8_t buffSize)
+{
+	return snprintf_(buff, buffSize, "%.0f SPS", adsRateToHz(rate));
+}
+
+
+
+/*
+ * Prints rate of regulators being set, at ADS rate being set (decimation is
+ * limited by it).
+ */
+static int32_t _printRegSync(char* buff, uint8_t buffSize)
+{
+	float sampleRate = adsRateToHz(localRef.adsRate);
+	uint32_t decimation = regulatorSyncLimit(localRef.uRegSync, sampleRate);
+
+	if (decimation == 0)
+		return snprintf_(buff, buffSize, "TIM6");
+	return snprintf_(buff, buffSize, "%.0f Hz", sampleRate / (float)decimation);
+}
+
+
+
+static const char* _tuneLoopName(enum ePwmChannel loop)
+{
+	switch (loop)
+	{
+	case PWM_CHANNEL_UC:	return "UC";
+	case PWM_CHANNEL_UE:	return "UE";
+	case PWM_CHANNEL_UF:	return "UF";
+	case REG_IA:			return "IA";
+	default:				return "--";
+	}
+}
+
+
+
+static const char* _calibTableName(enum eCalibTable table)
+{
+	switch (table)
+	{
+	case CALIB_TABLE_CH0:	return "IA";
+	case CALIB_TABLE_CH1:	return "UC";
+	case CALIB_TABLE_PUMP:	return "UP";
+	case CALIB_TABLE_FF_UC:	return "FF UC";
+	case CALIB_TABLE_FF_UE:	return "FF UE";
+	case CALIB_TABLE_FF_UF:	return "FF UF";
+	default:				return "--";
+	}
+}
+
+
+
+/*
+ * Reference entered at SCREEN_CALIB, in units of the table.
+ */
+static float _calibRefValue(void)
+{
+	if (calibTable == CALIB_TABLE_CH0)
+		return (float)calibRef * 1e-8f;	// [A]
+	return (float)calibRef;				// [V]
+}
+
+
+
+static PIDControl* _tuneLoopPid(enum ePwmChannel loop)
+{
+	switch (loop)
+	{
+	case PWM_CHANNEL_UE:	return &pidUe;
+	case PWM_CHANNEL_UF:	return &pidUf;
+	case REG_IA:			return &pidIa;
+	default:				return &pidUc;
+	}
+}
+
+
+
+/*
+ * Prints time given in DWT cycles.
+ */
+static int32_t _printCycles(uint32_t cycles, char* buff, uint8_t buffSize)
+{
+	float time = (float)cycles * (1e6f / (float)SystemCoreClock);	// [us]
+
+	if (time < 100.0f)
+		return snprintf_(buff, buffSize, "%.1f us", time);
+	else if (time < 10000.0f)
+		return snprintf_(buff, buffSize, "%.0f us", time);
+	else
+		return snprintf_(buff, buffSize, "%.0f ms", time / 1000.0f);
+}
+
+
+
 static int32_t _printPower(float power, char* buff, uint8_t buffSize)
 {
 	power = fabsf(power * 1000.0f);
@@ -274,6 +475,7 @@ void uiInit(void)
 	// init variables
 	settingsScreenGr1 = SCREEN_SET_UC;
 	settingsScreenGr2 = SCREEN_SET_UE;
+	settingsScreenGr3 = SCREEN_SET_ADSRATE;
 	returnScreen = SCREEN_1;
 
 	// init LCD on I2C interface
@@ -339,6 +541,53 @@ void uiScreenChange(enum eScreen newScreen)
 		// don't need to print values here, all 'll be refreshed later
 		break;
 
+	case SCREEN_ADS:
+		HD44780_Puts(0, 0, "ADS rate:");	// line 1 - ADS sample rate
+		HD44780_Puts(0, 1, "Delay IA:");	// line 2 - Ia filter group delay
+		HD44780_Puts(0, 2, "Delay UC:");	// line 3 - Uc filter group delay
+		HD44780_Puts(0, 3, "HF log:");		// line 4 - HF logger time base
+		// don't need to print values here, all 'll be refreshed later
+		break;
+
+	case SCREEN_TIMING:
+		HD44780_Puts(0, 0, "Period:");		// line 1 - mean DRDY period
+		HD44780_Puts(0, 1, "Jitter:");		// line 2 - DRDY period max - min
+		HD44780_Puts(0, 2, "Lat.max:");		// line 3 - max DRDY to sample ready
+		HD44780_Puts(0, 3, "Late/Lost:");	// line 4 - samples over latency budget / lost
+		// don't need to print values here, all 'll be refreshed later
+		break;
+
+	case SCREEN_AUTOZERO:
+		HD44780_Puts(0, 0, "Auto-zero  Input");	// line 1 - title, offsets and live ADS codes below
+		HD44780_Puts(0, 1, "IA");			// line 2 - Anode current offset, code
+		HD44780_Puts(0, 2, "UC");			// line 3 - Cathode voltage offset, code
+		HD44780_Puts(0, 3, "Status:");		// line 4 - progress or result
+		// don't need to print values here, all 'll be refreshed later
+		break;
+
+	case SCREEN_TUNE:
+		HD44780_Puts(0, 0, "Tune");			// line 1 - loop and tuning rule
+		HD44780_Puts(0, 2, "Kp:");			// line 3 - Kp in use or tuned one
+		HD44780_Puts(0, 3, "Ki:");			// line 4 - Ki (and Kd) in use or tuned
+		// don't need to print values here, all 'll be refreshed later
+		break;
+
+	case SCREEN_CALIB:
+		HD44780_Puts(0, 0, "Calib");		// line 1 - table and points collected
+		HD44780_Puts(0, 1, "Input:");		// line 2 - ADS code after offset or duty
+		HD44780_Puts(0, 2, "Ref:");			// line 3 - external meter reading
+		HD44780_Puts(0, 3, "Status:");		// line 4 - result of the last action
+		// don't need to print values here, all 'll be refreshed later
+		break;
+
+	case SCREEN_RIPPLE:
+		HD44780_Puts(0, 0, "UC p-p:");		// line 1 - Cathode voltage peak-to-peak
+		HD44780_Puts(0, 1, "UC rms:");		// line 2 - Cathode voltage ripple RMS
+		HD44780_Puts(0, 2, "IA p-p:");		// line 3 - Anode current peak-to-peak
+		HD44780_Puts(0, 3, "IA rms:");		// line 4 - Anode current ripple RMS
+		// don't need to print values here, all 'll be refreshed later
+		break;
+
 	case SCREEN_SET_UC:
 	case SCREEN_SET_IA:
 	case SCREEN_SET_UF:
@@ -415,6 +664,38 @@ void uiScreenChange(enum eScreen newScreen)
 		}
 		break;
 
+	case SCREEN_SET_ADSRATE:
+	case SCREEN_SET_FILTER_IA:
+	case SCREEN_SET_FILTER_UC:
+	case SCREEN_SET_REGSYNC:
+		HD44780_Puts(0, 0, "ADS Rate:");
+		HD44780_Puts(0, 1, "Filt. IA:");
+		HD44780_Puts(0, 2, "Filt. UC:");
+		HD44780_Puts(0, 3, "Regul.:");
+		// Need to print all values here, beacouse only one 'll be refreshed later.
+		// print rate
+		printedCharsLine[0] = _printRate(localRef.adsRate, LCD_buff, 10);
+		HD44780_Puts(10, 0, LCD_buff);
+		// print filters
+		printedCharsLine[1] = snprintf_(LCD_buff, 10, "%s", calibFilterName(localRef.filterIa));
+		HD44780_Puts(10, 1, LCD_buff);
+		printedCharsLine[2] = snprintf_(LCD_buff, 10, "%s", calibFilterName(localRef.filterUc));
+		HD44780_Puts(10, 2, LCD_buff);
+		// print regulators rate
+		printedCharsLine[3] = _printRegSync(LCD_buff, 10);
+		HD44780_Puts(10, 3, LCD_buff);
+		// correct blinking period
+		if (bBlink == true)
+		{
+			uint8_t row = 4;
+			if (newScreen == SCREEN_SET_ADSRATE) row = 0;
+			else if (newScreen == SCREEN_SET_FILTER_IA) row = 1;
+			else if (newScreen == SCREEN_SET_FILTER_UC) row = 2;
+			else if (newScreen == SCREEN_SET_REGSYNC) row = 3;
+			_clearField(0, row, 9);
+		}
+		break;
+
 	case SCREEN_POWERON_1:
 		HD44780_Puts(2, 0, "Microscope supply");	// 17 chars
 		HD44780_Puts(4, 1, "Politechnika");			// 12 chars
@@ -439,6 +720,10 @@ void uiScreenChange(enum eScreen newScreen)
 	case SCREEN_LOWBATT:
 		HD44780_Puts(5, 2, "Low batt!");
 		break;
+
+	case SCREEN_DISCHARGE:
+		HD44780_Puts(4, 1, "HV shutdown");		// line 3 - stage, voltage, time
+		break;
 	}
 	actualScreen = newScreen;
 	uScreenTimer = HAL_GetTick();
@@ -461,6 +746,14 @@ void uiScreenUpdate(void)
 		bInit = true;
 	}
 
+	if (bPowerOffPending && (highSideState(NULL) == HS_OFF) && (uiGetScreenTime() > POWEROFF_SCREEN_MS))
+	{
+		if (bPowerOffSave)
+			flashSaveConfig();
+		powerLockOff();
+		while(0xDEADBABE);
+	}
+
 	if (HAL_GetTick() - uTimeTick > LCD_UPDATERATE_MS)
 	{
 		uTimeTick += LCD_UPDATERATE_MS;
@@ -531,6 +824,219 @@ void uiScreenUpdate(void)
 			HD44780_Puts(9, 3, LCD_buff);
 			break;
 
+		case SCREEN_ADS:
+			// line 1 - ADS sample rate
+			_clearField(10, 0, printedCharsLine[0]);
+			printedCharsLine[0] = _printRate(adsGetDataRate(), LCD_buff, 10);
+			HD44780_Puts(10, 0, LCD_buff);
+			// line 2 - Ia filter group delay
+			_clearField(10, 1, printedCharsLine[1]);
+			printedCharsLine[1] = snprintf_(LCD_buff, 10, "%.1f ms", 1000.0f * filterGroupDelay(&filterIa, FILTER_STAGES_NUMBER_OF));
+			HD44780_Puts(10, 1, LCD_buff);
+			// line 3 - Uc filter group delay
+			_clearField(10, 2, printedCharsLine[2]);
+			printedCharsLine[2] = snprintf_(LCD_buff, 10, "%.1f ms", 1000.0f * filterGroupDelay(&filterUc, FILTER_STAGES_NUMBER_OF));
+			HD44780_Puts(10, 2, LCD_buff);
+			// line 4 - HF logger time base
+			_clearField(10, 3, printedCharsLine[3]);
+			printedCharsLine[3] = snprintf_(LCD_buff, 10, "%.2f ms", 1000.0f * loggerHighFreqPeriodGet());
+			HD44780_Puts(10, 3, LCD_buff);
+			break;
+
+		case SCREEN_TIMING:
+		{
+			// statistics of last LCD_UPDATERATE_MS
+			adsTiming_t timing;
+			adsTimingGet(&timing);
+			// line 1 - mean DRDY period
+			_clearField(10, 0, printedCharsLine[0]);
+			if (timing.periods > 0)
+				printedCharsLine[0] = _printCycles((uint32_t)(timing.periodSum / timing.periods), LCD_buff, 10);
+			else
+				printedCharsLine[0] = snprintf_(LCD_buff, 10, "-----");
+			HD44780_Puts(10, 0, LCD_buff);
+			// line 2 - DRDY period max - min
+			_clearField(10, 1, printedCharsLine[1]);
+			if (timing.periods > 0)
+				printedCharsLine[1] = _printCycles(timing.periodMax - timing.periodMin, LCD_buff, 10);
+			else
+				printedCharsLine[1] = snprintf_(LCD_buff, 10, "-----");
+			HD44780_Puts(10, 1, LCD_buff);
+			// line 3 - max DRDY to sample ready
+			_clearField(10, 2, printedCharsLine[2]);
+			if (timing.samples > 0)
+				printedCharsLine[2] = _printCycles(timing.latencyMax, LCD_buff, 10);
+			else
+				printedCharsLine[2] = snprintf_(LCD_buff, 10, "-----");
+			HD44780_Puts(10, 2, LCD_buff);
+			// line 4 - samples over latency budget / lost (CRC errors, recovery)
+			_clearField(10, 3, printedCharsLine[3]);
+			printedCharsLine[3] = snprintf_(LCD_buff, 10, "%u/%u", timing.late, timing.lost);
+			HD44780_Puts(10, 3, LCD_buff);
+			break;
+		}
+
+		case SCREEN_AUTOZERO:
+		{
+			int32_t offsetIa, offsetUc;
+			float progress;
+			adsSample_t sample;
+			enum eAutoZero state = calibAutoZeroState(&progress);
+			calibOffsetsGet(&offsetIa, &offsetUc);
+			// line 2, 3 - offsets in use [bit]
+			_clearField(3, 1, 7);
+			snprintf_(LCD_buff, 8, "%i", offsetIa);
+			HD44780_Puts(3, 1, LCD_buff);
+			_clearField(3, 2, 7);
+			snprintf_(LCD_buff, 8, "%i", offsetUc);
+			HD44780_Puts(3, 2, LCD_buff);
+			// line 2, 3 - the latest raw codes, so shorted inputs can be
+			// checked before start; sample is published by ADS interrupt
+			_clearField(11, 1, 9);
+			_clearField(11, 2, 9);
+			if (adsSampleRead(&sample))
+			{
+				snprintf_(LCD_buff, 10, "%i", sample.data.channel0);
+				HD44780_Puts(11, 1, LCD_buff);
+				snprintf_(LCD_buff, 10, "%i", sample.data.channel1);
+				HD44780_Puts(11, 2, LCD_buff);
+			}
+			else
+			{
+				HD44780_Puts(11, 1, "-----");
+				HD44780_Puts(11, 2, "-----");
+			}
+			// line 4 - progress or result
+			_clearField(10, 3, printedCharsLine[3]);
+			if ((state == AUTOZERO_RUNNING) || (state == AUTOZERO_DONE))
+				printedCharsLine[3] = snprintf_(LCD_buff, 10, "%.0f %%", 100.0f * progress);
+			else if (state == AUTOZERO_SAVED)
+				printedCharsLine[3] = snprintf_(LCD_buff, 10, "Saved");
+			else if (state == AUTOZERO_ERROR)
+				printedCharsLine[3] = snprintf_(LCD_buff, 10, "Error");
+			else
+				printedCharsLine[3] = snprintf_(LCD_buff, 10, "Aborted");
+			HD44780_Puts(10, 3, LCD_buff);
+			break;
+		}
+
+		case SCREEN_TUNE:
+		{
+			uint32_t cycles;
+			float ku, tu, kp, ki, kd;
+			enum ePwmChannel loop = tuneLoop;
+			enum eAutotuneState state = regulatorTuneState(&cycles, &loop);
+			bool bResult = regulatorTuneResult(tuneRule, &ku, &tu, &kp, &ki, &kd);
+			if (state == AUTOTUNE_IDLE)
+				loop = tuneLoop;
+			if (!bResult)
+			{	// gains in use
+				PIDControl *pid = _tuneLoopPid(loop);
+				kp = PIDKpGet(pid);
+				ki = PIDKiGet(pid);
+				kd = PIDKdGet(pid);
+			}
+			// line 1 - loop and rule
+			_clearField(5, 0, printedCharsLine[0]);
+			printedCharsLine[0] = snprintf_(LCD_buff, 15, "%s %s", _tuneLoopName(loop), autotuneRuleName(tuneRule));
+			HD44780_Puts(5, 0, LCD_buff);
+			// line 2 - progress or ultimate gain and period
+			_clearField(0, 1, printedCharsLine[1]);
+			if (bResult)
+				printedCharsLine[1] = snprintf_(LCD_buff, 20, "Ku %.2e Tu %.0fms", ku, 1000.0f * tu);
+			else if (state == AUTOTUNE_RELAY)
+				printedCharsLine[1] = snprintf_(LCD_buff, 20, "Relay %u/%u", cycles, AUTOTUNE_CYCLES);
+			else if (state == AUTOTUNE_FAILED)
+				printedCharsLine[1] = snprintf_(LCD_buff, 20, "Failed");
+			else
+				printedCharsLine[1] = snprintf_(LCD_buff, 20, "Gains in use");
+			HD44780_Puts(0, 1, LCD_buff);
+			// line 3, 4 - gains
+			_clearField(4, 2, printedCharsLine[2]);
+			printedCharsLine[2] = snprintf_(LCD_buff, 16, "%.3e", kp);
+			HD44780_Puts(4, 2, LCD_buff);
+			_clearField(4, 3, printedCharsLine[3]);
+			if (kd > 0.0f)
+				printedCharsLine[3] = snprintf_(LCD_buff, 16, "%.2e D%.0e", ki, kd);
+			else
+				printedCharsLine[3] = snprintf_(LCD_buff, 16, "%.2e", ki);
+			HD44780_Puts(4, 3, LCD_buff);
+			break;
+		}
+
+		case SCREEN_CALIB:
+		{
+			float input;
+			// line 1 - table and points collected
+			_clearField(6, 0, printedCharsLine[0]);
+			printedCharsLine[0] = snprintf_(LCD_buff, 15, "%s  %u/%u pts", _calibTableName(calibTable), calibPointsCount(calibTable), LUT_POINTS_MAX);
+			HD44780_Puts(6, 0, LCD_buff);
+			// line 2 - input of the point
+			_clearField(10, 1, printedCharsLine[1]);
+			if (!calibPointInput(calibTable, &input))
+				printedCharsLine[1] = snprintf_(LCD_buff, 10, "-----");
+			else if (calibTable >= CALIB_TABLE_PUMP)	// duty
+				printedCharsLine[1] = snprintf_(LCD_buff, 10, "%.4f", input);
+			else
+				printedCharsLine[1] = snprintf_(LCD_buff, 10, "%.0f", input);
+			HD44780_Puts(10, 1, LCD_buff);
+			// line 3 - reference
+			_clearField(10, 2, printedCharsLine[2]);
+			if (calibTable == CALIB_TABLE_CH0)
+				printedCharsLine[2] = snprintf_(LCD_buff, 10, "%.2f uA", _calibRefValue() * 1e6f);
+			else
+				printedCharsLine[2] = snprintf_(LCD_buff, 10, "%i V", calibRef);
+			HD44780_Puts(10, 2, LCD_buff);
+			// line 4 - result of the last action
+			_clearField(10, 3, printedCharsLine[3]);
+			printedCharsLine[3] = snprintf_(LCD_buff, 10, "%s", calibStatus);
+			HD44780_Puts(10, 3, LCD_buff);
+			break;
+		}
+
+		case SCREEN_RIPPLE:
+		{
+			// before filter - ripple of the output itself, of the last window
+			statsResult_t uc, ia;
+			bool bUc = calibStatsGet(STATS_UC, STATS_RAW, &uc);
+			bool bIa = calibStatsGet(STATS_IA, STATS_RAW, &ia);
+			// line 1, 2 - Cathode voltage
+			_clearField(10, 0, printedCharsLine[0]);
+			_clearField(10, 1, printedCharsLine[1]);
+			if (bUc)
+			{
+				printedCharsLine[0] = snprintf_(LCD_buff, 10, "%.2f V", uc.p2p);
+				HD44780_Puts(10, 0, LCD_buff);
+				printedCharsLine[1] = snprintf_(LCD_buff, 10, "%.3f V", uc.std);
+				HD44780_Puts(10, 1, LCD_buff);
+			}
+			else
+			{
+				printedCharsLine[0] = snprintf_(LCD_buff, 10, "-----");
+				HD44780_Puts(10, 0, LCD_buff);
+				printedCharsLine[1] = snprintf_(LCD_buff, 10, "-----");
+				HD44780_Puts(10, 1, LCD_buff);
+			}
+			// line 3, 4 - Anode current
+			_clearField(10, 2, printedCharsLine[2]);
+			_clearField(10, 3, printedCharsLine[3]);
+			if (bIa)
+			{
+				printedCharsLine[2] = snprintf_(LCD_buff, 10, "%.3f uA", ia.p2p * 1e6f);
+				HD44780_Puts(10, 2, LCD_buff);
+				printedCharsLine[3] = snprintf_(LCD_buff, 10, "%.3f uA", ia.std * 1e6f);
+				HD44780_Puts(10, 3, LCD_buff);
+			}
+			else
+			{
+				printedCharsLine[2] = snprintf_(LCD_buff, 10, "-----");
+				HD44780_Puts(10, 2, LCD_buff);
+				printedCharsLine[3] = snprintf_(LCD_buff, 10, "-----");
+				HD44780_Puts(10, 3, LCD_buff);
+			}
+			break;
+		}
+
 		// settings group 1 ////////////////////////////////////////////////////
 		case SCREEN_SET_UC:
 			_blinkText(0, 0, "SET UC:");
@@ -599,11 +1105,53 @@ void uiScreenUpdate(void)
 			HD44780_Puts(10, 3, LCD_buff);
 			break;
 
-		case SCREEN_POWERON_1:
-		case SCREEN_POWERON_2:
+		// settings group 3 ////////////////////////////////////////////////////
+		case SCREEN_SET_ADSRATE:
+			_blinkText(0, 0, "ADS Rate:");
+			_clearField(10, 0, printedCharsLine[0]);
+			printedCharsLine[0] = _printRate(localRef.adsRate, LCD_buff, 10);
+			HD44780_Puts(10, 0, LCD_buff);
+			_clearField(10, 3, printedCharsLine[3]);
+			printedCharsLine[3] = _printRegSync(LCD_buff, 10);	// limited by the rate
+			HD44780_Puts(10, 3, LCD_buff);
+			break;
+
+		case SCREEN_SET_FILTER_IA:
+			_blinkText(0, 1, "Filt. IA:");
+			_clearField(10, 1, printedCharsLine[1]);
+			printedCharsLine[1] = snprintf_(LCD_buff, 10, "%s", calibFilterName(localRef.filterIa));
+			HD44780_Puts(10, 1, LCD_buff);
+			break;
+
+		case SCREEN_SET_FILTER_UC:
+			_blinkText(0, 2, "Filt. UC:");
+			_clearField(10, 2, printedCharsLine[2]);
+			printedCharsLine[2] = snprintf_(LCD_buff, 10, "%s", calibFilterName(localRef.filterUc));
+			HD44780_Puts(10, 2, LCD_buff);
+			break;
+
+		case SCREEN_SET_REGSYNC:
+			_blinkText(0, 3, "Regul.:");
+			_clearField(10, 3, printedCharsLine[3]);
+			printedCharsLine[3] = _printRegSync(LCD_buff, 10);
+			HD44780_Puts(10, 3, LCD_buff);
+			break;
+
 		case SCREEN_POWEROFF:
 		case SCREEN_AUTOPOWEROFF:
 		case SCREEN_LOWBATT:
+			_printShutdown(3);
+			break;
+
+		case SCREEN_DISCHARGE:
+			if (highSideState(NULL) == HS_OFF)
+				uiScreenChange(SCREEN_1);
+			else
+				_printShutdown(2);
+			break;
+
+		case SCREEN_POWERON_1:
+		case SCREEN_POWERON_2:
 			break;
 		}
 	}
@@ -611,6 +1159,24 @@ void uiScreenUpdate(void)
 
 
 
+/*
+ * Shows the screen, shuts HV down and then powers the supply off (after
+ * saving settings, if bSaveConfig), from uiScreenUpdate() - the screen shows
+ * progress of the shutdown meanwhile.
+ */
+void uiPowerOff(enum eScreen screen, bool bSaveConfig)
+{
+	if (bPowerOffPending)
+		return;
+
+	uiScreenChange(screen);
+	highSideShutdown();
+	bPowerOffSave = bSaveConfig;
+	bPowerOffPending = true;
+}
+
+
+
 /*
  * Call in main loop.
  * Execution period (KB read) is controlled internally (50 ms period now).
@@ -636,13 +1202,7 @@ void keyboardRoutine(void)
 			uKeysPressedTime[KEY_POWER]++;
 
 			if (uKeysPressedTime[KEY_POWER] > KB_HOLD_THRESHOLD)
-			{
-				uiScreenChange(SCREEN_POWEROFF);
-				highSideShutdown();
-				flashSaveConfig();
-				powerLockOff();
-				while(0xDEADBABE);
-			}
+				uiPowerOff(SCREEN_POWEROFF, true);
 		}
 		else
 			uKeysPressedTime[KEY_POWER] = 0;
@@ -654,7 +1214,14 @@ void keyboardRoutine(void)
 
 			if (uKeysPressedTime[KEY_ENTER] == KB_PRESSED_THRESHOLD)	// do not repeat 'pressed' action
 			{
-				if (!IS_SETTINGS_SCREEN)
+				if ((actualScreen == SCREEN_AUTOZERO) || (actualScreen == SCREEN_DISCHARGE) || (actualScreen == SCREEN_CALIB))
+				{	// no settings here, calibration point is added on release
+				}
+				else if (actualScreen == SCREEN_TUNE)
+				{	// accept tuning result with the rule shown
+					regulatorTuneAccept(tuneRule);
+				}
+				else if (!IS_SETTINGS_SCREEN)
 				{	// goto settings
 					memcpy(&localRef, &System.ref, sizeof(localRef));
 					returnScreen = actualScreen;
@@ -664,23 +1231,57 @@ void keyboardRoutine(void)
 						if (System.bSweepOn == false)
 							uiScreenChange(settingsScreenGr2);
 					}
+					else if ((actualScreen == SCREEN_ADS) || (actualScreen == SCREEN_TIMING) || (actualScreen == SCREEN_RIPPLE))
+					{
+						if ((System.bSweepOn == false) && (System.bLoggerOn == false))
+							uiScreenChange(settingsScreenGr3);
+					}
 					else
 						uiScreenChange(settingsScreenGr1);
 				}
 				else
 				{	// settings confirmed
+					bool bRateChanged = (localRef.adsRate != System.ref.adsRate);
+					bool bFilterIaChanged = (localRef.filterIa != System.ref.filterIa);
+					bool bFilterUcChanged = (localRef.filterUc != System.ref.filterUc);
+					bool bRegSyncChanged = (localRef.uRegSync != System.ref.uRegSync);
 					memcpy(&System.ref, &localRef, sizeof(System.ref));
+					if (bFilterIaChanged)
+						calibFilterSet(&filterIa, System.ref.filterIa);
+					if (bFilterUcChanged)
+						calibFilterSet(&filterUc, System.ref.filterUc);
+					if (bRegSyncChanged)
+						regulatorSyncSet(System.ref.uRegSync);
+					if (bRateChanged)
+						adsSetDataRate(System.ref.adsRate);	// ADS restarts on the next main loop passes
+
 					if (IS_SETTINGS_SCREEN_GROUP_1)
 						settingsScreenGr1 = actualScreen;
-					else
+					else if (IS_SETTINGS_SCREEN_GROUP_2)
 						settingsScreenGr2 = actualScreen;
+					else
+						settingsScreenGr3 = actualScreen;
 
 					uiScreenChange(returnScreen);
 				}
 			}
+			else if ((uKeysPressedTime[KEY_ENTER] == KB_HOLD_THRESHOLD) && (actualScreen == SCREEN_CALIB))
+			{	// collected points become the table, flash write with HV off only
+				if (highSideState(NULL) != HS_OFF)
+					calibStatus = "HV on";
+				else
+					calibStatus = calibPointsSave(calibTable) ? "Saved" : "Error";
+			}
 		}
 		else
+		{
+			if ((actualScreen == SCREEN_CALIB) && (uKeysPressedTime[KEY_ENTER] >= KB_PRESSED_THRESHOLD)
+					&& (uKeysPressedTime[KEY_ENTER] < KB_HOLD_THRESHOLD))
+			{	// short press: point of the reference entered
+				calibStatus = calibPointAdd(calibTable, _calibRefValue()) ? "Added" : "Error";
+			}
 			uKeysPressedTime[KEY_ENTER] = 0;
+		}
 
 		// KEY_ESC /////////////////////////////////////////////////////////////
 		if (HAL_GPIO_ReadPin(KEY_ESC_GPIO_Port, KEY_ESC_Pin) == GPIO_PIN_RESET)
@@ -693,11 +1294,30 @@ void keyboardRoutine(void)
 				{	// settings abandoned
 					if (IS_SETTINGS_SCREEN_GROUP_1)
 						settingsScreenGr1 = actualScreen;
-					else
+					else if (IS_SETTINGS_SCREEN_GROUP_2)
 						settingsScreenGr2 = actualScreen;
+					else
+						settingsScreenGr3 = actualScreen;
 
 					uiScreenChange(returnScreen);
 				}
+				else if (actualScreen == SCREEN_AUTOZERO)
+				{	// abort if still running, results are applied already else
+					calibAutoZeroAbort();
+					uiScreenChange(SCREEN_ADS);
+				}
+				else if (actualScreen == SCREEN_CALIB)
+				{	// points not saved are dropped
+					calibPointsClear();
+					uiScreenChange(SCREEN_ADS);
+				}
+				else if (actualScreen == SCREEN_TUNE)
+				{	// abort relay or discard result, else leave
+					enum eAutotuneState state = regulatorTuneState(NULL, NULL);
+					regulatorTuneStop();
+					if ((state != AUTOTUNE_RELAY) && (state != AUTOTUNE_DONE))
+						uiScreenChange(SCREEN_1);
+				}
 				else
 				{	// reset HD44780 controller
 					enum eScreen tmp = actualScreen;
@@ -742,13 +1362,13 @@ void keyboardRoutine(void)
 			{
 				if (uKeysPressedTime[KEY_ENC] >= KB_PRESSED_THRESHOLD)
 				{
-					if (IS_SETTINGS_SCREEN)
+					if (IS_SETTINGS_SCREEN || (actualScreen == SCREEN_CALIB))
 					{
 						// increase digit position
 						setDigit *= 10;
 
 						// wrap digit position (depends on screen)
-						if (actualScreen == SCREEN_SET_IA)
+						if ((actualScreen == SCREEN_SET_IA) || ((actualScreen == SCREEN_CALIB) && (calibTable == CALIB_TABLE_CH0)))
 						{
 							if (setDigit > 100)	// 10 uA resolution
 								setDigit = 1;	// 0.1 uA resolution
@@ -759,6 +1379,36 @@ void keyboardRoutine(void)
 								setDigit = 1;	// 1 V resolution
 						}
 					}
+					else if (actualScreen == SCREEN_1)
+					{	// PID auto-tuning, loops must run
+						if ((System.bHighSidePowered == true) && (System.bSweepOn == false) && (System.bLoggerOn == false))
+							uiScreenChange(SCREEN_TUNE);
+					}
+					else if (actualScreen == SCREEN_TUNE)
+					{	// start relay of selected loop, unless there's a result to accept
+						enum eAutotuneState state = regulatorTuneState(NULL, NULL);
+						if ((state != AUTOTUNE_RELAY) && (state != AUTOTUNE_DONE))
+							regulatorTuneStart(tuneLoop);
+					}
+					else if (actualScreen == SCREEN_AUTOZERO)
+					{	// calibration tables, points are taken after offsets
+						enum eAutoZero state = calibAutoZeroState(NULL);
+						if ((state != AUTOZERO_RUNNING) && (state != AUTOZERO_DONE))
+						{
+							calibRef = 0;
+							setDigit = 1;
+							calibStatus = "";
+							uiScreenChange(SCREEN_CALIB);
+						}
+					}
+					else if (actualScreen == SCREEN_ADS)
+					{	// offsets auto-zero, HV must be off and outputs shorted
+						if ((System.bHighSidePowered == false) && (System.bSweepOn == false) && (System.bLoggerOn == false))
+						{
+							if (calibAutoZeroStart())
+								uiScreenChange(SCREEN_AUTOZERO);
+						}
+					}
 					else if (actualScreen == SCREEN_CONTROL_UE)
 					{	// switch logger or sweep
 						if (System.ref.extMode == EXT_SWEEP)
@@ -802,9 +1452,10 @@ void keyboardRoutine(void)
 
 				if (uKeysPressedTime[KEY_ENC] >= KB_HOLD_THRESHOLD)
 				{
-					if (HAL_GPIO_ReadPin(TP32_GPIO_Port, TP32_Pin) == GPIO_PIN_RESET)	// HV enable switch - toggle
+					enum eHighSideState state = highSideState(NULL);
+					if (state == HS_OFF)	// HV enable switch - toggle
 					{
-						if (!IS_SETTINGS_SCREEN)
+						if (!IS_SETTINGS_SCREEN && (actualScreen != SCREEN_AUTOZERO))
 						{
 							if (System.ref.loggerMode == LOGGER_HF_UC_STARTUP)
 							{
@@ -814,8 +1465,13 @@ void keyboardRoutine(void)
 							highSideStart();
 						}
 					}
-					else
+					else if ((state == HS_POWER_UP) || (state == HS_ON))
+					{	// progress shown until HV is off, calibration points
+						// are saved with HV off, so stay there
 						highSideShutdown();
+						if (actualScreen != SCREEN_CALIB)
+							uiScreenChange(SCREEN_DISCHARGE);
+					}
 
 					uKeysPressedTime[KEY_ENC] = 0;	// finish pressed counting
 				}
@@ -881,6 +1537,88 @@ void encoderKnob_turnCallback(void)
 			else
 				localRef.loggerMode = LOGGER_IA_UE_UF;
 		}
+		else if (actualScreen == SCREEN_SET_ADSRATE)
+		{	// change enum, no wrapping
+			if (levelB == GPIO_PIN_SET)
+			{	// left
+				if (localRef.adsRate > ADS_RATE_250)
+					localRef.adsRate--;
+			}
+			else
+			{	// right
+				if (localRef.adsRate < ADS_RATE_MAX)
+					localRef.adsRate++;
+			}
+		}
+		else if (actualScreen == SCREEN_TUNE)
+		{	// tuning rule of the result, or loop to tune (wrapped)
+			enum eAutotuneState state = regulatorTuneState(NULL, NULL);
+			if (state == AUTOTUNE_DONE)
+			{
+				if (levelB == GPIO_PIN_SET)
+					tuneRule = (tuneRule > TUNE_ZN_PI) ? (tuneRule - 1) : (TUNE_RULES_NUMBER_OF - 1);
+				else
+					tuneRule = (tuneRule < TUNE_RULES_NUMBER_OF - 1) ? (tuneRule + 1) : TUNE_ZN_PI;
+			}
+			else if (state != AUTOTUNE_RELAY)
+			{
+				if (levelB == GPIO_PIN_SET)
+					tuneLoop = (tuneLoop == PWM_CHANNEL_UC) ? REG_IA : (tuneLoop == REG_IA) ? PWM_CHANNEL_UF : (tuneLoop == PWM_CHANNEL_UF) ? PWM_CHANNEL_UE : PWM_CHANNEL_UC;
+				else
+					tuneLoop = (tuneLoop == PWM_CHANNEL_UC) ? PWM_CHANNEL_UE : (tuneLoop == PWM_CHANNEL_UE) ? PWM_CHANNEL_UF : (tuneLoop == PWM_CHANNEL_UF) ? REG_IA : PWM_CHANNEL_UC;
+			}
+		}
+		else if (actualScreen == SCREEN_CALIB)
+		{	// reference, within range of the output
+			int32_t value = calibRef + ((levelB == GPIO_PIN_SET) ? -setDigit : setDigit);
+
+			if (calibTable == CALIB_TABLE_CH0)
+			{
+				if ((value < 4800) && (value >= 0))		// 0 - 48.00 uA
+					calibRef = value;
+			}
+			else if (calibTable == CALIB_TABLE_CH1)
+			{
+				if ((value > -5001) && (value <= 0))	// cathode is negative
+					calibRef = value;
+			}
+			else if ((value < 5001) && (value >= 0))
+				calibRef = value;
+		}
+		else if (actualScreen == SCREEN_SET_REGSYNC)
+		{	// decimation, over the values left by the limit, 0 - TIM6
+			uint32_t decimationMin = regulatorSyncLimit(1, adsRateToHz(localRef.adsRate));
+
+			if (levelB == GPIO_PIN_SET)
+			{	// left
+				if (localRef.uRegSync > decimationMin)
+					localRef.uRegSync--;
+				else
+					localRef.uRegSync = 0;
+			}
+			else
+			{	// right
+				if (localRef.uRegSync < decimationMin)
+					localRef.uRegSync = decimationMin;
+				else if (localRef.uRegSync < REGULATOR_SYNC_DECIMATION_MAX)
+					localRef.uRegSync++;
+			}
+		}
+		else if ((actualScreen == SCREEN_SET_FILTER_IA) || (actualScreen == SCREEN_SET_FILTER_UC))
+		{	// change enum, no wrapping
+			enum eFilterPreset *preset = (actualScreen == SCREEN_SET_FILTER_IA) ? &localRef.filterIa : &localRef.filterUc;
+
+			if (levelB == GPIO_PIN_SET)
+			{	// left
+				if (*preset > FILTER_OFF)
+					(*preset)--;
+			}
+			else
+			{	// right
+				if (*preset < FILTER_PRESETS_NUMBER_OF - 1)
+					(*preset)++;
+			}
+		}
 		else
 		{	// change numeric values
 			/* load float value to uint */
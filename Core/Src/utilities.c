@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <string.h>
+#include "crc.h"
 #include "typedefs.h"
 #include "hd44780_i2c.h"
 #include "utilities.h"
@@ -198,34 +199,10 @@ void ledError(uint32_t errNo)
 
 
 
-_OPT_O3 uint8_t crc8(const uint8_t *data, uint32_t length)
-{
-	uint8_t crc = 0x00;
-	uint8_t extract;
-	uint8_t sum;
-
-	for(uint32_t i=0; i<length; i++)
-	{
-		extract = *data;
-		for (uint32_t tempI = 8; tempI; tempI--)
-		{
-			sum = (crc ^ extract) & 0x01;
-			crc >>= 1;
-			if (sum)
-				crc ^= 0x8C;
-			extract >>= 1;
-		}
-		data++;
-	}
-	return crc;
-}
-
-
-
 /*
  * @return 0 - success, 1 - error
  */
-static bool _flashSave(const uint64_t *data)
+static bool _flashSave(uint32_t addr, const uint64_t *data, uint32_t parts)
 {
 	HAL_StatusTypeDef status;
 	bool bError = false;
@@ -238,9 +215,9 @@ static bool _flashSave(const uint64_t *data)
 	}
 	else
 	{
-		for (uint32_t i=0; i<FLASH_DATA_PARTS; i++)
+		for (uint32_t i=0; i<parts; i++)
 		{
-			status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, FLASHSTORAGE2 + (i*sizeof(uint64_t)), data[i]);
+			status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr + (i*sizeof(uint64_t)), data[i]);
 			if (status != HAL_OK)
 			{
 				SPAM(("Flash err program\n"));
@@ -269,7 +246,7 @@ void flashSaveConfig(void)
 		memcpy(&uFlashData.flashData.data, &System.ref, sizeof(tsRegulatedVal));
 		uFlashData.flashData.crc = crc8(uFlashData.buff8, sizeof(tsRegulatedVal));
 
-		_flashSave(uFlashData.buff64);
+		_flashSave(FLASHSTORAGE2, uFlashData.buff64, FLASH_DATA_PARTS);
 		SPAM(("Config saved!\n"));
 	}
 }
@@ -299,4 +276,50 @@ bool flashReadConfig(void)
 	}
 }
 
+
+
+/*
+ * Loads calibration record from flash, if crc is correct.
+ * @return 0 - success, 1 - error
+ */
+bool flashReadCalib(tsCalibRecord *record)
+{
+	tuFlashCalib localFlashCalib;
+
+	memcpy(&localFlashCalib.buff8, (void*)FLASHSTORAGE1, sizeof(localFlashCalib.flashData));
+
+	uint8_t crc = crc8(localFlashCalib.buff8, sizeof(tsCalibRecord));
+
+	if (crc == localFlashCalib.flashData.crc)
+	{
+		memcpy(record, &localFlashCalib.flashData.data, sizeof(tsCalibRecord));
+		return false;
+	}
+	else
+	{
+		return true;
+	}
+}
+
+
+
+/*
+ * Flash is stalled during erase (ca. 22 ms) - samples lost meanwhile are
+ * accounted by ADS driver.
+ * @return 0 - success, 1 - error
+ */
+bool flashSaveCalib(const tsCalibRecord *record)
+{
+	tuFlashCalib localFlashCalib;
+
+	if (flashErase(FLASHSTORAGE1))
+		return true;
+
+	memset(&localFlashCalib, 0xFF, sizeof(localFlashCalib));
+	memcpy(&localFlashCalib.flashData.data, record, sizeof(tsCalibRecord));
+	localFlashCalib.flashData.crc = crc8(localFlashCalib.buff8, sizeof(tsCalibRecord));
+
+	return _flashSave(FLASHSTORAGE1, localFlashCalib.buff64, FLASH_CALIB_PARTS);
+}
+
 /************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
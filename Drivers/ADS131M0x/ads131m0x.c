@@ -33,8 +33,10 @@
 
 #include <string.h>
 #include "ads131m0x.h"
+#include "ads_unpack.h"
 #include "calibration.h"
 #include "communication.h"
+#include "crc.h"
 #include "regulator.h"	// pid tuning
 #include "stm32l4xx_hal.h"
 #include "typedefs.h"
@@ -53,16 +55,147 @@ static uint16_t             registerMap[NUM_REGISTERS];
 // Array of SPI word lengths
 const static uint8_t        wlength_byte_values[] = {2, 3, 4, 4};
 
-// I want use const word length - therefore it must be default 24 bit word
+// I want use const word length - therefore it must be selected at compile time
 //#define BYTES_PER_WORD	(3u)
+#ifdef WORD_LENGTH_16BIT_TRUNCATED
+const static uint32_t bytesPerWord = 2;
+#else
 const static uint32_t bytesPerWord = 3;
+#endif
+
+// all CHn_EN bits of CLOCK register
+#define CLOCK_CH_EN_ALL_MASK	((uint16_t) 0xFF00)
+
+/*
+ * Layout of data frame read on every DRDY, set by adsFrameLayoutUpdate().
+ *
+ * Disabled channels keep their words in the frame and CRC is always the last
+ * word, so with ADS_CHECK_CRC the whole frame is clocked out and only 16 bit
+ * words make it shorter. Without ADS_CHECK_CRC the frame is cut after the last
+ * enabled channel. For Ch0 + Ch1, CLKIN 8 MHz, SPI clock of the rate from
+ * adsRateTable (5 MHz down to OSR 1024, 10 MHz at 512, 20 MHz at 256 and 128):
+ *
+ *  frame                     bytes  SPI time [us]         bytes/s @ OSR:  16384  2048   256    128
+ *                                   5 / 10 / 20 MHz
+ *  24 bit, CRC (default)       24   38.4 / 19.2 / 9.6                     5.9k   46.9k  375k   750k
+ *  16 bit, CRC                 16   25.6 / 12.8 / 6.4                     3.9k   31.3k  250k   500k
+ *  24 bit, no CRC               9   14.4 /  7.2 / 3.6                     2.2k   17.6k  141k   281k
+ *  16 bit, no CRC               6    9.6 /  4.8 / 2.4                     1.5k   11.7k  94k    188k
+ *
+ * SPI times and byte rates are calculated from the clocks, not measured. At
+ * OSR 128 (32 us period) the full frame takes 9.6 us of it.
+ *
+ * ISR time is an estimate too: CRC by crc16ccitt() takes ca. 1 us per frame
+ * (hardware engine or table), unpacking (adsUnpack24) ca. 0.5 us. So dropping
+ * CRC saves ca. 2 ms/s of CPU at 1953 SPS and 31 ms/s at 31250 SPS, 16 bit
+ * words save mostly SPI time. Measure them on target (DWT) before relying.
+ */
+static struct
+{
+	uint8_t channelMask;	// enabled channels, bit n - channel n
+	uint8_t crcIndex;		// index of CRC word = number of bytes covered by CRC
+	uint8_t frameBytes;		// bytes clocked out on every DRDY
+} adsFrame;
+
+// Ping-pong receive buffers: transfer fills one, while the other is parsed in
+// place. Assume the longest case: 32 bit words.
+static uint8_t adsDataRx[2][4 * ADS_FRAME_WORDS];
+static uint32_t adsRxIndex;
+// NULL commands only - zeroed at startup and never written
+static uint8_t adsDataTx[4 * ADS_FRAME_WORDS];
+
+// Selected by adsSetDataRate(), applied at adsStartup()
+static enum eAdsRate adsRate = ADS_RATE_DEFAULT;
+
+/*
+ * SPI clock follows the rate, so the frame (24 B) takes less than half of the
+ * sample period. SPI1 clock 80 MHz, ADS SCLK max 25 MHz.
+ */
+static const struct
+{
+	uint16_t osr;			// CLOCK register bits
+	uint16_t spiPrescaler;
+	float sampleRate;		// [Hz]
+} adsRateTable[ADS_RATE_NUMBER_OF] =
+{
+	[ADS_RATE_250] = { CLOCK_OSR_16384,	SPI_BAUDRATEPRESCALER_16,	244.140625f },
+	[ADS_RATE_500] = { CLOCK_OSR_8192,	SPI_BAUDRATEPRESCALER_16,	488.28125f },
+	[ADS_RATE_1K]  = { CLOCK_OSR_4096,	SPI_BAUDRATEPRESCALER_16,	976.5625f },
+	[ADS_RATE_2K]  = { CLOCK_OSR_2048,	SPI_BAUDRATEPRESCALER_16,	1953.125f },	// 5 MHz, 38 us
+	[ADS_RATE_4K]  = { CLOCK_OSR_1024,	SPI_BAUDRATEPRESCALER_16,	3906.25f },
+	[ADS_RATE_8K]  = { CLOCK_OSR_512,	SPI_BAUDRATEPRESCALER_8,	7812.5f },		// 10 MHz, 19 us
+	[ADS_RATE_16K] = { CLOCK_OSR_256,	SPI_BAUDRATEPRESCALER_4,	15625.0f },		// 20 MHz, 10 us
+	[ADS_RATE_32K] = { CLOCK_OSR_128,	SPI_BAUDRATEPRESCALER_4,	31250.0f },		// 20 MHz, 10 us
+};
+
+// Published sample records: one is given to consumers (System.ads.sample),
+// the other one is written by parser. See adsPublishSample().
+static adsSample_t adsSamples[2];
+static uint32_t adsSampleSeq;
+
+// DRDY timestamps and timing statistics, see adsDrdyTimestamp()
+static volatile uint32_t adsDrdyTime;
+static bool bDrdyFirst = true;			// no period for the first edge after startup
+static uint32_t adsRxTime[2];			// DRDY time of frames in adsDataRx
+static adsTiming_t adsTiming;
+
+// Lost samples accounting, see adsSampleAccount()
+static uint32_t adsPeriodCycles;		// nominal DRDY period in DWT cycles
+static uint32_t adsLastSampleTime;		// DRDY time of the last sample passed further
+static bool bLastSampleValid = false;	// kept over full resets, so they're counted too
+
+/*
+ * Fault recovery steps, clocked by DRDY edges - ADS keeps converting and
+ * pulsing DRDY whether frames are read or not. See adsRecoveryStart().
+ */
+enum eAdsRecovery
+{
+	ADS_RECOVERY_IDLE = 0,
+	ADS_RECOVERY_SYNC,		// next DRDY: sync pulse restarts conversions
+	ADS_RECOVERY_FLUSH,		// first DRDY after sync: SPI FIFO and DMA cleaned up
+	ADS_RECOVERY_REARM,		// next DRDY: frames are read again from this one
+};
+
+static struct
+{
+	volatile enum eAdsRecovery state;
+	uint32_t attempts;		// in a row, without ADS_RECOVERY_GOOD_SAMPLES in between
+	uint32_t goodSamples;	// since the last re-arm
+	uint32_t crcErrors;		// frames with CRC error in a row
+	uint32_t startTick;		// HAL tick of the last attempt, see adsRecoveryWatchdog()
+} adsRecovery;
 
-// assume buffers for the longest case: 32 bit words
-static uint8_t adsDataRx[4 * 8];
-static uint8_t adsDataTx[sizeof(adsDataRx)];
+/*
+ * Rate change with running acquisition, one step per main loop pass (see
+ * adsRateChangeStep()), so no single pass stalls for the whole restart.
+ */
+enum eAdsRateChange
+{
+	ADS_RATE_CHANGE_IDLE = 0,
+	ADS_RATE_CHANGE_STOP,		// acquisition is stopped
+	ADS_RATE_CHANGE_RETUNE,		// last frame has finished, application retunes
+	ADS_RATE_CHANGE_RESTART,	// ADS is reset and started with new rate
+};
+
+static struct
+{
+	enum eAdsRateChange state;
+	enum eAdsRate rate;		// requested one
+	uint32_t stopTick;		// HAL tick of the stop
+} adsRateChange;
 
 static uint32_t uTimerProtection;
 
+#ifdef ADS_SPI_USE_DMA_BLOCK
+// circular buffer of whole frames, DMA fills one frame per DRDY
+static uint8_t adsBlockRx[ADS_BLOCK_FRAMES][4 * ADS_FRAME_WORDS];
+// unpacked samples of half of the buffer, passed to the block callback
+static adsChannelData_t adsBlockData[ADS_BLOCK_HALF];
+static uint32_t adsBlockTime[ADS_BLOCK_FRAMES];	// DRDY time of frames in adsBlockRx
+static uint32_t adsBlockIndex;
+static volatile uint32_t adsBlockReady;	// halves waiting for adsReadDataBlockProcess(), bit n - half n
+#endif
+
 //******************************************************************************
 //
 // Internal function prototypes
@@ -76,6 +209,21 @@ static int32_t signExtend (const uint8_t*);
 static uint8_t buildSPIarray(const uint16_t*, uint8_t, uint8_t*);
 static uint16_t enforce_selected_device_modes(uint16_t data);
 static uint8_t getWordByteLength(void);
+static bool adsParseFrame(const uint8_t frame[], adsChannelData_t *DataStruct);
+static void adsFrameLayoutUpdate(uint8_t mask);
+static adsSample_t* adsNextSample(void);
+static void adsSpiClockUpdate(void);
+static void adsPublishSample(adsSample_t *sample);
+#ifdef ADS_SPI_USE_DMA_BLOCK
+static void adsProcessBlock(uint32_t first);
+#endif
+static void adsTimingReset(void);
+static void adsLatencyUpdate(uint32_t drdyTime, uint32_t now);
+static void adsSampleAccount(adsChannelData_t *data);
+static void adsCrcError(void);
+static void adsRecoveryEscalate(void);
+static void adsRateApply(enum eAdsRate rate);
+static void adsRateChangeStep(void);
 
 
 
@@ -114,8 +262,18 @@ void adsStartup(void)
 	uint16_t response;
 	uint8_t uChannelsNum;
 
+	adsSpiClockUpdate();
 	adsResetHard();
 
+	dwtInit();
+	adsTimingReset();
+	bDrdyFirst = true;
+	adsPeriodCycles = (uint32_t)((float)SystemCoreClock / adsRateTable[adsRate].sampleRate + 0.5f);
+
+	adsRecovery.state = ADS_RECOVERY_IDLE;
+	adsRecovery.attempts = 0;
+	adsRecovery.crcErrors = 0;
+
 	// check ID register
 	adsReadSingleRegister(ID_ADDRESS);
 	uChannelsNum = (uint8_t)((registerMap[ID_ADDRESS] >> 8) & 0x0F);
@@ -125,13 +283,18 @@ void adsStartup(void)
 	SPAM(("ADC status register: 0x%X, channels: %u\n", response, uChannelsNum));
 	UNUSED(response);
 
-	// disable unused channels, set OSR
-#if defined (ADS_SPI_USE_INT) || defined (ADS_SPI_USE_DMA)
-	reg = CLOCK_CH0_EN_ENABLED + CLOCK_CH1_EN_ENABLED + CLOCK_XTAL_DIS_ENABLED + CLOCK_OSR_2048 + CLOCK_PWR_HR;
-#else
-	reg = CLOCK_CH0_EN_ENABLED + CLOCK_CH1_EN_ENABLED + CLOCK_XTAL_DIS_ENABLED + CLOCK_OSR_16384 + CLOCK_PWR_HR;
+#ifdef WORD_LENGTH_16BIT_TRUNCATED
+	// switch to 16 bit words - WLENGTH is set by enforce_selected_device_modes()
+	// NOTE: it also sets DRDY format selected in header (pulse), which is
+	// 		default (logic low) otherwise, both work with EXTI falling edge.
+	adsWriteSingleRegister(MODE_ADDRESS, registerMap[MODE_ADDRESS]);
 #endif
+
+	// disable unused channels, set OSR
+	reg = CLOCK_XTAL_DIS_ENABLED + adsRateTable[adsRate].osr + CLOCK_PWR_HR;
+	reg |= ((uint16_t)ADS_CHANNEL_MASK << 8) & CLOCK_CH_EN_ALL_MASK;
 	adsWriteSingleRegister(CLOCK_ADDRESS, reg);
+	adsFrameLayoutUpdate(ADS_CHANNEL_MASK);
 
 	/* (OPTIONAL) Check STATUS register for faults */
 	uTimerProtection = HAL_GetTick();
@@ -390,55 +553,34 @@ bool adsReadData(adsChannelData_t *DataStruct)
 
 
 /*
- * Reads 8 words in blocking mode.
+ * Reads one frame (see adsFrame) in blocking mode and publishes it.
  * 133 us @ 2.5 MHz SPI @ 24 B
  * 100 us @ 5 MHz SPI @ 24 B
  * 78 us @ 10 MHz SPI @ 24 B
+ *
+ * @return	published sample or NULL when a CRC error occurs
  */
-bool adsReadDataOptimized(adsChannelData_t *DataStruct)
+const adsSample_t* adsReadDataOptimized(void)
 {
-    uint32_t i;
-	uint16_t crcCalc;
-	UNUSED(crcCalc);
-
-    memset(adsDataRx, 0x00, sizeof(adsDataRx));
-    memset(adsDataTx, 0x00, sizeof(adsDataTx));
+    adsSample_t *sample = adsNextSample();
 
     adsSetCS(LOW);
 
-    HAL_SPI_TransmitReceive(&hspi1, adsDataTx, adsDataRx, bytesPerWord * 8, 10);
-    i = 0;
-    DataStruct->response = combineBytes(adsDataRx[i], adsDataRx[i+1]);
-    i += bytesPerWord;
-    DataStruct->channel0 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel1 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel2 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel3 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel4 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel5 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->crc = combineBytes(adsDataRx[i], adsDataRx[i+1]);
+    HAL_SPI_TransmitReceive(&hspi1, adsDataTx, adsDataRx[0], adsFrame.frameBytes, 10);
 
     adsSetCS(HIGH);
 
-#ifdef ADS_CHECK_CRC
-    //crcCalc = adsCalculateCRC(&adsDataRx[0], i, 0xFFFF);
-    crcCalc = adsCalculateCRCfast(&adsDataRx[0], i);
-
-    if (crcCalc != DataStruct->crc)
+    if (false == adsParseFrame(adsDataRx[0], &sample->data))
     {
-    	adsSyncPulse();
-    	return false;
+    	adsCrcError();
+    	return NULL;
     }
-#endif
 
-    // Returns false when a CRC error occurs
-    return true;
+    sample->data.timestamp = adsDrdyTime;
+    adsLatencyUpdate(sample->data.timestamp, DWT->CYCCNT);
+    adsSampleAccount(&sample->data);
+    adsPublishSample(sample);
+    return sample;
 }
 
 
@@ -450,23 +592,19 @@ _OPT_OFF void adsReadDataIT(void)
 {
 	HAL_StatusTypeDef retVal;
 
-    memset(adsDataRx, 0x00, sizeof(adsDataRx));
-    memset(adsDataTx, 0x00, sizeof(adsDataTx));
+	// the other buffer may be still parsed
+	adsRxIndex ^= 1;
+	adsRxTime[adsRxIndex] = adsDrdyTime;
 
 	adsSetCS(LOW);
-	// read 8 words
-	retVal = HAL_SPI_TransmitReceive_IT(&hspi1, adsDataTx, adsDataRx, 8 * 3);
+	// read whole frame
+	retVal = HAL_SPI_TransmitReceive_IT(&hspi1, adsDataTx, adsDataRx[adsRxIndex], adsFrame.frameBytes);
 
 	if (retVal != HAL_OK)
 	{
-		SPAM(("ADS RX_IT init error\n"));
 		//SPAM(("ADS RX_IT init error: %u\n", retVal));
-		adsSetCS(HIGH);
-		HAL_NVIC_DisableIRQ(EXTI4_IRQn);
-		HAL_SPI_Abort_IT(&hspi1);	// Rx may be in progress in interrupt mode, will cause HardFault if come
-		// Set flags and stop ADS, it will be re-launched in non-blocking main() loop
-		System.ads.ready = false;
-		System.ads.error = true;
+		// aborts transfer, next DRDY edges restart acquisition
+		adsRecoveryStart();
 
 //		adsSyncPulse();
 //		adsSetCS(LOW);
@@ -504,31 +642,16 @@ _OPT_OFF void adsReadDataIT(void)
 
 /*
  * Called in SPI transmission end interrupt, finishes reading data triggered by
- * corresponding function.
+ * corresponding function. Frame is parsed in place, straight into the sample
+ * record which is published afterwards.
  * 10 us version with index incrementing
  * 9 us version with constant indexes
+ *
+ * @return	published sample or NULL when a CRC error occurs
  */
-_OPT_O3 bool adsReadDataITcallback(adsChannelData_t *DataStruct)
+_OPT_O3 const adsSample_t* adsReadDataITcallback(void)
 {
-	uint16_t crcCalc;
-	UNUSED(crcCalc);
-
-    uint32_t i = 0;
-    DataStruct->response = combineBytes(adsDataRx[i], adsDataRx[i+1]);
-    i += bytesPerWord;
-    DataStruct->channel0 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel1 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel2 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel3 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel4 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->channel5 = signExtend(&adsDataRx[i]);
-    i += bytesPerWord;
-    DataStruct->crc = combineBytes(adsDataRx[i], adsDataRx[i+1]);
+    adsSample_t *sample = adsNextSample();
 
     adsSetCS(HIGH);
 
@@ -538,19 +661,78 @@ _OPT_O3 bool adsReadDataITcallback(adsChannelData_t *DataStruct)
 ////    	adsStartup();
 //    }
 
-#ifdef ADS_CHECK_CRC
-//    crcCalc = adsCalculateCRC(&adsDataRx[0], i, 0xFFFF);
-    crcCalc = adsCalculateCRCfast(&adsDataRx[0], i);
-
-    if (crcCalc != DataStruct->crc)
+    if (false == adsParseFrame(adsDataRx[adsRxIndex], &sample->data))
     {
-    	//adsSyncPulse();
-    	return false;
+    	adsCrcError();
+    	return NULL;
     }
-#endif
 
-    // Returns false when a CRC error occurs
-    return true;
+    sample->data.timestamp = adsRxTime[adsRxIndex];
+    adsLatencyUpdate(sample->data.timestamp, DWT->CYCCNT);
+    adsSampleAccount(&sample->data);
+    adsPublishSample(sample);
+    return sample;
+}
+
+
+
+/*
+ * Copies the latest published sample. Use it where sample may be published
+ * during reading (main loop, lower priority interrupt). Code called from ADS
+ * interrupts may use System.ads.sample directly.
+ *
+ * @return	false if there's no sample yet or it was overwritten while copying
+ * 			three times in a row
+ */
+bool adsSampleRead(adsSample_t *copy)
+{
+	for (uint32_t retry = 0; retry < 3; retry++)
+	{
+		const adsSample_t *sample = System.ads.sample;
+		if (sample == NULL)
+			return false;
+
+		uint32_t seq = sample->seq;
+		__DMB();
+		if (seq & 1u)
+			continue;	// being written right now
+
+		*copy = *sample;
+		__DMB();
+		if (sample->seq == seq)
+			return true;
+	}
+	return false;
+}
+
+
+
+/*
+ * Returns record for the next sample - the one not published now. Its sequence
+ * number is odd while it's written.
+ */
+static inline adsSample_t* adsNextSample(void)
+{
+	adsSample_t *sample = (System.ads.sample == &adsSamples[0]) ? &adsSamples[1] : &adsSamples[0];
+
+	sample->seq = adsSampleSeq + 1;
+	__DMB();
+	return sample;
+}
+
+
+
+/*
+ * Completes the record (even sequence number) and publishes it with single
+ * pointer write, so consumers never see partially parsed frame.
+ */
+static inline void adsPublishSample(adsSample_t *sample)
+{
+	adsSampleSeq += 2;
+	__DMB();
+	sample->seq = adsSampleSeq;
+	__DMB();
+	System.ads.sample = sample;
 }
 
 
@@ -561,24 +743,703 @@ _OPT_O3 bool adsReadDataITcallback(adsChannelData_t *DataStruct)
 _OPT_OFF void adsReadDataDMA(void)
 {
 	HAL_StatusTypeDef retVal;
-    memset(adsDataRx, 0x00, sizeof(adsDataRx));
-    memset(adsDataTx, 0x00, sizeof(adsDataTx));
+
+	// the other buffer may be still parsed
+	adsRxIndex ^= 1;
+	adsRxTime[adsRxIndex] = adsDrdyTime;
+
 	adsSetCS(LOW);
-	// read 8 words
-	retVal = HAL_SPI_TransmitReceive_DMA(&hspi1, adsDataTx, adsDataRx, 8* 3);
+	// read whole frame
+	retVal = HAL_SPI_TransmitReceive_DMA(&hspi1, adsDataTx, adsDataRx[adsRxIndex], adsFrame.frameBytes);
 //	retVal = HAL_SPI_Receive_DMA(&hspi1, adsDataRx, 8*3);
 
 	if (retVal != HAL_OK)
 	{
-		adsSetCS(HIGH);
-		HAL_NVIC_DisableIRQ(EXTI4_IRQn);
-		HAL_SPI_DMAStop(&hspi1);
-		SPAM(("ADS RX_DMA init error\n"));
 		//SPAM(("ADS RX_IT init error: %u\n", retVal));
-		// Set flags and stop ADS, it will be re-launched in non-blocking main() loop
+		// stops DMA, next DRDY edges restart acquisition
+		adsRecoveryStart();
+	}
+}
+
+
+
+#ifdef ADS_SPI_USE_DMA_BLOCK
+/*
+ * Prepares SPI and both its DMA channels for block acquisition. Call it after
+ * adsStartup(), which uses SPI in blocking mode.
+ *
+ * DMA channels are configured by HAL in HAL_SPI_MspInit(), from now on they
+ * are driven directly by registers: Tx channel clocks out the same frame of
+ * NULL commands, Rx channel writes consecutive frames of circular buffer.
+ * Filled halves are processed in PendSV, which gets the lowest priority here,
+ * so DRDY and DMA interrupts are never delayed by processing.
+ */
+void adsReadDataBlockStart(void)
+{
+	adsReadDataBlockStop();
+	adsBlockIndex = 0;
+	adsBlockReady = 0;
+
+	HAL_NVIC_SetPriority(PendSV_IRQn, (1u << __NVIC_PRIO_BITS) - 1, 0);
+
+	hdma_spi1_rx.Instance->CPAR = (uint32_t)&hspi1.Instance->DR;
+	hdma_spi1_tx.Instance->CPAR = (uint32_t)&hspi1.Instance->DR;
+	hdma_spi1_tx.Instance->CMAR = (uint32_t)adsDataTx;
+
+	// only Rx channel interrupts, it always completes after Tx
+	SET_BIT(hdma_spi1_rx.Instance->CCR, DMA_CCR_TCIE | DMA_CCR_TEIE);
+	CLEAR_BIT(hdma_spi1_rx.Instance->CCR, DMA_CCR_HTIE);
+	CLEAR_BIT(hdma_spi1_tx.Instance->CCR, DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE);
+
+	// Rx requests must be enabled before Tx ones (RM0394 SPI DMA procedure),
+	// transfer starts when Tx DMA channel gets enabled by DRDY interrupt
+	SET_BIT(hspi1.Instance->CR2, SPI_CR2_RXDMAEN);
+	SET_BIT(hspi1.Instance->CR2, SPI_CR2_TXDMAEN);
+	__HAL_SPI_ENABLE(&hspi1);
+}
+
+
+
+/*
+ * Stops block acquisition and gives SPI back for blocking transfers.
+ */
+void adsReadDataBlockStop(void)
+{
+	CLEAR_BIT(hdma_spi1_tx.Instance->CCR, DMA_CCR_EN);
+	CLEAR_BIT(hdma_spi1_rx.Instance->CCR, DMA_CCR_EN);
+	CLEAR_BIT(hspi1.Instance->CR2, SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+
+	hdma_spi1_rx.DmaBaseAddress->IFCR = (DMA_ISR_GIF1 << (hdma_spi1_rx.ChannelIndex & 0x1CU));
+	hdma_spi1_tx.DmaBaseAddress->IFCR = (DMA_ISR_GIF1 << (hdma_spi1_tx.ChannelIndex & 0x1CU));
+
+	adsSetCS(HIGH);
+}
+
+
+
+/*
+ * Call it in DRDY interrupt. Points Rx DMA to next frame of circular buffer
+ * and starts the transfer - no HAL, no buffer clearing, ca. 1 us.
+ */
+_OPT_O3 void adsReadDataBlockDMA(void)
+{
+	DMA_Channel_TypeDef *rx = hdma_spi1_rx.Instance;
+	DMA_Channel_TypeDef *tx = hdma_spi1_tx.Instance;
+
+	if (rx->CCR & DMA_CCR_EN)
+	{	// previous frame is not finished yet
+		adsRecoveryStart();
+		return;
+	}
+
+	adsBlockTime[adsBlockIndex] = adsDrdyTime;
+	rx->CMAR = (uint32_t)adsBlockRx[adsBlockIndex];
+	rx->CNDTR = adsFrame.frameBytes;
+	tx->CNDTR = adsFrame.frameBytes;
+
+	adsSetCS(LOW);
+	SET_BIT(rx->CCR, DMA_CCR_EN);
+	SET_BIT(tx->CCR, DMA_CCR_EN);
+}
+
+
+
+/*
+ * Call it in Rx DMA channel interrupt instead of HAL_DMA_IRQHandler().
+ * Closes the frame and every half of the buffer pends its processing (PendSV,
+ * see adsReadDataBlockProcess()), while DMA goes on with the other half.
+ */
+_OPT_O3 void adsReadDataBlockIRQHandler(void)
+{
+	uint32_t flags = hdma_spi1_rx.DmaBaseAddress->ISR >> (hdma_spi1_rx.ChannelIndex & 0x1CU);
+
+	hdma_spi1_rx.DmaBaseAddress->IFCR = (DMA_ISR_GIF1 << (hdma_spi1_rx.ChannelIndex & 0x1CU));
+	hdma_spi1_tx.DmaBaseAddress->IFCR = (DMA_ISR_GIF1 << (hdma_spi1_tx.ChannelIndex & 0x1CU));
+
+	adsSetCS(HIGH);
+	CLEAR_BIT(hdma_spi1_tx.Instance->CCR, DMA_CCR_EN);
+	CLEAR_BIT(hdma_spi1_rx.Instance->CCR, DMA_CCR_EN);
+
+	if (flags & DMA_ISR_TEIF1)
+	{
+		adsRecoveryStart();
+		return;
+	}
+
+	adsBlockIndex++;
+	if (adsBlockIndex == ADS_BLOCK_HALF)
+	{
+		adsBlockReady |= 1u << 0;
+	}
+	else if (adsBlockIndex >= ADS_BLOCK_FRAMES)
+	{
+		adsBlockIndex = 0;
+		adsBlockReady |= 1u << 1;
+	}
+	else
+		return;
+
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+
+
+/*
+ * Call it in PendSV interrupt, it has the lowest priority (see
+ * adsReadDataBlockStart()).
+ *
+ * @brief	Processes halves of the buffer filled since the last call. DMA
+ * 			gets back to a half after ADS_BLOCK_HALF sample periods, so it has
+ * 			to be processed in that time (late samples show it, adsTiming_t).
+ * 			If both halves are waiting, one of them is written again already -
+ * 			only the other one is processed, lost samples are counted from
+ * 			DRDY times.
+ */
+_OPT_O3 void adsReadDataBlockProcess(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t ready;
+
+	__disable_irq();
+	ready = adsBlockReady;
+	adsBlockReady = 0;
+	if (ready == ((1u << 0) | (1u << 1)))
+		ready = (adsBlockIndex < ADS_BLOCK_HALF) ? (1u << 1) : (1u << 0);
+	__set_PRIMASK(primask);
+
+	if (ready & (1u << 0))
+		adsProcessBlock(0);
+	if (ready & (1u << 1))
+		adsProcessBlock(ADS_BLOCK_HALF);
+}
+
+
+
+/*
+ * Unpacks half of the circular buffer and passes valid samples further. The
+ * last valid one is also published as the latest sample.
+ *
+ * Runs preempted by DRDY and DMA interrupts, which also do fault recovery, so
+ * accounting (recovery counters, timing) is done with interrupts disabled.
+ */
+static _OPT_O3 void adsProcessBlock(uint32_t first)
+{
+	uint32_t count = 0;
+	uint32_t crcErrors = 0;
+	uint32_t now = DWT->CYCCNT;
+	uint32_t primask;
+	adsSample_t *sample;
+
+	for (uint32_t i = first; i < first + ADS_BLOCK_HALF; i++)
+	{
+		bool bValid = adsParseFrame(adsBlockRx[i], &adsBlockData[count]);
+
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (bValid)
+		{
+			adsBlockData[count].timestamp = adsBlockTime[i];
+			adsLatencyUpdate(adsBlockTime[i], now);
+			adsSampleAccount(&adsBlockData[count]);
+			count++;
+		}
+		else
+		{
+			crcErrors++;
+			adsCrcError();
+		}
+		__set_PRIMASK(primask);
+	}
+
+	if (count > 0)
+	{
+		sample = adsNextSample();
+		sample->data = adsBlockData[count - 1];
+		adsPublishSample(sample);
+	}
+
+	adsReadDataBlockCallback(adsBlockData, count, crcErrors);
+}
+#endif // ADS_SPI_USE_DMA_BLOCK
+
+
+
+/*
+ * Call it first thing in DRDY (EXTI4) interrupt, ca. 20 cycles.
+ *
+ * @brief	Stores DRDY time for the frame read next and measures period between
+ * 			DRDY interrupts - its variation is the interrupt entry delay caused
+ * 			by other interrupts (all have the same priority now).
+ */
+_OPT_O3 void adsDrdyTimestamp(void)
+{
+	uint32_t now = DWT->CYCCNT;
+	uint32_t period = now - adsDrdyTime;
+
+	adsDrdyTime = now;
+
+	if (bDrdyFirst)
+	{
+		bDrdyFirst = false;
+		return;
+	}
+
+	adsTiming.periods++;
+	adsTiming.periodSum += period;
+	if (period < adsTiming.periodMin)
+		adsTiming.periodMin = period;
+	if (period > adsTiming.periodMax)
+		adsTiming.periodMax = period;
+}
+
+
+
+/*
+ * Can be called from main loop, e.g. once per LCD refresh.
+ *
+ * @brief	Copies timing statistics and restarts the window (late samples
+ * 			counter is not cleared).
+ */
+void adsTimingGet(adsTiming_t *copy)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	*copy = adsTiming;
+	adsTimingReset();
+
+	__set_PRIMASK(primask);
+}
+
+
+
+static void adsTimingReset(void)
+{
+	adsTiming.periods = 0;
+	adsTiming.periodMin = UINT32_MAX;
+	adsTiming.periodMax = 0;
+	adsTiming.periodSum = 0;
+	adsTiming.samples = 0;
+	adsTiming.latencyMin = UINT32_MAX;
+	adsTiming.latencyMax = 0;
+	adsTiming.latencySum = 0;
+}
+
+
+
+/*
+ * Called when sample is parsed and is going to be passed to application.
+ */
+static inline void adsLatencyUpdate(uint32_t drdyTime, uint32_t now)
+{
+	uint32_t latency = now - drdyTime;
+
+	adsTiming.samples++;
+	adsTiming.latencySum += latency;
+	if (latency < adsTiming.latencyMin)
+		adsTiming.latencyMin = latency;
+	if (latency > adsTiming.latencyMax)
+		adsTiming.latencyMax = latency;
+	if (latency > ADS_LATENCY_BUDGET_US * (SystemCoreClock / 1000000u))
+		adsTiming.late++;
+}
+
+
+
+/*
+ * Called when sample is parsed and is going to be passed to application.
+ *
+ * @brief	Counts samples lost since the previous one from DRDY times, so every
+ * 			cause (CRC errors, recovery, full reset, missed DRDY) is covered.
+ * 			Result goes to data->lost for the application. Good samples also
+ * 			end the CRC error series and, after ADS_RECOVERY_GOOD_SAMPLES, the
+ * 			series of recovery attempts.
+ */
+static inline void adsSampleAccount(adsChannelData_t *data)
+{
+	uint32_t period = adsPeriodCycles;
+	uint32_t elapsed = data->timestamp - adsLastSampleTime;
+
+	data->lost = 0;
+	if (bLastSampleValid && (elapsed > period + period / 2))
+	{
+		data->lost = (elapsed + period / 2) / period - 1;
+		adsTiming.lost += data->lost;
+	}
+	adsLastSampleTime = data->timestamp;
+	bLastSampleValid = true;
+
+	adsRecovery.crcErrors = 0;
+	if ((adsRecovery.attempts > 0) && (++adsRecovery.goodSamples >= ADS_RECOVERY_GOOD_SAMPLES))
+		adsRecovery.attempts = 0;
+}
+
+
+
+/*
+ * Single CRC errors only lose the frame, a series of them starts recovery.
+ */
+static void adsCrcError(void)
+{
+	if (++adsRecovery.crcErrors >= ADS_RECOVERY_CRC_ERRORS)
+	{
+		adsRecovery.crcErrors = 0;
+		adsRecoveryStart();
+	}
+}
+
+
+
+/*
+ * Call it from any ADS interrupt (DRDY, SPI, DMA) on transfer fault.
+ *
+ * @brief	Stops the transfer and starts non-blocking recovery - the next DRDY
+ * 			edges send sync pulse, flush SPI and re-arm acquisition (see
+ * 			adsRecoveryStep()), ca. 3 sample periods plus filter settling after
+ * 			sync. After ADS_RECOVERY_ATTEMPTS attempts in a row, or when DRDY
+ * 			stops (adsRecoveryWatchdog()), System.ads.error is set and main loop
+ * 			does full reset by InitADC().
+ */
+void adsRecoveryStart(void)
+{
+	System.ads.ready = false;
+
+#if defined (ADS_SPI_USE_DMA_BLOCK)
+	adsReadDataBlockStop();
+#elif defined (ADS_SPI_USE_DMA)
+	HAL_SPI_DMAStop(&hspi1);
+#elif defined (ADS_SPI_USE_INT)
+	HAL_SPI_Abort_IT(&hspi1);	// Rx may be in progress in interrupt mode, will cause HardFault if come
+#endif
+	adsSetCS(HIGH);
+
+	if (++adsRecovery.attempts > ADS_RECOVERY_ATTEMPTS)
+	{
+		adsRecoveryEscalate();
+		return;
+	}
+
+	adsRecovery.startTick = HAL_GetTick();
+	adsRecovery.state = ADS_RECOVERY_SYNC;
+}
+
+
+
+/*
+ * Call it in DRDY interrupt when System.ads.ready is false, before reading.
+ * Does nothing if recovery doesn't run.
+ *
+ * @brief	Does one recovery step per DRDY edge, the last one sets
+ * 			System.ads.ready, so frame of the same edge is read already.
+ */
+_OPT_O3 void adsRecoveryStep(void)
+{
+	switch (adsRecovery.state)
+	{
+	case ADS_RECOVERY_SYNC:
+		adsSyncPulse();		// 1 us
+		adsRecovery.state = ADS_RECOVERY_FLUSH;
+		break;
+
+	case ADS_RECOVERY_FLUSH:
+		HAL_SPIEx_FlushRxFifo(&hspi1);
+		__HAL_SPI_CLEAR_OVRFLAG(&hspi1);
+#ifdef ADS_SPI_USE_DMA_BLOCK
+		adsReadDataBlockStart();
+#endif
+		adsRecovery.state = ADS_RECOVERY_REARM;
+		break;
+
+	case ADS_RECOVERY_REARM:
+		adsRecovery.state = ADS_RECOVERY_IDLE;
+		adsRecovery.goodSamples = 0;
+		adsTiming.recoveries++;
+		System.ads.ready = true;
+		break;
+
+	case ADS_RECOVERY_IDLE:
+	default:
+		break;
+	}
+}
+
+
+
+/*
+ * Call it from main loop, before System.ads.error is checked.
+ *
+ * @brief	Recovery depends on DRDY edges - if they don't come for
+ * 			ADS_RECOVERY_TIMEOUT_MS, it ends with full reset. Also advances
+ * 			rate change requested by adsSetDataRate().
+ */
+void adsRecoveryWatchdog(void)
+{
+	adsRateChangeStep();
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((adsRecovery.state != ADS_RECOVERY_IDLE) &&
+		(HAL_GetTick() - adsRecovery.startTick > ADS_RECOVERY_TIMEOUT_MS))
+	{
+		adsRecoveryEscalate();
+	}
+
+	__set_PRIMASK(primask);
+}
+
+
+
+/*
+ * Gives up fast recovery, acquisition is stopped until InitADC() in main loop.
+ */
+static void adsRecoveryEscalate(void)
+{
+	HAL_NVIC_DisableIRQ(EXTI4_IRQn);
+	adsRecovery.state = ADS_RECOVERY_IDLE;
+	adsTiming.resets++;
+	SPAM(("ADS recovery failed, reset\n"));
+	System.ads.ready = false;
+	System.ads.error = true;
+}
+
+
+
+/*
+ * Call it from main loop or at init before InitADC().
+ *
+ * @brief	Stops acquisition, lets application retune everything depending on
+ * 			sample rate (adsDataRateCallback) and restarts ADS with new OSR and
+ * 			SPI clock. Rate is limited to ADS_RATE_MAX. With acquisition
+ * 			stopped it's done at once, with running one it's only requested -
+ * 			adsRecoveryWatchdog() does it in steps on the next main loop passes,
+ * 			adsGetDataRate() returns the old rate until then.
+ */
+void adsSetDataRate(enum eAdsRate rate)
+{
+	bool bRunning = System.ads.ready || (adsRecovery.state != ADS_RECOVERY_IDLE);
+
+	if (rate > ADS_RATE_MAX)
+		rate = ADS_RATE_MAX;
+
+	if (bRunning || (adsRateChange.state != ADS_RATE_CHANGE_IDLE))
+	{
+		adsRateChange.rate = rate;
+		if (adsRateChange.state == ADS_RATE_CHANGE_IDLE)
+			adsRateChange.state = ADS_RATE_CHANGE_STOP;
+		else if (adsRateChange.state == ADS_RATE_CHANGE_RESTART)
+			adsRateChange.state = ADS_RATE_CHANGE_RETUNE;	// retuned for the previous request
+		return;
+	}
+
+	adsRateApply(rate);
+}
+
+
+
+static void adsRateApply(enum eAdsRate rate)
+{
+	adsRate = rate;
+	SPAM(("ADS rate: %.0f SPS\n", adsRateTable[rate].sampleRate));
+	adsDataRateCallback(adsRateTable[rate].sampleRate);
+}
+
+
+
+/*
+ * One step of the rate change per call, the longest one is InitADC() (hard
+ * reset pulse 1 ms and register setup).
+ */
+static void adsRateChangeStep(void)
+{
+	switch (adsRateChange.state)
+	{
+	case ADS_RATE_CHANGE_STOP:
+		HAL_NVIC_DisableIRQ(EXTI4_IRQn);
 		System.ads.ready = false;
-		System.ads.error = true;
+		System.ads.error = false;	// full reset follows anyway
+		adsRecovery.state = ADS_RECOVERY_IDLE;
+#ifdef ADS_SPI_USE_DMA_BLOCK
+		adsReadDataBlockStop();
+#endif
+		adsRateChange.stopTick = HAL_GetTick();
+		adsRateChange.state = ADS_RATE_CHANGE_RETUNE;
+		break;
+
+	case ADS_RATE_CHANGE_RETUNE:
+		if (HAL_GetTick() - adsRateChange.stopTick < 2)
+			break;		// let the last frame finish, at least 1 ms
+		adsRateApply(adsRateChange.rate);
+		adsRateChange.state = ADS_RATE_CHANGE_RESTART;
+		break;
+
+	case ADS_RATE_CHANGE_RESTART:
+		adsRateChange.state = ADS_RATE_CHANGE_IDLE;
+		InitADC();
+		break;
+
+	case ADS_RATE_CHANGE_IDLE:
+	default:
+		break;
+	}
+}
+
+
+
+enum eAdsRate adsGetDataRate(void)
+{
+	return adsRate;
+}
+
+
+
+/*
+ * @return	sample rate [Hz] of given setting, actual one for adsGetDataRate()
+ */
+float adsRateToHz(enum eAdsRate rate)
+{
+	if (rate >= ADS_RATE_NUMBER_OF)
+		return 0.0f;
+
+	return adsRateTable[rate].sampleRate;
+}
+
+
+
+/*
+ * SPI is re-initialized only if prescaler changes. Call it with acquisition
+ * stopped.
+ */
+static void adsSpiClockUpdate(void)
+{
+	if (hspi1.Init.BaudRatePrescaler != adsRateTable[adsRate].spiPrescaler)
+	{
+		hspi1.Init.BaudRatePrescaler = adsRateTable[adsRate].spiPrescaler;
+		if (HAL_SPI_Init(&hspi1) != HAL_OK)
+			SPAM(("ADS SPI init error\n"));
+	}
+}
+
+
+
+/*
+ * Call it at startup or when channels change, with acquisition stopped.
+ *
+ * @brief	Enables channels given in mask (bit n - channel n) in CLOCK register
+ * 			and updates the data frame layout.
+ */
+void adsSetChannelMask(uint8_t mask)
+{
+	uint16_t reg = registerMap[CLOCK_ADDRESS] & ~CLOCK_CH_EN_ALL_MASK;
+
+	reg |= ((uint16_t)mask << 8) & CLOCK_CH_EN_ALL_MASK;
+	adsWriteSingleRegister(CLOCK_ADDRESS, reg);
+	adsFrameLayoutUpdate(mask);
+}
+
+
+
+/*
+ * @return	number of bytes clocked out on every DRDY
+ */
+uint32_t adsGetFrameBytes(void)
+{
+	return adsFrame.frameBytes;
+}
+
+
+
+/*
+ * Sets frame length and CRC position for given channel mask, see adsFrame.
+ */
+static void adsFrameLayoutUpdate(uint8_t mask)
+{
+	uint32_t lastChannel = 0;
+
+	for (uint32_t n = 0; n < CHANNEL_COUNT; n++)
+	{
+		if (mask & (1u << n))
+			lastChannel = n + 1;
 	}
+
+	adsFrame.channelMask = mask;
+#ifdef ADS_CHECK_CRC
+	// disabled channels keep their words, CRC is the last one
+	UNUSED(lastChannel);
+	adsFrame.crcIndex = (1 + CHANNEL_COUNT) * bytesPerWord;
+	adsFrame.frameBytes = (2 + CHANNEL_COUNT) * bytesPerWord;
+#else
+	// short frame: CS goes high after the last enabled channel, CRC not read
+	adsFrame.crcIndex = (1 + lastChannel) * bytesPerWord;
+	adsFrame.frameBytes = (1 + lastChannel) * bytesPerWord;
+#endif
+}
+
+
+
+/*
+ * Unpacks one data frame (see adsFrame) and checks its CRC. Words of disabled
+ * channels are skipped and their fields in DataStruct are left unchanged.
+ *
+ * @return	false when a CRC error occurs
+ */
+static _OPT_O3 bool adsParseFrame(const uint8_t frame[], adsChannelData_t *DataStruct)
+{
+	uint16_t crcCalc;
+	UNUSED(crcCalc);
+	const uint32_t mask = adsFrame.channelMask;
+	int32_t words[ADS_FRAME_WORDS];
+
+	// whole frame at once, status and CRC words included - keeps full iterations
+#ifdef WORD_LENGTH_16BIT_TRUNCATED
+	adsUnpack16(frame, words, ADS_FRAME_WORDS);
+#else
+	adsUnpack24(frame, words, ADS_FRAME_WORDS);
+#endif
+
+    DataStruct->response = combineBytes(frame[0], frame[1]);
+
+    if (mask & (1u << 0))
+        DataStruct->channel0 = words[1];
+#if (CHANNEL_COUNT > 1)
+    if (mask & (1u << 1))
+        DataStruct->channel1 = words[2];
+#endif
+#if (CHANNEL_COUNT > 2)
+    if (mask & (1u << 2))
+        DataStruct->channel2 = words[3];
+#endif
+#if (CHANNEL_COUNT > 3)
+    if (mask & (1u << 3))
+        DataStruct->channel3 = words[4];
+#endif
+#if (CHANNEL_COUNT > 4)
+    if (mask & (1u << 4))
+        DataStruct->channel4 = words[5];
+#endif
+#if (CHANNEL_COUNT > 5)
+    if (mask & (1u << 5))
+        DataStruct->channel5 = words[6];
+#endif
+#if (CHANNEL_COUNT > 6)
+    if (mask & (1u << 6))
+        DataStruct->channel6 = words[7];
+#endif
+#if (CHANNEL_COUNT > 7)
+    if (mask & (1u << 7))
+        DataStruct->channel7 = words[8];
+#endif
+
+#ifdef ADS_CHECK_CRC
+    DataStruct->crc = combineBytes(frame[adsFrame.crcIndex], frame[adsFrame.crcIndex + 1]);
+//    crcCalc = adsCalculateCRC(&frame[0], adsFrame.crcIndex, 0xFFFF);
+    crcCalc = adsCalculateCRCfast(&frame[0], adsFrame.crcIndex);
+
+    if (crcCalc != DataStruct->crc)
+    	return false;
+#endif
+
+    return true;
 }
 
 
@@ -869,7 +1730,8 @@ uint16_t adsCalculateCRC(const uint8_t dataBytes[], uint8_t numberBytes, uint16_
 #endif
 
 //#define CRC_ALG_1	/* Algorithm 1 - 15.6 us - from ADS library example */
-#define CRC_ALG_2	/* Algorithm 2 - 4.8 us - from some old MSP430 forum */
+//#define CRC_ALG_2	/* Algorithm 2 - 4.8 us - from some old MSP430 forum */
+#define CRC_ALG_3	/* Algorithm 3 - CRC service: hardware engine or lookup table */
 
 /*
  * Calculates the 16-bit CRC for the selected CRC polynomial.
@@ -918,6 +1780,13 @@ _OPT_O3 uint16_t adsCalculateCRCfast(const uint8_t dataBytes[], uint8_t numberBy
 		crc = (crc << 8) ^ (x << 12) ^ (x <<5) ^ x;
 	}
 	return crc;
+
+#elif defined (CRC_ALG_3)
+	#ifdef CRC_CCITT
+	return crc16ccitt(dataBytes, numberBytes);
+	#else
+	return adsCalculateCRC(dataBytes, numberBytes, 0xFFFF);
+	#endif
 #endif
 }
 
@@ -1090,7 +1959,8 @@ static int32_t signExtend (const uint8_t dataBytes[])
     int32_t upperByte   = ((int32_t) dataBytes[0] << 24);
     int32_t lowerByte   = ((int32_t) dataBytes[1] << 16);
 
-    return (((int32_t) (upperByte | lowerByte)) >> 16);                 // Right-shift of signed data maintains signed bit
+    // scaled to 24 bit LSB like the other modes, calibration coefficients stay valid
+    return (((int32_t) (upperByte | lowerByte)) >> 8);                  // Right-shift of signed data maintains signed bit
 
 #endif
 }
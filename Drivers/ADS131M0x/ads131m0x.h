@@ -60,6 +60,18 @@
 
 
 
+//****************************************************************************
+//
+// Select the channels used by application...
+//
+//****************************************************************************
+
+/* Bit n enables channel n, ADCs of the other channels are powered down in the
+ * CLOCK register and their words are not unpacked. Both boards use Ch0 and Ch1. */
+#define ADS_CHANNEL_MASK    (0x03)
+
+
+
 //****************************************************************************
 //
 // Select the desired MODE register settings...
@@ -67,7 +79,10 @@
 //
 //****************************************************************************
 
-/* Pick one (and only one) mode to use... */
+/* Pick one (and only one) mode to use...
+ * NOTE: 16 bit words are shifted to 24 bit scale by signExtend(), so
+ *       calibration coefficients stay valid. Resolution drops to 256 LSB of
+ *       24 bit mode: ca. 1.5 nA for Ia and 0.2 V for Uc, Ue, Uf. */
 //#define WORD_LENGTH_16BIT_TRUNCATED
 #define WORD_LENGTH_24BIT
 //#define WORD_LENGTH_32BIT_SIGN_EXTEND
@@ -101,6 +116,11 @@
 #error Must define at least one WORD_LENGTH mode
 #endif
 
+// Data read functions use constant word length of 2 or 3 bytes
+#if defined WORD_LENGTH_32BIT_SIGN_EXTEND || defined WORD_LENGTH_32BIT_ZERO_PADDED
+#error 32 bit WORD_LENGTH modes are not supported by data read functions
+#endif
+
 // Throw an error if none or both CRC types are selected
 #if !defined CRC_CCITT && !defined CRC_ANSI
 #error Must define at least one CRC type
@@ -1597,6 +1617,8 @@ typedef struct
 {
     uint16_t response;
     uint16_t crc;
+    uint32_t timestamp;		// DWT->CYCCNT at DRDY interrupt, see adsDrdyTimestamp()
+    uint32_t lost;			// samples lost right before this one (CRC errors, recovery)
     int32_t channel0;
 
 #if (CHANNEL_COUNT > 1)
@@ -1622,15 +1644,124 @@ typedef struct
 #endif
 } adsChannelData_t;
 
+/*
+ * Sample published to consumers. Sequence number is incremented by 2 with every
+ * published sample and it's odd while the record is being written.
+ */
+typedef struct
+{
+	uint32_t seq;
+	adsChannelData_t data;
+} adsSample_t;
+
+/*
+ * Acquisition timing, all times in DWT cycles (80 MHz). Window is restarted by
+ * adsTimingGet().
+ */
+typedef struct
+{
+	uint32_t periods;		// DRDY periods measured in the window
+	uint32_t periodMin;		// between DRDY interrupts
+	uint32_t periodMax;
+	uint64_t periodSum;
+	uint32_t samples;		// samples with latency measured in the window
+	uint32_t latencyMin;	// DRDY interrupt to sample passed to application
+	uint32_t latencyMax;
+	uint64_t latencySum;
+	uint32_t late;			// samples over ADS_LATENCY_BUDGET_US since power on
+	uint32_t lost;			// samples lost since power on
+	uint32_t recoveries;	// faults recovered by sync, flush and re-arm since power on
+	uint32_t resets;		// faults which needed full reset since power on
+} adsTiming_t;
+
 typedef struct
 {
 	bool ready;
 	bool error;
-	adsChannelData_t data;
+	const adsSample_t * volatile sample;	// latest published sample, NULL before the first one
 } adsStatus_t;
 
 
 
+//****************************************************************************
+//
+// Block acquisition (ADS_SPI_USE_DMA_BLOCK)
+//
+//****************************************************************************
+
+/* Frames in the circular DMA buffer. Samples are processed every half of it,
+ * so at 2 kSPS it gives 2 ms of additional latency for 8 frames. Processing
+ * runs in PendSV (lowest priority) and has ADS_BLOCK_HALF sample periods for
+ * a half - 128 us at 31250 SPS. */
+#define ADS_BLOCK_FRAMES	(8)
+#define ADS_BLOCK_HALF		(ADS_BLOCK_FRAMES / 2)
+
+/* Words in one data frame: response, channels, CRC */
+#define ADS_FRAME_WORDS		(CHANNEL_COUNT + 2)
+
+
+
+//****************************************************************************
+//
+// Data rate - selected at runtime by adsSetDataRate()
+//
+//****************************************************************************
+
+/* fDATA = fCLKIN / (2 * OSR), CLKIN 8 MHz in high resolution mode (the low
+ * power modes need lower CLKIN, so they're not used). Names are approximate. */
+enum eAdsRate
+{
+	ADS_RATE_250 = 0,	// OSR 16384, 244 SPS
+	ADS_RATE_500,		// OSR 8192, 488 SPS
+	ADS_RATE_1K,		// OSR 4096, 977 SPS
+	ADS_RATE_2K,		// OSR 2048, 1953 SPS
+	ADS_RATE_4K,		// OSR 1024, 3906 SPS
+	ADS_RATE_8K,		// OSR 512, 7813 SPS
+	ADS_RATE_16K,		// OSR 256, 15625 SPS
+	ADS_RATE_32K,		// OSR 128, 31250 SPS
+	ADS_RATE_NUMBER_OF,
+};
+
+/* The fastest rate the read method keeps up with (frame time + interrupts) */
+#if defined (ADS_SPI_USE_DMA_BLOCK)
+	#define ADS_RATE_MAX		ADS_RATE_32K
+#elif defined (ADS_SPI_USE_INT) || defined (ADS_SPI_USE_DMA)
+	#define ADS_RATE_MAX		ADS_RATE_8K
+#else
+	#define ADS_RATE_MAX		ADS_RATE_2K		// 100 us blocking read in DRDY interrupt
+#endif
+
+#if defined (ADS_SPI_USE_INT) || defined (ADS_SPI_USE_DMA)
+	#define ADS_RATE_DEFAULT	ADS_RATE_2K
+#else
+	#define ADS_RATE_DEFAULT	ADS_RATE_250
+#endif
+
+/* Samples passed to application later than this after DRDY are counted as
+ * late (adsTiming_t). Block mode adds up to ADS_BLOCK_HALF sample periods by
+ * design - 2 ms at 2 kSPS. */
+#define ADS_LATENCY_BUDGET_US	(2500)
+
+
+
+//****************************************************************************
+//
+// Fault recovery - see adsRecoveryStart()
+//
+//****************************************************************************
+
+/* Fast recoveries in a row (without ADS_RECOVERY_GOOD_SAMPLES in between)
+ * before full reset by InitADC() from main loop. */
+#define ADS_RECOVERY_ATTEMPTS		(3)
+#define ADS_RECOVERY_GOOD_SAMPLES	(16)
+/* Frames with CRC error in a row, which start recovery */
+#define ADS_RECOVERY_CRC_ERRORS		(3)
+/* No DRDY for this time during recovery also ends with full reset. Sync,
+ * filter settling and two more edges take ca. 25 ms at 250 SPS. */
+#define ADS_RECOVERY_TIMEOUT_MS		(100)
+
+
+
 //******************************************************************************
 //
 // Function prototypes
@@ -1640,10 +1771,28 @@ typedef struct
 void        adsStartup(void);
 uint16_t    adsSendCommand(uint16_t op_code);
 bool        adsReadData(adsChannelData_t *);
-bool		adsReadDataOptimized(adsChannelData_t *);
+const adsSample_t* adsReadDataOptimized(void);
 void		adsReadDataIT(void);
-bool 		adsReadDataITcallback(adsChannelData_t *);
+const adsSample_t* adsReadDataITcallback(void);
+bool		adsSampleRead(adsSample_t *copy);
 void 		adsReadDataDMA(void);
+void		adsSetChannelMask(uint8_t mask);
+uint32_t	adsGetFrameBytes(void);
+void		adsReadDataBlockStart(void);
+void		adsReadDataBlockStop(void);
+void		adsReadDataBlockDMA(void);
+void		adsReadDataBlockIRQHandler(void);
+void		adsReadDataBlockProcess(void);
+void		adsReadDataBlockCallback(const adsChannelData_t data[], uint32_t count, uint32_t crcErrors);
+void		adsSetDataRate(enum eAdsRate rate);
+enum eAdsRate adsGetDataRate(void);
+float		adsRateToHz(enum eAdsRate rate);
+void		adsDataRateCallback(float sampleRate);
+void		adsDrdyTimestamp(void);
+void		adsTimingGet(adsTiming_t *copy);
+void		adsRecoveryStart(void);
+void		adsRecoveryStep(void);
+void		adsRecoveryWatchdog(void);
 uint16_t    adsReadSingleRegister(uint8_t address);
 void        adsWriteSingleRegister(uint8_t address, uint16_t data);
 bool        adsLockRegisters(void);
@@ -0,0 +1,102 @@
+/*
+ * ads_unpack.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <string.h>
+#include "ads_unpack.h"
+#include "main.h"	// for _OPT definition
+
+/* Private functions ---------------------------------------------------------*/
+
+/*
+ * Unaligned little-endian word load, compiles to single LDR on Cortex-M4.
+ */
+static inline uint32_t loadWord(const uint8_t *src)
+{
+	uint32_t word;
+
+	memcpy(&word, src, sizeof(word));
+	return word;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+_OPT_O3 void adsUnpack24(const uint8_t *src, int32_t *dst, uint32_t count)
+{
+	uint32_t r0, r1, r2;
+
+	/*
+	 * bytes:  b0 b1 b2 | b3 b4 b5 | b6 b7 b8 | b9 b10 b11
+	 * r0 = b0 b1 b2 b3, r1 = b4 b5 b6 b7, r2 = b8 b9 b10 b11 (MSB first)
+	 * Every word is moved to the upper 24 bits and arithmetic shift right
+	 * extends the sign. Halves are merged by barrel shifter.
+	 */
+	for (; count >= 4; count -= 4)
+	{
+		r0 = __REV(loadWord(&src[0]));
+		r1 = __REV(loadWord(&src[4]));
+		r2 = __REV(loadWord(&src[8]));
+
+		dst[0] = (int32_t)r0 >> 8;
+		dst[1] = (int32_t)((r0 << 24) | (r1 >> 8)) >> 8;
+		dst[2] = (int32_t)((r1 << 16) | (r2 >> 16)) >> 8;
+		dst[3] = (int32_t)(r2 << 8) >> 8;
+
+		src += 12;
+		dst += 4;
+	}
+
+	adsUnpack24Ref(src, dst, count);
+}
+
+
+
+void adsUnpack24Ref(const uint8_t *src, int32_t *dst, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t word = ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8);
+
+		dst[i] = (int32_t)word >> 8;	// Right-shift of signed data maintains signed bit
+		src += 3;
+	}
+}
+
+
+
+_OPT_O3 void adsUnpack16(const uint8_t *src, int32_t *dst, uint32_t count)
+{
+	uint32_t r0;
+
+	// r0 = b0 b1 b2 b3: upper half is the first word, lower half the second one
+	for (; count >= 2; count -= 2)
+	{
+		r0 = __REV(loadWord(&src[0]));
+
+		dst[0] = (int32_t)(r0 & 0xFFFF0000u) >> 8;
+		dst[1] = (int32_t)(r0 << 16) >> 8;
+
+		src += 4;
+		dst += 2;
+	}
+
+	adsUnpack16Ref(src, dst, count);
+}
+
+
+
+void adsUnpack16Ref(const uint8_t *src, int32_t *dst, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t word = ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16);
+
+		dst[i] = (int32_t)word >> 8;	// scaled to 24 bit LSB
+		src += 2;
+	}
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
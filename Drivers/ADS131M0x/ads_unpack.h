@@ -0,0 +1,69 @@
+/*
+ * ads_unpack.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Unpacking of ADS data words (big-endian, two's complement) into int32.
+ * Module doesn't depend on HAL, so it compiles on host too - reference and fast
+ * kernels have the same API and must give identical results for any input.
+ */
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * Can be called from interrupts, no state.
+ *
+ * @brief	Unpacks count of 24 bit words from src (3*count bytes) into dst.
+ * 			Four words (12 bytes) are converted per iteration: three word loads,
+ * 			byte reverse (REV) and shifts, no byte accesses. Rest is done by
+ * 			the reference code.
+ *
+ * @note	src doesn't need to be aligned (Cortex-M4 handles unaligned LDR).
+ */
+void adsUnpack24(const uint8_t *src, int32_t *dst, uint32_t count);
+
+
+
+/*
+ * @brief	Reference for adsUnpack24(), byte by byte - the same as signExtend()
+ * 			of the ADS driver.
+ */
+void adsUnpack24Ref(const uint8_t *src, int32_t *dst, uint32_t count);
+
+
+
+/*
+ * Can be called from interrupts, no state.
+ *
+ * @brief	Unpacks count of 16 bit words (WORD_LENGTH_16BIT_TRUNCATED) from src
+ * 			(2*count bytes) into dst. Result is scaled to 24 bit LSB like in
+ * 			the other modes, so calibration coefficients stay valid. Two words
+ * 			are converted per one word load.
+ */
+void adsUnpack16(const uint8_t *src, int32_t *dst, uint32_t count);
+
+
+
+/*
+ * @brief	Reference for adsUnpack16(), byte by byte.
+ */
+void adsUnpack16Ref(const uint8_t *src, int32_t *dst, uint32_t count);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
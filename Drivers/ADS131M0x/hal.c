@@ -63,12 +63,21 @@ void InitADC(void)
     HAL_GPIO_WritePinHigh(nSYNC_nRESET_PORT, nSYNC_nRESET_PIN);
     HAL_GPIO_WritePinHigh(nCS_PORT, nCS_PIN);
 
+#ifdef ADS_SPI_USE_DMA_BLOCK
+    // Give SPI back to blocking mode for register access
+    adsReadDataBlockStop();
+#endif
+
     // Initialize SPI peripheral used by ADS131M0x
     HAL_SPIEx_FlushRxFifo(&hspi1);
 
     // Run ADC startup function
     adsStartup();
 
+#ifdef ADS_SPI_USE_DMA_BLOCK
+    adsReadDataBlockStart();
+#endif
+
     HAL_NVIC_EnableIRQ(EXTI4_IRQn);
     System.ads.ready = true;
     System.ads.error = false;
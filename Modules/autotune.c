@@ -0,0 +1,220 @@
+/*
+ * autotune.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <math.h>
+#include <string.h>
+#include "autotune.h"
+#include "main.h"	// for _OPT definition
+
+#define PI_F	(3.14159265f)
+
+/* Private variables ---------------------------------------------------------*/
+
+static const char* const ruleNames[TUNE_RULES_NUMBER_OF] =
+{
+	[TUNE_ZN_PI]		= "ZN PI",
+	[TUNE_TL_PI]		= "TL PI",
+	[TUNE_ZN_PID]		= "ZN PID",
+	[TUNE_NO_OVERSHOOT]	= "NO OVS",
+};
+
+/* Exported functions --------------------------------------------------------*/
+
+void oscInit(oscDetector_t *osc, float hysteresis, uint32_t cycles)
+{
+	memset(osc, 0, sizeof(oscDetector_t));
+	osc->hysteresis = hysteresis;
+	osc->cycles = (cycles > 0) ? cycles : 1;
+}
+
+
+
+_OPT_O3 bool oscAddSample(oscDetector_t *osc, float value, float time)
+{
+	if (!osc->bStarted)
+	{
+		osc->bStarted = true;
+		osc->extreme = value;
+		osc->extremeTime = time;
+		return false;
+	}
+
+	if (osc->bRising)
+	{
+		if (value > osc->extreme)
+		{
+			osc->extreme = value;
+			osc->extremeTime = time;
+		}
+		else if (value < osc->extreme - osc->hysteresis)
+		{	// peak confirmed, track valley
+			osc->lastPeak = osc->extreme;
+			osc->bPeak = true;
+			osc->bRising = false;
+			osc->extreme = value;
+			osc->extremeTime = time;
+		}
+		return false;
+	}
+
+	if (value < osc->extreme)
+	{
+		osc->extreme = value;
+		osc->extremeTime = time;
+		return false;
+	}
+	if (value <= osc->extreme + osc->hysteresis)
+		return false;
+
+	// valley confirmed, track peak
+	if (osc->valleys == 0)
+	{
+		osc->firstValleyTime = osc->extremeTime;
+		osc->p2pSum = 0.0f;
+		osc->p2pCount = 0;
+	}
+	else if (osc->bPeak)
+	{
+		osc->p2pSum += osc->lastPeak - osc->extreme;
+		osc->p2pCount++;
+	}
+	osc->valleys++;
+	osc->bRising = true;
+
+	float valleyTime = osc->extremeTime;
+	osc->extreme = value;
+	osc->extremeTime = time;
+
+	if (osc->valleys <= osc->cycles)
+		return false;
+
+	// mean period from the first to the last valley, so sampling jitter of
+	// single valleys is divided by number of cycles
+	osc->period = (valleyTime - osc->firstValleyTime) / (float)osc->cycles;
+	osc->amplitude = (osc->p2pCount > 0) ? 0.5f * osc->p2pSum / (float)osc->p2pCount : 0.0f;
+	// the last valley starts the next measurement
+	osc->valleys = 1;
+	osc->firstValleyTime = valleyTime;
+	osc->p2pSum = 0.0f;
+	osc->p2pCount = 0;
+	return true;
+}
+
+
+
+void autotuneStart(autotune_t *at, float bias, float d, float hysteresis,
+			float outMin, float outMax, bool bReverse,
+			float dt, float errorMax, float timeout)
+{
+	at->state = AUTOTUNE_IDLE;
+
+	at->bias = bias;
+	at->high = fminf(bias + d, outMax);
+	at->low = fmaxf(bias - d, outMin);
+	at->hysteresis = hysteresis;
+	at->bReverse = bReverse;
+	at->bHigh = true;
+	at->dt = dt;
+	at->time = 0.0f;
+	at->timeout = timeout;
+	at->errorMax = errorMax;
+	at->cycles = 0;
+	at->ku = 0.0f;
+	at->tu = 0.0f;
+	oscInit(&at->osc, hysteresis, AUTOTUNE_SETTLE_CYCLES);
+
+	at->state = (at->high > at->low) ? AUTOTUNE_RELAY : AUTOTUNE_FAILED;
+}
+
+
+
+_OPT_O3 float autotuneStep(autotune_t *at, float error)
+{
+	if (at->state != AUTOTUNE_RELAY)
+		return at->bias;
+
+	at->time += at->dt;
+	if ((fabsf(error) > at->errorMax) || (at->time > at->timeout))
+	{
+		at->state = AUTOTUNE_FAILED;
+		return at->bias;
+	}
+
+	// input below setpoint - drive it up (down if reverse)
+	if (error > at->hysteresis)
+		at->bHigh = !at->bReverse;
+	else if (error < -at->hysteresis)
+		at->bHigh = at->bReverse;
+
+	if (oscAddSample(&at->osc, error, at->time))
+	{
+		if (at->osc.cycles == AUTOTUNE_SETTLE_CYCLES)
+		{	// limit cycle settled, measure it now
+			oscInit(&at->osc, at->hysteresis, AUTOTUNE_CYCLES);
+		}
+		else
+		{
+			float a = at->osc.amplitude;
+			float d = 0.5f * (at->high - at->low);
+
+			if (a > at->hysteresis)
+			{
+				at->ku = 4.0f * d / (PI_F * sqrtf(a * a - at->hysteresis * at->hysteresis));
+				at->tu = at->osc.period;
+				at->state = AUTOTUNE_DONE;
+			}
+			else
+				at->state = AUTOTUNE_FAILED;
+			return at->bias;
+		}
+	}
+	if (at->osc.cycles == AUTOTUNE_CYCLES)
+		at->cycles = (at->osc.valleys > 0) ? at->osc.valleys - 1 : 0;
+
+	return at->bHigh ? at->high : at->low;
+}
+
+
+
+void autotuneGains(enum eTuneRule rule, float ku, float tu, float *kp, float *ki, float *kd)
+{
+	switch (rule)
+	{
+	case TUNE_TL_PI:
+		*kp = ku / 3.2f;
+		*ki = *kp / (2.2f * tu);
+		*kd = 0.0f;
+		break;
+	case TUNE_ZN_PID:
+		*kp = 0.6f * ku;
+		*ki = 1.2f * ku / tu;
+		*kd = 0.075f * ku * tu;
+		break;
+	case TUNE_NO_OVERSHOOT:
+		*kp = 0.2f * ku;
+		*ki = 0.4f * ku / tu;
+		*kd = 0.0667f * ku * tu;
+		break;
+	case TUNE_ZN_PI:
+	default:
+		*kp = 0.45f * ku;
+		*ki = 0.54f * ku / tu;
+		*kd = 0.0f;
+		break;
+	}
+}
+
+
+
+const char* autotuneRuleName(enum eTuneRule rule)
+{
+	if (rule >= TUNE_RULES_NUMBER_OF)
+		return "?";
+	return ruleNames[rule];
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
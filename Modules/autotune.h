@@ -0,0 +1,165 @@
+/*
+ * autotune.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Relay feedback auto-tuning (Astrom-Hagglund). The loop output is switched
+ * between bias + d and bias - d by sign of the error (with hysteresis eps),
+ * which makes the plant oscillate at its ultimate period Tu. With oscillation
+ * amplitude a of the input, describing function of the relay gives ultimate
+ * gain:
+ *
+ *  Ku = 4 * d / (pi * sqrt(a^2 - eps^2))
+ *
+ * PID gains then follow from Ku, Tu by a tuning rule (enum eTuneRule) - the
+ * same way as hand-run Ziegler-Nichols notes in regulator.c, without pushing
+ * the loop to the stability limit.
+ *
+ * Period and amplitude are measured by oscillation detector, which is also
+ * used alone for manual tuning (pidMeasOscPeriod()). It confirms peaks and
+ * valleys once the signal turns back by more than its hysteresis, so it
+ * doesn't depend on DC level and noise below hysteresis doesn't count.
+ *
+ * Module doesn't depend on HAL, so it compiles on host too.
+ */
+
+/* Config --------------------------------------------------------------------*/
+
+#define AUTOTUNE_SETTLE_CYCLES	2		// skipped, till the limit cycle settles
+#define AUTOTUNE_CYCLES			6		// measured
+
+/* Exported types ------------------------------------------------------------*/
+
+enum eTuneRule
+{
+	TUNE_ZN_PI = 0,		// Ziegler-Nichols PI, as in regulator.c notes
+	TUNE_TL_PI,			// Tyreus-Luyben PI, less overshoot, slower
+	TUNE_ZN_PID,		// Ziegler-Nichols classic PID
+	TUNE_NO_OVERSHOOT,	// PID with no overshoot
+	TUNE_RULES_NUMBER_OF,
+};
+
+enum eAutotuneState
+{
+	AUTOTUNE_IDLE = 0,
+	AUTOTUNE_RELAY,		// relay running
+	AUTOTUNE_DONE,		// Ku and Tu known
+	AUTOTUNE_FAILED,	// error over limit or timeout
+};
+
+typedef struct
+{
+	float hysteresis;
+	uint32_t cycles;			// per measurement
+	// peak or valley being tracked
+	bool bStarted;
+	bool bRising;
+	float extreme;
+	float extremeTime;
+	bool bPeak;					// lastPeak is valid
+	float lastPeak;
+	// valleys of the measurement
+	uint32_t valleys;
+	float firstValleyTime;
+	float p2pSum;
+	uint32_t p2pCount;
+	// the last complete measurement
+	float period;				// [s]
+	float amplitude;			// half of peak-to-peak
+} oscDetector_t;
+
+typedef struct
+{
+	volatile enum eAutotuneState state;
+	float bias;
+	float high, low;			// relay outputs, bias +- d within limits
+	float hysteresis;			// eps
+	bool bReverse;				// output decreases input
+	bool bHigh;
+	float dt;					// [s] step period
+	float time;
+	float timeout;
+	float errorMax;
+	uint32_t cycles;			// measured cycles, for UI
+	oscDetector_t osc;
+	float ku;					// result, [output/input]
+	float tu;					// [s]
+} autotune_t;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * @brief	Clears detector. It measures mean period and amplitude over given
+ * 			number of cycles, again and again.
+ */
+void oscInit(oscDetector_t *osc, float hysteresis, uint32_t cycles);
+
+
+
+/*
+ * Can be called from interrupts, constant time.
+ *
+ * @brief	Adds sample of given time [s].
+ *
+ * @return	true if measurement is complete, see osc->period and amplitude
+ */
+bool oscAddSample(oscDetector_t *osc, float value, float time);
+
+
+
+/*
+ * Call it with the loop output held, then call autotuneStep() instead of PID
+ * on every period dt.
+ *
+ * @brief	Starts relay with output bias +- d, limited to outMin - outMax. It
+ * 			fails if error exceeds errorMax or oscillation isn't measured
+ * 			within timeout [s].
+ */
+void autotuneStart(autotune_t *at, float bias, float d, float hysteresis,
+			float outMin, float outMax, bool bReverse,
+			float dt, float errorMax, float timeout);
+
+
+
+/*
+ * Can be called from interrupts, constant time.
+ *
+ * @brief	One relay step for error = setpoint - input.
+ *
+ * @return	loop output, bias once the relay isn't running
+ */
+float autotuneStep(autotune_t *at, float error);
+
+
+
+/*
+ * @brief	Calculates PID gains from Ku and Tu by given rule.
+ */
+void autotuneGains(enum eTuneRule rule, float ku, float tu, float *kp, float *ki, float *kd);
+
+
+
+/*
+ * @return	short name of the rule for UI
+ */
+const char* autotuneRuleName(enum eTuneRule rule);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
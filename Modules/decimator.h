@@ -0,0 +1,132 @@
+/*
+ * decimator.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Two stage decimation of ADS samples down to the regulator rate:
+ *
+ *  ADS rate --[CIC, order 3, ratio R]--> DECIM_MID_RATE --[FIR]--> regulator
+ *
+ * CIC runs on raw int32 codes in blocks (integrators at ADS rate, combs at
+ * DECIM_MID_RATE) and doesn't need any multiplication. ADS rates are powers
+ * of 2 times the lowest one, so R is a power of 2 and CIC gain R^3 is removed
+ * by shift. FIR is a low pass which rejects everything above 50 Hz by more
+ * than 40 dB - regulator reads it at 100 Hz (PID_PERIOD), so that would alias
+ * into its band. Passband is flat within 0.5 dB up to 5 Hz (-1.1 dB at 10 Hz).
+ * It is evaluated only when the regulator asks for output (decimOutput()), so
+ * there is exactly one output per regulator period, whatever ADS rate is.
+ * Below DECIM_MID_RATE CIC is bypassed and FIR runs at the input rate, so at
+ * 250 SPS its band is halved and delay doubled (41 ms).
+ *
+ * Module doesn't depend on HAL, so it compiles on host too.
+ */
+
+/* Config --------------------------------------------------------------------*/
+
+#define DECIM_CIC_ORDER		(3)
+#define DECIM_FIR_TAPS		(21)
+#define DECIM_MID_RATE		(488.28125f)	// [Hz] CIC output, ADS rate 2 kSPS / 4
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+	// CIC: unsigned, so integrators wrap around without UB - result is exact
+	// anyway as long as it fits in 64 bits (24 bit + 3 * log2(R))
+	uint64_t integ[DECIM_CIC_ORDER];
+	uint64_t comb[DECIM_CIC_ORDER];	// previous comb inputs (differential delay 1)
+	uint32_t ratio;				// CIC decimation, power of 2
+	uint32_t shift;				// gain normalization, R^ORDER = 1 << shift
+	uint32_t phase;				// input samples since the last CIC output
+	// FIR: CIC outputs, every one written twice, so the taps always see
+	// contiguous history starting at index
+	float history[2 * DECIM_FIR_TAPS];
+	uint32_t index;
+	uint32_t fill;				// CIC outputs in history, up to DECIM_FIR_TAPS
+	bool bRefill;				// set by decimGap(), next output fills history
+} decimator_t;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * Call it at init and when input rate changes, with samples stopped.
+ *
+ * @brief	Clears the filter and sets CIC ratio - rounded down to power of 2
+ * 			and at least 1 (CIC bypassed). Use decimRatio() to get it.
+ */
+void decimInit(decimator_t *d, uint32_t ratio);
+
+
+
+/*
+ * @return	CIC ratio for given input rate [Hz], see DECIM_MID_RATE
+ */
+uint32_t decimRatio(float inputRate);
+
+
+
+/*
+ * Call it from ADS interrupt, on every sample or block of them.
+ *
+ * @brief	Runs CIC on count raw samples (ca. 10 cycles per sample) and puts
+ * 			every R-th result into FIR history.
+ */
+void decimProcessBlock(decimator_t *d, const int32_t src[], uint32_t count);
+
+
+
+/*
+ * Call it from interrupt of the same priority as decimProcessBlock() (the
+ * regulator tick), or with ADS interrupts disabled. When decimProcessBlock()
+ * runs at lower priority (ADS block processing in PendSV), it has to be called
+ * with interrupts disabled itself.
+ *
+ * @brief	Calculates FIR on the latest history (21 MAC).
+ *
+ * @return	false until history is filled after decimInit()
+ */
+bool decimOutput(const decimator_t *d, float *out);
+
+
+
+/*
+ * Call it before samples which follow a gap (lost samples).
+ *
+ * @brief	Gaps shorter than one CIC period just shift the time a bit. Longer
+ * 			ones make FIR history stale, so it's filled with the next output.
+ */
+void decimGap(decimator_t *d, uint32_t lost);
+
+
+
+/*
+ * @return	group delay [s] of the whole chain at given input rate
+ */
+float decimGroupDelay(float inputRate);
+
+
+
+/*
+ * @return	magnitude of the chain frequency response at f [Hz]
+ */
+float decimResponse(float inputRate, float f);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
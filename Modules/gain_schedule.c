@@ -0,0 +1,82 @@
+/*
+ * gain_schedule.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include "gain_schedule.h"
+#include "main.h"	// for _OPT definition
+
+/* Private functions ---------------------------------------------------------*/
+
+/*
+ * Finds segment of the axis with x and position in it (0 .. 1, held at ends).
+ */
+static inline uint32_t axisFind(const float axis[], uint32_t size, float x, float *frac)
+{
+	uint32_t i = 0;
+
+	*frac = 0.0f;
+	if (size < 2)
+		return 0;
+
+	while ((i < size - 2) && (x > axis[i + 1]))
+		i++;
+
+	if (x <= axis[i])
+		*frac = 0.0f;
+	else if (x >= axis[i + 1])
+		*frac = 1.0f;
+	else
+		*frac = (x - axis[i]) / (axis[i + 1] - axis[i]);
+
+	return i;
+}
+
+
+
+static inline uint32_t axisNearest(const float axis[], uint32_t size, float x)
+{
+	float frac;
+	uint32_t i = axisFind(axis, size, x, &frac);
+
+	return ((size > 1) && (frac > 0.5f)) ? (i + 1) : i;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+_OPT_O3 void gschedEval(const gschedTable_t *table, float setpoint, float load, gschedGains_t *gains)
+{
+	float fs, fl;
+	uint32_t s = axisFind(table->setpoint, table->setpoints, setpoint, &fs);
+	uint32_t l = axisFind(table->load, table->loads, load, &fl);
+	uint32_t s1 = (table->setpoints > 1) ? (s + 1) : s;
+	uint32_t l1 = (table->loads > 1) ? (l + 1) : l;
+	const gschedGains_t *g00 = &table->gains[s][l];
+	const gschedGains_t *g01 = &table->gains[s][l1];
+	const gschedGains_t *g10 = &table->gains[s1][l];
+	const gschedGains_t *g11 = &table->gains[s1][l1];
+	float w00 = (1.0f - fs) * (1.0f - fl);
+	float w01 = (1.0f - fs) * fl;
+	float w10 = fs * (1.0f - fl);
+	float w11 = fs * fl;
+
+	gains->kp = w00 * g00->kp + w01 * g01->kp + w10 * g10->kp + w11 * g11->kp;
+	gains->ki = w00 * g00->ki + w01 * g01->ki + w10 * g10->ki + w11 * g11->ki;
+	gains->kd = w00 * g00->kd + w01 * g01->kd + w10 * g10->kd + w11 * g11->kd;
+}
+
+
+
+bool gschedEntrySet(gschedTable_t *table, float setpoint, float load, const gschedGains_t *gains)
+{
+	if ((gains->kp < 0.0f) || (gains->ki < 0.0f) || (gains->kd < 0.0f))
+		return false;
+
+	table->gains[axisNearest(table->setpoint, table->setpoints, setpoint)]
+				[axisNearest(table->load, table->loads, load)] = *gains;
+	return true;
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
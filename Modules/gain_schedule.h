@@ -0,0 +1,86 @@
+/*
+ * gain_schedule.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Gain scheduling of PID loops. Ultimate gain of the multipliers depends on
+ * load and output voltage (see tuning notes in regulator.c), so one tuning is
+ * either slow unloaded or oscillates loaded. Every loop gets a small table of
+ * tunings on a grid of setpoint magnitude x load, interpolated bilinearly at
+ * the actual operating point:
+ *
+ *            load[0]   load[1]  ...
+ *  sp[0]     gains     gains
+ *  sp[1]     gains     gains
+ *
+ * Outside of the grid gains are held at its edge. Axis of size 1 makes the
+ * table constant in that direction, 1x1 table is a fixed tuning.
+ *
+ * Regulator schedules only Uc on a 2x2 grid: unloaded and loaded tunings along
+ * load, the same at both setpoints until auto-tuning results are accepted.
+ * Ue, Uf and Ia have 1x1 tables - no scheduling, gschedEval() returns their
+ * fixed gains and accepted tuning replaces them.
+ * Load is conductance [S] (Ia / Uc), so unloaded output is 0, not infinity.
+ *
+ * Module doesn't depend on HAL, so it compiles on host too.
+ */
+
+/* Config --------------------------------------------------------------------*/
+
+#define GSCHED_AXIS_MAX		(4)
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+	float kp, ki, kd;
+} gschedGains_t;
+
+typedef struct
+{
+	uint32_t setpoints;							// used of setpoint[], 1 .. GSCHED_AXIS_MAX
+	uint32_t loads;								// used of load[]
+	float setpoint[GSCHED_AXIS_MAX];			// |setpoint|, ascending
+	float load[GSCHED_AXIS_MAX];				// [S], ascending
+	gschedGains_t gains[GSCHED_AXIS_MAX][GSCHED_AXIS_MAX];	// [setpoint][load]
+} gschedTable_t;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * Can be called from interrupts, ca. 1 us.
+ *
+ * @brief	Interpolates gains at setpoint magnitude and load (bilinear, held at
+ * 			edges of the grid).
+ */
+void gschedEval(const gschedTable_t *table, float setpoint, float load, gschedGains_t *gains);
+
+
+
+/*
+ * @brief	Replaces gains of the grid entry nearest to setpoint and load, e.g.
+ * 			by auto-tuning result at that operating point.
+ *
+ * @return	false if gains are negative
+ */
+bool gschedEntrySet(gschedTable_t *table, float setpoint, float load, const gschedGains_t *gains);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,104 @@
+/*
+ * lut.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <math.h>
+#include "lut.h"
+#include "main.h"	// for _OPT definition
+
+/* Private functions ---------------------------------------------------------*/
+
+/*
+ * Value of the table at x, end segments extrapolated. Double, as it runs only
+ * at compile time.
+ */
+static double lutPwl(const lutTable_t *table, int64_t x)
+{
+	uint32_t j = 0;
+
+	// segment j .. j+1 containing x, the first or the last one outside
+	while ((j + 2 < table->count) && (x >= table->point[j + 1].x))
+		j++;
+
+	const lutPoint_t *p0 = &table->point[j];
+	const lutPoint_t *p1 = &table->point[j + 1];
+
+	return (double)p0->y + ((double)p1->y - (double)p0->y) * (double)(x - p0->x) / (double)((int64_t)p1->x - p0->x);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+bool lutCompile(lut_t *lut, const lutTable_t *table, int32_t xMin, uint32_t log2Range)
+{
+	double y[LUT_SEGMENTS + 1];
+	double maxAbs = 0.0;
+	uint32_t shift;
+
+	if ((table->count < 2) || (table->count > LUT_POINTS_MAX))
+		return false;
+	if ((log2Range < LUT_SEGMENTS_LOG2) || (log2Range > 31))
+		return false;
+	if ((int64_t)xMin + ((int64_t)1 << log2Range) - 1 > INT32_MAX)
+		return false;
+	for (uint32_t j = 1; j < table->count; j++)
+	{
+		if (table->point[j].x <= table->point[j - 1].x)
+			return false;
+	}
+
+	shift = log2Range - LUT_SEGMENTS_LOG2;
+	for (uint32_t i = 0; i <= LUT_SEGMENTS; i++)
+	{
+		y[i] = lutPwl(table, (int64_t)xMin + ((int64_t)i << shift));
+		if (fabs(y[i]) > maxAbs)
+			maxAbs = fabs(y[i]);
+	}
+
+	// full scale is 2^30, so differences of neighbours fit in int32 too
+	lut->scale = (maxAbs > 0.0) ? (float)(maxAbs / (double)(1u << 30)) : 1.0f;
+	for (uint32_t i = 0; i <= LUT_SEGMENTS; i++)
+		lut->q[i] = (int32_t)lround(y[i] / (double)lut->scale);
+
+	lut->xMin = xMin;
+	lut->xMax = (int32_t)((int64_t)xMin + ((int64_t)1 << log2Range) - 1);
+	lut->shift = shift;
+	return true;
+}
+
+
+
+void lutLinear(lutTable_t *table, float gain, int32_t xMin, uint32_t log2Range)
+{
+	int32_t xMax = (int32_t)((int64_t)xMin + ((int64_t)1 << log2Range) - 1);
+
+	table->count = 2;
+	table->point[0].x = xMin;
+	table->point[0].y = gain * (float)xMin;
+	table->point[1].x = xMax;
+	table->point[1].y = gain * (float)xMax;
+}
+
+
+
+_OPT_O3 float lutEval(const lut_t *lut, int32_t x)
+{
+	uint32_t d, i, frac;
+	int32_t q;
+
+	if (x < lut->xMin)
+		x = lut->xMin;
+	else if (x > lut->xMax)
+		x = lut->xMax;
+
+	d = (uint32_t)x - (uint32_t)lut->xMin;
+	i = d >> lut->shift;
+	frac = d & ((1u << lut->shift) - 1u);
+
+	q = lut->q[i] + (int32_t)((((int64_t)lut->q[i + 1] - lut->q[i]) * frac) >> lut->shift);
+	return lut->scale * (float)q;
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
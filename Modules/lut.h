@@ -0,0 +1,99 @@
+/*
+ * lut.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Piecewise linear calibration: table of points (input, value) is compiled
+ * into uniformly spaced fixed-point lookup table. Evaluation is then one shift
+ * for the index, one integer interpolation and one multiplication by the table
+ * scale - no float division, constant time.
+ *
+ * Input is an integer (ADS code, mV), table covers 2^log2Range of it from xMin.
+ * Outside of the table points values are extrapolated with the end segments,
+ * outside of the range they're clamped. Breakpoints which are not on the grid
+ * (multiples of 2^(log2Range - LUT_SEGMENTS_LOG2)) are rounded off within one
+ * grid segment.
+ *
+ * Module doesn't depend on HAL, so it compiles on host too.
+ */
+
+/* Config --------------------------------------------------------------------*/
+
+#define LUT_POINTS_MAX		(8)
+#define LUT_SEGMENTS_LOG2	(8)		// 256 segments, 1 kB per table
+#define LUT_SEGMENTS		(1u << LUT_SEGMENTS_LOG2)
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+	int32_t x;		// input, ascending
+	float y;		// value
+} lutPoint_t;
+
+/*
+ * Calibration table as stored in flash.
+ */
+typedef struct
+{
+	uint32_t count;		// points used, less than 2 - table not set
+	lutPoint_t point[LUT_POINTS_MAX];
+} lutTable_t;
+
+typedef struct
+{
+	int32_t xMin;
+	int32_t xMax;				// the last valid input
+	uint32_t shift;				// segment width 2^shift
+	float scale;				// value = scale * q
+	int32_t q[LUT_SEGMENTS + 1];
+} lut_t;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * Call it at init, or compile into other lut_t and copy it with interrupts
+ * disabled.
+ *
+ * @brief	Compiles table of at least 2 points into lut, for inputs from xMin
+ * 			to xMin + 2^log2Range - 1 (log2Range from LUT_SEGMENTS_LOG2 to 31).
+ *
+ * @return	false if points aren't ascending, there's less than 2 of them or
+ * 			range is wrong - lut isn't changed then
+ */
+bool lutCompile(lut_t *lut, const lutTable_t *table, int32_t xMin, uint32_t log2Range);
+
+
+
+/*
+ * @brief	Fills table with the linear model value = gain * x, as two points at
+ * 			ends of given range.
+ */
+void lutLinear(lutTable_t *table, float gain, int32_t xMin, uint32_t log2Range);
+
+
+
+/*
+ * Can be called from interrupts, constant time.
+ */
+float lutEval(const lut_t *lut, int32_t x);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
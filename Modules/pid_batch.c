@@ -0,0 +1,140 @@
+/*
+ * pid_batch.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <string.h>
+#include "main.h"	// for _OPT definition
+#include "pid_batch.h"
+
+#define CONSTRAIN(x,lower,upper)    ((x)<(lower)?(lower):((x)>(upper)?(upper):(x)))
+
+/* Exported functions --------------------------------------------------------*/
+
+void pidBatchInit(pidBatch_t *b, const uint8_t order[], uint32_t count)
+{
+	memset(b, 0, sizeof(pidBatch_t));
+
+	if (count > PIDB_LOOPS_MAX)
+		count = PIDB_LOOPS_MAX;
+	for (uint32_t k = 0; k < count; k++)
+		b->order[k] = order[k];
+	b->count = count;
+}
+
+
+
+void pidBatchLoad(pidBatch_t *b, uint32_t loop, const PIDControl *pid)
+{
+	b->input[loop] = pid->input;
+	b->setpoint[loop] = pid->setpoint;
+	b->output[loop] = pid->output;
+	b->lastInput[loop] = pid->lastInput;
+	b->iTerm[loop] = pid->iTerm;
+	b->dTerm[loop] = pid->dTerm;
+	if (pid->mode == AUTOMATIC)
+		b->active |= (1u << loop);
+	else
+		b->active &= ~(1u << loop);
+
+	pidBatchConfigLoad(b, loop, pid);
+}
+
+
+
+void pidBatchConfigLoad(pidBatch_t *b, uint32_t loop, const PIDControl *pid)
+{
+	b->kp[loop] = pid->alteredKp;
+	b->ki[loop] = pid->alteredKi;
+	b->kd[loop] = pid->alteredKd;
+	b->kt[loop] = pid->alteredKt;
+	b->beta[loop] = pid->beta;
+	b->dFilter[loop] = pid->dFilter;
+	b->outMin[loop] = pid->outMin;
+	b->outMax[loop] = pid->outMax;
+
+	if (pidBatchIsActive(b, loop))
+	{
+		b->output[loop] = CONSTRAIN(b->output[loop], b->outMin[loop], b->outMax[loop]);
+		b->iTerm[loop] = CONSTRAIN(b->iTerm[loop], b->outMin[loop], b->outMax[loop]);
+	}
+}
+
+
+
+_OPT_O3 void pidBatchCompute(pidBatch_t *b, uint32_t from, uint32_t to, uint32_t mask)
+{
+	mask &= b->active;
+	if (to > b->count)
+		to = b->count;
+
+	for (uint32_t k = from; k < to; k++)
+	{
+		uint32_t i = b->order[k];
+		float error, iTerm, dTerm, unlimited, output;
+
+		if ((mask & (1u << i)) == 0)
+			continue;
+
+		// the same steps as PIDCompute()
+		error = b->setpoint[i] - b->input[i];
+		iTerm = b->iTerm[i] + b->ki[i] * error;
+		iTerm = CONSTRAIN(iTerm, b->outMin[i], b->outMax[i]);
+
+		dTerm = b->dFilter[i] * b->dTerm[i] - (1.0f - b->dFilter[i]) * b->kd[i] * (b->input[i] - b->lastInput[i]);
+
+		unlimited = b->kp[i] * (b->beta[i] * b->setpoint[i] - b->input[i]) + iTerm + dTerm;
+		output = CONSTRAIN(unlimited, b->outMin[i], b->outMax[i]);
+
+		if (b->kt[i] > 0.0f)
+		{
+			iTerm += b->kt[i] * (output - unlimited);
+			iTerm = CONSTRAIN(iTerm, b->outMin[i], b->outMax[i]);
+		}
+
+		b->iTerm[i] = iTerm;
+		b->dTerm[i] = dTerm;
+		b->output[i] = output;
+		b->lastInput[i] = b->input[i];
+	}
+}
+
+
+
+void pidBatchModeSet(pidBatch_t *b, uint32_t loop, PIDMode mode)
+{
+	if ((mode == AUTOMATIC) && !pidBatchIsActive(b, loop))
+	{	// the next output continues from the current one
+		b->iTerm[loop] = b->output[loop] - b->kp[loop] * (b->beta[loop] * b->setpoint[loop] - b->input[loop]);
+		b->iTerm[loop] = CONSTRAIN(b->iTerm[loop], b->outMin[loop], b->outMax[loop]);
+		b->lastInput[loop] = b->input[loop];
+		b->dTerm[loop] = 0.0f;
+	}
+
+	if (mode == AUTOMATIC)
+		b->active |= (1u << loop);
+	else
+		b->active &= ~(1u << loop);
+}
+
+
+
+void pidBatchOutputTrack(pidBatch_t *b, uint32_t loop, float output)
+{
+	if (pidBatchIsActive(b, loop))
+	{
+		if (b->kt[loop] > 0.0f)
+		{
+			b->iTerm[loop] += b->kt[loop] * (output - b->output[loop]);
+			b->iTerm[loop] = CONSTRAIN(b->iTerm[loop], b->outMin[loop], b->outMax[loop]);
+		}
+	}
+	else
+		b->lastInput[loop] = b->input[loop];
+
+	b->output[loop] = output;
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,132 @@
+/*
+ * pid_batch.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pid_controller.h"
+
+/*
+ * Batch of PID loops computed together. PIDControl keeps display gains and
+ * the setup next to the state, and every loop is a separate call. Here the
+ * hot state and altered gains of all loops are kept in arrays (struct of
+ * arrays) and computed in one loop, in explicit order - cascade masters before
+ * their slaves, e.g. Ia before Ue whose setpoint is Ia output:
+ *
+ *  order:  [UC, UF, IA | UE]
+ *           stage 1      stage 2 - setpoint from stage 1 outputs
+ *
+ * The caller computes stage by stage (pidBatchCompute(from, to)) and sets
+ * slave setpoints in between. Math is the same as PIDCompute(), including
+ * anti-windup, setpoint weight and derivative filter.
+ *
+ * PIDControl stays the setup of a loop (PIDInit(), PIDTuningsSet() etc.), it
+ * is copied into the batch by pidBatchLoad() or pidBatchConfigLoad(). State is
+ * kept by the batch from then on.
+ *
+ * Module doesn't depend on HAL, so it compiles on host too.
+ */
+
+/* Config --------------------------------------------------------------------*/
+
+#define PIDB_LOOPS_MAX		(4)
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+	uint32_t count;						// loops in order[]
+	uint8_t order[PIDB_LOOPS_MAX];		// of computation, loop indexes
+	uint32_t active;					// bit per loop - AUTOMATIC
+	// state, [loop]
+	float input[PIDB_LOOPS_MAX];
+	float setpoint[PIDB_LOOPS_MAX];
+	float output[PIDB_LOOPS_MAX];
+	float lastInput[PIDB_LOOPS_MAX];
+	float iTerm[PIDB_LOOPS_MAX];
+	float dTerm[PIDB_LOOPS_MAX];
+	// altered gains (sample time and direction in), limits
+	float kp[PIDB_LOOPS_MAX];
+	float ki[PIDB_LOOPS_MAX];
+	float kd[PIDB_LOOPS_MAX];
+	float kt[PIDB_LOOPS_MAX];
+	float beta[PIDB_LOOPS_MAX];
+	float dFilter[PIDB_LOOPS_MAX];
+	float outMin[PIDB_LOOPS_MAX];
+	float outMax[PIDB_LOOPS_MAX];
+} pidBatch_t;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * @brief	Clears the batch and sets order of computation of count loops
+ * 			(indexes 0 .. PIDB_LOOPS_MAX - 1). All are in MANUAL.
+ */
+void pidBatchInit(pidBatch_t *b, const uint8_t order[], uint32_t count);
+
+
+
+/*
+ * @brief	Copies setup, state and mode of pid into the loop.
+ */
+void pidBatchLoad(pidBatch_t *b, uint32_t loop, const PIDControl *pid);
+
+
+
+/*
+ * Can be called from interrupts.
+ *
+ * @brief	Copies setup of pid (gains, limits, anti-windup, setpoint weight,
+ * 			derivative filter) into the loop, state and mode are kept. Output
+ * 			and integral are constrained to new limits.
+ */
+void pidBatchConfigLoad(pidBatch_t *b, uint32_t loop, const PIDControl *pid);
+
+
+
+/*
+ * Call it every period, with inputs and setpoints of the loops set.
+ *
+ * @brief	Computes loops order[from] .. order[to - 1], which are active and
+ * 			in mask (bit per loop).
+ */
+void pidBatchCompute(pidBatch_t *b, uint32_t from, uint32_t to, uint32_t mask);
+
+
+
+/*
+ * @brief	As PIDModeSet(): switch to AUTOMATIC is bumpless.
+ */
+void pidBatchModeSet(pidBatch_t *b, uint32_t loop, PIDMode mode);
+
+
+
+/*
+ * @brief	As PIDOutputTrack(): output applied, if it differs from the
+ * 			computed one.
+ */
+void pidBatchOutputTrack(pidBatch_t *b, uint32_t loop, float output);
+
+
+
+static inline bool pidBatchIsActive(const pidBatch_t *b, uint32_t loop)
+{
+	return (b->active & (1u << loop)) != 0;
+}
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
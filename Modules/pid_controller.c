@@ -53,6 +53,7 @@ void PIDInit(PIDControl *pid, float kp, float ki, float kd,
     pid->controllerDirection = controllerDirection;
     pid->mode = mode;
     pid->iTerm = 0.0f;
+    pid->dTerm = 0.0f;
     pid->input = 0.0f;
     pid->lastInput = 0.0f;
     pid->output = 0.0f;
@@ -67,6 +68,13 @@ void PIDInit(PIDControl *pid, float kp, float ki, float kd,
         // If the passed parameter was incorrect, set to 1 second
         pid->sampleTime = 1.0f;
     }
+
+    // Extensions off, classic PID
+    pid->beta = 1.0f;
+    pid->dispTt = 0.0f;
+    pid->alteredKt = 0.0f;
+    pid->dispTf = 0.0f;
+    pid->dFilter = 0.0f;
     
     PIDOutputLimitsSet(pid, minOutput, maxOutput);
     PIDTuningsSet(pid, kp, ki, kd);
@@ -75,7 +83,7 @@ void PIDInit(PIDControl *pid, float kp, float ki, float kd,
 _OPT_O3 bool
 PIDCompute(PIDControl *pid) 
 {
-    float error, dInput;
+    float error, dInput, unlimited;
 
     if(pid->mode == MANUAL)
     {
@@ -91,14 +99,24 @@ PIDCompute(PIDControl *pid)
     // Constrain the integrator to make sure it does not exceed output bounds
     pid->iTerm = CONSTRAIN( (pid->iTerm), (pid->outMin), (pid->outMax) );
     
-    // Take the "derivative on measurement" instead of "derivative on error"
+    // Take the "derivative on measurement" instead of "derivative on error",
+    // low-pass filtered
     dInput = (pid->input) - (pid->lastInput);
+    pid->dTerm = (pid->dFilter) * (pid->dTerm) - (1.0f - (pid->dFilter)) * (pid->alteredKd) * dInput;
     
-    // Run all the terms together to get the overall output
-    pid->output = (pid->alteredKp) * error + (pid->iTerm) - (pid->alteredKd) * dInput;
+    // Run all the terms together to get the overall output, proportional one
+    // with weighted setpoint
+    unlimited = (pid->alteredKp) * ((pid->beta) * (pid->setpoint) - (pid->input)) + (pid->iTerm) + (pid->dTerm);
     
     // Bound the output
-    pid->output = CONSTRAIN( (pid->output), (pid->outMin), (pid->outMax) );
+    pid->output = CONSTRAIN( unlimited, (pid->outMin), (pid->outMax) );
+    
+    // Back-calculation: integral follows the part cut off by limits
+    if((pid->alteredKt) > 0.0f)
+    {
+        pid->iTerm += (pid->alteredKt) * ((pid->output) - unlimited);
+        pid->iTerm = CONSTRAIN( (pid->iTerm), (pid->outMin), (pid->outMax) );
+    }
     
     // Make the current input the former input
     pid->lastInput = pid->input;
@@ -112,9 +130,11 @@ PIDModeSet(PIDControl *pid, PIDMode mode)
     // If the mode changed from MANUAL to AUTOMATIC
     if(pid->mode != mode && mode == AUTOMATIC)
     {
-        // Initialize a few PID parameters to new values
-        pid->iTerm = pid->output;
+        // Initialize a few PID parameters to new values, so the next output
+        // continues from the current one (bumpless)
+        pid->iTerm = (pid->output) - (pid->alteredKp) * ((pid->beta) * (pid->setpoint) - (pid->input));
         pid->lastInput = pid->input;
+        pid->dTerm = 0.0f;
         
         // Constrain the integrator to make sure it does not exceed output bounds
         pid->iTerm = CONSTRAIN( (pid->iTerm), (pid->outMin), (pid->outMax) );
@@ -219,7 +239,67 @@ PIDSampleTimeSet(PIDControl *pid, float sampleTimeSeconds)
         
         // Save the new sampling time
         pid->sampleTime = sampleTimeSeconds;
+        
+        // Time constants stay, their discrete coefficients change
+        PIDAntiWindupSet(pid, pid->dispTt);
+        PIDDerivativeFilterSet(pid, pid->dispTf);
+    }
+}
+
+void 
+PIDAntiWindupSet(PIDControl *pid, float trackingTimeSeconds)
+{
+    if(trackingTimeSeconds <= 0.0f)
+    {
+        pid->dispTt = 0.0f;
+        pid->alteredKt = 0.0f;
+        return;
     }
+    
+    pid->dispTt = trackingTimeSeconds;
+    
+    // Faster than one sample it would oscillate
+    pid->alteredKt = (trackingTimeSeconds > pid->sampleTime) ? 
+                     (pid->sampleTime / trackingTimeSeconds) : 1.0f;
+}
+
+void 
+PIDSetpointWeightSet(PIDControl *pid, float beta)
+{
+    pid->beta = CONSTRAIN(beta, 0.0f, 1.0f);
+}
+
+void 
+PIDDerivativeFilterSet(PIDControl *pid, float filterTimeSeconds)
+{
+    if(filterTimeSeconds <= 0.0f)
+    {
+        pid->dispTf = 0.0f;
+        pid->dFilter = 0.0f;
+        return;
+    }
+    
+    pid->dispTf = filterTimeSeconds;
+    pid->dFilter = filterTimeSeconds / (filterTimeSeconds + pid->sampleTime);
+}
+
+void 
+PIDOutputTrack(PIDControl *pid, float output)
+{
+    if(pid->mode == AUTOMATIC)
+    {
+        if((pid->alteredKt) > 0.0f)
+        {
+            pid->iTerm += (pid->alteredKt) * (output - (pid->output));
+            pid->iTerm = CONSTRAIN( (pid->iTerm), (pid->outMin), (pid->outMax) );
+        }
+    }
+    else
+    {
+        pid->lastInput = pid->input;
+    }
+    
+    pid->output = output;
 }
 
 
@@ -109,6 +109,29 @@ typedef struct
     // 
     float iTerm;
     
+    // 
+    // Back-calculation anti-windup: integral is moved by alteredKt times
+    // the part of the output cut off by the limits (or by the actuator,
+    // see PIDOutputTrack). dispTt is the tracking time in seconds, 0 - off
+    // (the integral is only clamped to the output limits).
+    // 
+    float dispTt;
+    float alteredKt;
+    
+    // 
+    // Setpoint weight of the proportional term (2-DOF), 0 .. 1:
+    // P = Kp * (beta * setpoint - input). 1 - classic PID.
+    // 
+    float beta;
+    
+    // 
+    // The Derivative Term, on measurement, low-pass filtered with the time
+    // constant dispTf in seconds (0 - no filter). dFilter = Tf / (Tf + Ts).
+    // 
+    float dTerm;
+    float dispTf;
+    float dFilter;
+    
     // 
     // The interval (in seconds) on which the PID controller
     // will be called
@@ -191,7 +214,9 @@ extern bool PIDCompute(PIDControl *pid);
 // 
 // PID Mode Set
 // Description:
-//      Sets the PID controller to a new mode.
+//      Sets the PID controller to a new mode. Switch to AUTOMATIC is bumpless:
+//      the integral is set so that the next output continues from the
+//      current one (see also PIDOutputTrack).
 // Parameters:
 //      pid - The address of a PIDControl instantiation.
 //      mode - Tells how the controller should respond if the user has taken over
@@ -293,7 +318,68 @@ extern void PIDControllerDirectionSet(PIDControl *pid,
 // Returns:
 //      Nothing.
 // 
-extern void PIDSampleTimeSet(PIDControl *pid, float sampleTimeSeconds);                                                       									  									  									   
+extern void PIDSampleTimeSet(PIDControl *pid, float sampleTimeSeconds);
+
+// 
+// PID Anti-windup Set
+// Description:
+//      Sets back-calculation anti-windup. When the output saturates, the
+//      integral is pulled towards the value which just gives the limit, with
+//      the tracking time constant. A rule of thumb is Tt between Ti and Td,
+//      e.g. Ti = Kp / Ki for PI. Without it (default) the integral is only
+//      clamped to the output limits, so it winds up to the limit and the
+//      output overshoots after saturation.
+// Parameters:
+//      pid - The address of a PIDControl instantiation.
+//      trackingTimeSeconds - Tt, 0 - off. It's at least the sample time.
+// Returns:
+//      Nothing.
+// 
+extern void PIDAntiWindupSet(PIDControl *pid, float trackingTimeSeconds);
+
+// 
+// PID Setpoint Weight Set
+// Description:
+//      Sets weight of the setpoint in the proportional term (2-DOF PID).
+//      Below 1 the setpoint change doesn't kick the output by Kp, the
+//      integral brings it in instead. Response to disturbances doesn't change.
+// Parameters:
+//      pid - The address of a PIDControl instantiation.
+//      beta - 0 .. 1, default 1 (classic PID).
+// Returns:
+//      Nothing.
+// 
+extern void PIDSetpointWeightSet(PIDControl *pid, float beta);
+
+// 
+// PID Derivative Filter Set
+// Description:
+//      Sets the time constant of the first order low-pass filter of the
+//      derivative term, so it doesn't amplify measurement noise. A rule of
+//      thumb is Td / 10 .. Td / 3.
+// Parameters:
+//      pid - The address of a PIDControl instantiation.
+//      filterTimeSeconds - Tf, 0 - no filter (default).
+// Returns:
+//      Nothing.
+// 
+extern void PIDDerivativeFilterSet(PIDControl *pid, float filterTimeSeconds);
+
+// 
+// PID Output Track
+// Description:
+//      Tells the controller the output really applied, when it differs from
+//      PIDOutputGet (limited by another loop, actuator, or set by hand).
+//      In MANUAL the output is followed, so the switch to AUTOMATIC starts
+//      from it (bumpless). In AUTOMATIC the integral is back-calculated as
+//      for own limits - needs anti-windup on (PIDAntiWindupSet).
+// Parameters:
+//      pid - The address of a PIDControl instantiation.
+//      output - The output applied.
+// Returns:
+//      Nothing.
+// 
+extern void PIDOutputTrack(PIDControl *pid, float output);                                                       									  									  									   
 
 // 
 // Basic Set and Get Functions for PID Parameters
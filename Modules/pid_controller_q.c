@@ -0,0 +1,247 @@
+/*
+ * pid_controller_q.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <math.h>
+#include "main.h"	// for _OPT definition
+#include "pid_controller_q.h"
+
+#if defined (__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+	#define PIDQ_QADD(a, b)	__QADD(a, b)
+	#define PIDQ_QSUB(a, b)	__QSUB(a, b)
+#else
+	// no DSP instructions (host build)
+	#define PIDQ_QADD(a, b)	pidqSat((int64_t)(a) + (b))
+	#define PIDQ_QSUB(a, b)	pidqSat((int64_t)(a) - (b))
+#endif
+
+#define PIDQ_SHIFT_MAX	62
+
+/* Private functions ---------------------------------------------------------*/
+
+static inline int32_t pidqSat(int64_t x)
+{
+	if (x > INT32_MAX)
+		return INT32_MAX;
+	if (x < INT32_MIN)
+		return INT32_MIN;
+	return (int32_t)x;
+}
+
+
+
+static inline int32_t pidqClamp(int32_t x, int32_t min, int32_t max)
+{
+	return (x < min) ? min : ((x > max) ? max : x);
+}
+
+
+
+/*
+ * k * x / 2^shift, rounded to the nearest and saturated.
+ */
+static inline int32_t pidqMul(int32_t k, uint32_t shift, int32_t x)
+{
+	int64_t half = ((int64_t)1 << shift) >> 1;
+
+	return pidqSat(((int64_t)k * x + half) >> shift);
+}
+
+
+
+static inline int64_t pidqITermLimit(int32_t limit)
+{
+	return (int64_t)limit * ((int64_t)1 << PIDQ_ITERM_FRAC);
+}
+
+
+
+/*
+ * Gain [output LSB / input LSB] to mantissa of PIDQ_GAIN_BITS and shift, at
+ * least shiftMin. Gains too big for it are saturated.
+ */
+static void pidqGainSet(float gain, int32_t *k, uint32_t *shift, uint32_t shiftMin)
+{
+	int exp;
+	int32_t s;
+	double value;
+
+	if (gain == 0.0f)
+	{
+		*k = 0;
+		*shift = shiftMin;
+		return;
+	}
+
+	(void)frexpf(gain, &exp);	// 2^(exp-1) <= |gain| < 2^exp
+	s = PIDQ_GAIN_BITS - exp;
+	if (s < (int32_t)shiftMin)
+		s = (int32_t)shiftMin;
+	if (s > PIDQ_SHIFT_MAX)
+		s = PIDQ_SHIFT_MAX;
+
+	value = round(ldexp((double)gain, s));
+	if (value > (double)INT32_MAX)
+		value = (double)INT32_MAX;
+	else if (value < -(double)INT32_MAX)
+		value = -(double)INT32_MAX;
+
+	*k = (int32_t)value;
+	*shift = (uint32_t)s;
+}
+
+
+
+static void pidqGainsUpdate(PIDControlQ *pid)
+{
+	float scale = pid->inScale / pid->outScale;
+	float sign = (pid->controllerDirection == REVERSE) ? -1.0f : 1.0f;
+
+	pidqGainSet(sign * scale * pid->dispKp, &pid->kp, &pid->kpShift, 0);
+	pidqGainSet(sign * scale * pid->dispKi * pid->sampleTime, &pid->ki, &pid->kiShift, PIDQ_ITERM_FRAC);
+	pidqGainSet(sign * scale * pid->dispKd / pid->sampleTime, &pid->kd, &pid->kdShift, 0);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+void PIDQInit(PIDControlQ *pid, float kp, float ki, float kd,
+			float sampleTimeSeconds, int32_t minOutput, int32_t maxOutput,
+			float inScale, float outScale,
+			PIDMode mode, PIDDirection controllerDirection)
+{
+	pid->controllerDirection = controllerDirection;
+	pid->mode = mode;
+	pid->iTerm = 0;
+	pid->input = 0;
+	pid->lastInput = 0;
+	pid->output = 0;
+	pid->setpoint = 0;
+
+	pid->sampleTime = (sampleTimeSeconds > 0.0f) ? sampleTimeSeconds : 1.0f;
+	pid->inScale = (inScale > 0.0f) ? inScale : 1.0f;
+	pid->inScaleInv = 1.0f / pid->inScale;
+	pid->outScale = (outScale > 0.0f) ? outScale : 1.0f;
+	pid->dispKp = 0.0f;
+	pid->dispKi = 0.0f;
+	pid->dispKd = 0.0f;
+
+	PIDQOutputLimitsSet(pid, minOutput, maxOutput);
+	PIDQTuningsSet(pid, kp, ki, kd);
+}
+
+
+
+_OPT_O3 bool PIDQCompute(PIDControlQ *pid)
+{
+	int32_t error, dInput, iTerm, out;
+	int64_t iMin, iMax;
+
+	if (pid->mode == MANUAL)
+		return false;
+
+	error = PIDQ_QSUB(pid->setpoint, pid->input);
+
+	// integral with 32 fraction bits, clamped to output bounds
+	pid->iTerm += ((int64_t)pid->ki * error) >> (pid->kiShift - PIDQ_ITERM_FRAC);
+	iMin = pidqITermLimit(pid->outMin);
+	iMax = pidqITermLimit(pid->outMax);
+	if (pid->iTerm < iMin)
+		pid->iTerm = iMin;
+	else if (pid->iTerm > iMax)
+		pid->iTerm = iMax;
+
+	// derivative on measurement
+	dInput = PIDQ_QSUB(pid->input, pid->lastInput);
+
+	iTerm = (int32_t)((pid->iTerm + ((int64_t)1 << (PIDQ_ITERM_FRAC - 1))) >> PIDQ_ITERM_FRAC);
+	out = PIDQ_QADD(pidqMul(pid->kp, pid->kpShift, error), iTerm);
+	out = PIDQ_QSUB(out, pidqMul(pid->kd, pid->kdShift, dInput));
+	pid->output = pidqClamp(out, pid->outMin, pid->outMax);
+
+	pid->lastInput = pid->input;
+	return true;
+}
+
+
+
+void PIDQModeSet(PIDControlQ *pid, PIDMode mode)
+{
+	// bumpless from MANUAL to AUTOMATIC
+	if ((pid->mode != mode) && (mode == AUTOMATIC))
+	{
+		pid->iTerm = pidqITermLimit(pidqClamp(pid->output, pid->outMin, pid->outMax));
+		pid->lastInput = pid->input;
+	}
+
+	pid->mode = mode;
+}
+
+
+
+void PIDQOutputLimitsSet(PIDControlQ *pid, int32_t min, int32_t max)
+{
+	if (min >= max)
+		return;
+
+	pid->outMin = min;
+	pid->outMax = max;
+
+	if (pid->mode == AUTOMATIC)
+	{
+		pid->output = pidqClamp(pid->output, min, max);
+		if (pid->iTerm < pidqITermLimit(min))
+			pid->iTerm = pidqITermLimit(min);
+		else if (pid->iTerm > pidqITermLimit(max))
+			pid->iTerm = pidqITermLimit(max);
+	}
+}
+
+
+
+void PIDQTuningsSet(PIDControlQ *pid, float kp, float ki, float kd)
+{
+	if ((kp < 0.0f) || (ki < 0.0f) || (kd < 0.0f))
+		return;
+
+	pid->dispKp = kp;
+	pid->dispKi = ki;
+	pid->dispKd = kd;
+	pidqGainsUpdate(pid);
+}
+
+
+
+void PIDQControllerDirectionSet(PIDControlQ *pid, PIDDirection controllerDirection)
+{
+	pid->controllerDirection = controllerDirection;
+	pidqGainsUpdate(pid);
+}
+
+
+
+void PIDQSampleTimeSet(PIDControlQ *pid, float sampleTimeSeconds)
+{
+	if (sampleTimeSeconds > 0.0f)
+	{
+		pid->sampleTime = sampleTimeSeconds;
+		pidqGainsUpdate(pid);
+	}
+}
+
+
+
+int32_t PIDQInputScale(const PIDControlQ *pid, float value)
+{
+	float x = value * pid->inScaleInv;
+
+	if (x >= 2147483520.0f)		// the biggest float below 2^31
+		return INT32_MAX;
+	if (x <= -2147483648.0f)
+		return INT32_MIN;
+	return (int32_t)(x + ((x >= 0.0f) ? 0.5f : -0.5f));
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,120 @@
+/*
+ * pid_controller_q.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pid_controller.h"	// for PIDMode, PIDDirection
+
+/*
+ * Fixed-point variant of pid_controller (the same algorithm and API, PIDQ
+ * prefix), for loops run at kHz rates in the sample interrupt.
+ *
+ * Input and setpoint are integers in input LSB (e.g. mV, pA), output in output
+ * LSB - for PWM loops it's directly CCR value (0 - 65535). Gains are given in
+ * float units like for PIDInit() and converted with inScale and outScale
+ * [unit/LSB] to int32 mantissa with own shift each, so they keep ca. 30 bits
+ * whatever their magnitude is (1.7e-4 of voltage loops to 4.2e7 of Ia loop).
+ * Integrator has 32 fraction bits of output LSB, so tiny Ki * sampleTime
+ * still integrates small errors. Error and sums use saturating arithmetic
+ * (QADD, QSUB), the rest is clamped - nothing can wrap around.
+ *
+ * Compiles on host too, Tests/test_pid_q.c checks it against pid_controller.
+ */
+
+/* Config --------------------------------------------------------------------*/
+
+#define PIDQ_GAIN_BITS		30		// mantissa of gains
+#define PIDQ_ITERM_FRAC		32		// fraction bits of integrator
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+	int32_t input;				// [input LSB]
+	int32_t lastInput;
+	int32_t setpoint;
+	int32_t output;				// [output LSB]
+	int64_t iTerm;				// [output LSB], PIDQ_ITERM_FRAC fraction bits
+	// altered gains: value = k / 2^kShift [output LSB / input LSB], with
+	// direction and sample time applied
+	int32_t kp, ki, kd;
+	uint32_t kpShift, kiShift, kdShift;
+	// as given, for display and retuning
+	float dispKp, dispKi, dispKd;
+	float inScale;				// [unit/LSB]
+	float inScaleInv;			// [LSB/unit], for PIDQInputScale()
+	float outScale;
+	float sampleTime;			// [s]
+	int32_t outMin;				// [output LSB]
+	int32_t outMax;
+	PIDDirection controllerDirection;
+	PIDMode mode;
+} PIDControlQ;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * @brief	The same as PIDInit(), gains in units of inScale and outScale (e.g.
+ * 			duty/V for PWM loop with inScale 0.001 V and outScale 1/65535),
+ * 			output limits in output LSB.
+ */
+void PIDQInit(PIDControlQ *pid, float kp, float ki, float kd,
+			float sampleTimeSeconds, int32_t minOutput, int32_t maxOutput,
+			float inScale, float outScale,
+			PIDMode mode, PIDDirection controllerDirection);
+
+
+
+/*
+ * Can be called from interrupts, constant time (no division, no float).
+ *
+ * @brief	The same as PIDCompute(): P on error, I clamped to output limits,
+ * 			D on measurement.
+ *
+ * @return	false in MANUAL mode, output isn't changed then
+ */
+bool PIDQCompute(PIDControlQ *pid);
+
+
+
+void PIDQModeSet(PIDControlQ *pid, PIDMode mode);
+void PIDQOutputLimitsSet(PIDControlQ *pid, int32_t min, int32_t max);
+void PIDQTuningsSet(PIDControlQ *pid, float kp, float ki, float kd);
+void PIDQControllerDirectionSet(PIDControlQ *pid, PIDDirection controllerDirection);
+void PIDQSampleTimeSet(PIDControlQ *pid, float sampleTimeSeconds);
+
+
+
+/*
+ * @return	value in input LSB, rounded and saturated
+ */
+int32_t PIDQInputScale(const PIDControlQ *pid, float value);
+
+/* Exported inline snippets --------------------------------------------------*/
+
+static inline void PIDQSetpointSet(PIDControlQ *pid, int32_t setpoint) { pid->setpoint = setpoint; }
+static inline void PIDQInputSet(PIDControlQ *pid, int32_t input) { pid->input = input; }
+static inline int32_t PIDQOutputGet(const PIDControlQ *pid) { return pid->output; }
+static inline float PIDQKpGet(const PIDControlQ *pid) { return pid->dispKp; }
+static inline float PIDQKiGet(const PIDControlQ *pid) { return pid->dispKi; }
+static inline float PIDQKdGet(const PIDControlQ *pid) { return pid->dispKd; }
+static inline PIDMode PIDQModeGet(const PIDControlQ *pid) { return pid->mode; }
+static inline PIDDirection PIDQDirectionGet(const PIDControlQ *pid) { return pid->controllerDirection; }
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,103 @@
+/*
+ * stats.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <math.h>
+#include "main.h"	// for _OPT definition
+#include "stats.h"
+
+/* Private functions ---------------------------------------------------------*/
+
+static void statsPublish(stats_t *s)
+{
+	float var = s->m2 / (float)s->count;	// population variance of the window
+	float mean = s->ref + s->mean;
+
+	s->seq++;
+	__DMB();
+	s->result.count = s->count;
+	s->result.mean = mean;
+	s->result.min = s->ref + s->min;
+	s->result.max = s->ref + s->max;
+	s->result.p2p = s->max - s->min;
+	s->result.std = sqrtf(var);
+	s->result.rms = sqrtf(mean * mean + var);
+	s->windows++;
+	__DMB();
+	s->seq++;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+void statsInit(stats_t *s, uint32_t size)
+{
+	s->size = (size < 2) ? 2 : size;
+	s->seq = 0;
+	s->windows = 0;
+	statsRestart(s);
+}
+
+
+
+_OPT_O3 void statsAddSample(stats_t *s, float x)
+{
+	float delta;
+
+	if (s->count == 0)
+	{
+		s->ref = x;
+		s->mean = 0.0f;
+		s->m2 = 0.0f;
+		s->min = 0.0f;
+		s->max = 0.0f;
+	}
+
+	// Welford on shifted sample
+	x -= s->ref;
+	s->count++;
+	delta = x - s->mean;
+	s->mean += delta / (float)s->count;
+	s->m2 += delta * (x - s->mean);
+
+	if (x < s->min)
+		s->min = x;
+	if (x > s->max)
+		s->max = x;
+
+	if (s->count >= s->size)
+	{
+		statsPublish(s);
+		s->count = 0;
+	}
+}
+
+
+
+void statsRestart(stats_t *s)
+{
+	s->count = 0;
+}
+
+
+
+bool statsRead(const stats_t *s, statsResult_t *copy)
+{
+	for (uint32_t retry = 0; retry < 3; retry++)
+	{
+		uint32_t seq = s->seq;
+		__DMB();
+		if ((seq == 0) || (seq & 1u))
+			continue;	// no result yet, or being written right now
+
+		*copy = s->result;
+		__DMB();
+		if (s->seq == seq)
+			return true;
+	}
+	return false;
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,105 @@
+/*
+ * stats.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Ripple and noise statistics of a sample stream, in tumbling windows of given
+ * length: mean, min, max, peak-to-peak, standard deviation (Welford) and RMS.
+ * Every sample takes constant time and no sample buffer is needed. Samples are
+ * shifted by the first one of the window, so variance of a small ripple on a
+ * large DC level (kV) doesn't lose float precision.
+ *
+ * Result of every complete window is published with sequence number, so it can
+ * be read from lower priority (main loop) while samples are added.
+ *
+ * Module doesn't depend on HAL, so it compiles on host too.
+ */
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+	uint32_t count;		// samples in the window
+	float mean;
+	float min;
+	float max;
+	float p2p;			// max - min
+	float std;			// standard deviation - RMS of the ripple (AC part)
+	float rms;			// RMS of the signal, sqrt(mean^2 + std^2)
+} statsResult_t;
+
+typedef struct
+{
+	// window being collected, values shifted by ref
+	uint32_t size;				// window length [samples]
+	uint32_t count;
+	float ref;
+	float mean;
+	float m2;					// sum of squared differences from the mean
+	float min;
+	float max;
+	// the last complete window
+	volatile uint32_t seq;		// odd while result is written
+	uint32_t windows;			// complete windows since statsInit()
+	statsResult_t result;
+} stats_t;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * Call it when samples are stopped, or from the same interrupt priority as
+ * statsAddSample().
+ *
+ * @brief	Clears statistics and sets window length (at least 2 samples).
+ */
+void statsInit(stats_t *s, uint32_t size);
+
+
+
+/*
+ * Can be called from interrupts, constant time (one division).
+ *
+ * @brief	Adds sample to the window, at the end of it publishes result and
+ * 			starts the next one.
+ */
+void statsAddSample(stats_t *s, float x);
+
+
+
+/*
+ * Drops the window being collected - call it after a gap in samples, so the
+ * result doesn't mix data from before and after it.
+ */
+void statsRestart(stats_t *s);
+
+
+
+/*
+ * Can be called from lower priority than statsAddSample().
+ *
+ * @brief	Copies result of the last complete window.
+ *
+ * @return	false if there's no result yet, or it was overwritten while copying
+ * 			three times in a row
+ */
+bool statsRead(const stats_t *s, statsResult_t *copy);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
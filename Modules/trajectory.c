@@ -0,0 +1,70 @@
+/*
+ * trajectory.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <math.h>
+#include "main.h"	// for _OPT definition
+#include "trajectory.h"
+
+/* Exported functions --------------------------------------------------------*/
+
+void trajInit(traj_t *t, float slew, float accel, float position)
+{
+	t->slew = slew;
+	t->accel = accel;
+	trajReset(t, position);
+}
+
+
+
+void trajReset(traj_t *t, float position)
+{
+	t->target = position;
+	t->position = position;
+	t->velocity = 0.0f;
+}
+
+
+
+_OPT_O3 float trajStep(traj_t *t, float target, float dt)
+{
+	float error = target - t->position;
+	float dv = t->accel * dt;	// max velocity change per period
+	float vStop, step;
+
+	t->target = target;
+
+	/*
+	 * Velocity v from which the discrete profile stops just at the target:
+	 * h * (v + (v - dv) + ... + dv) = v * (v + dv) / (2 * a) = |error|
+	 */
+	vStop = 0.5f * (sqrtf(dv * dv + 8.0f * t->accel * fabsf(error)) - dv);
+	if (vStop > t->slew)
+		vStop = t->slew;
+	if (error < 0.0f)
+		vStop = -vStop;
+
+	if (vStop > t->velocity + dv)
+		t->velocity += dv;
+	else if (vStop < t->velocity - dv)
+		t->velocity -= dv;
+	else
+		t->velocity = vStop;
+
+	// the last step lands at the target
+	step = t->velocity * dt;
+	if (((error >= 0.0f) && (step >= error)) || ((error <= 0.0f) && (step <= error)))
+	{
+		t->position = target;
+		t->velocity = 0.0f;
+	}
+	else
+		t->position += step;
+
+	return t->position;
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
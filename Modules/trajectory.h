@@ -0,0 +1,90 @@
+/*
+ * trajectory.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Setpoint trajectory generator, between System.ref and PID setpoints. Raw
+ * step of the reference (e.g. 0 -> -2500 V) winds up integrators of the loops
+ * and the output overshoots - which the field emission tip doesn't like.
+ * Generator moves its output towards the target with limited velocity (slew)
+ * and acceleration, so the output is S-shaped:
+ *
+ *  velocity      ____________
+ *               /            \          accel = slew / t_a
+ *              /              \
+ *  ___________/                \_______
+ *
+ * Braking starts when the remaining distance equals the braking distance of
+ * the discrete profile, so output stops at the target without overshoot. Target
+ * can change anytime, also to the opposite direction - velocity is then
+ * reduced with the acceleration limit first.
+ *
+ * Module doesn't depend on HAL, so it compiles on host too.
+ */
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+	float slew;			// [unit/s] max velocity
+	float accel;		// [unit/s^2] max acceleration
+	float target;		// the last requested
+	float position;		// output, setpoint of the loop
+	float velocity;		// [unit/s]
+} traj_t;
+
+/* Exported functions --------------------------------------------------------*/
+
+/*
+ * @brief	Sets limits and puts the output at position, at rest.
+ */
+void trajInit(traj_t *t, float slew, float accel, float position);
+
+
+
+/*
+ * @brief	Moves the output to position at once, at rest (e.g. when the loop
+ * 			is off, or takes setpoint from elsewhere).
+ */
+void trajReset(traj_t *t, float position);
+
+
+
+/*
+ * Call it every period dt [s], from the regulator.
+ *
+ * @brief	Advances the output towards target by one period.
+ *
+ * @return	output
+ */
+float trajStep(traj_t *t, float target, float dt);
+
+
+
+/*
+ * @return	true when the output is at the target, at rest
+ */
+static inline bool trajDone(const traj_t *t)
+{
+	return (t->position == t->target) && (t->velocity == 0.0f);
+}
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
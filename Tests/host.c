@@ -0,0 +1,76 @@
+/*
+ * host.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#include <stdio.h>
+#include "host.h"
+#include "typedefs.h"
+
+/* Fake core, see host.h -----------------------------------------------------*/
+
+DWT_Type hostDwt;
+SCB_Type hostScb;
+NVIC_Type hostNvic;
+uint32_t hostPrimask;
+uint32_t hostTick;
+uint32_t hostFailures;
+
+uint32_t SystemCoreClock = 80000000u;
+struct sSystem System;
+
+/* HAL and printf output used by firmware sources ----------------------------*/
+
+uint32_t HAL_GetTick(void)
+{
+	return hostTick;
+}
+
+
+
+void HAL_Delay(uint32_t Delay)
+{
+	hostTick += Delay;
+}
+
+
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	(void)IRQn;
+}
+
+
+
+void _putchar(char character)
+{
+	putchar(character);
+}
+
+/* Test helpers --------------------------------------------------------------*/
+
+int hostResult(const char *name)
+{
+	printf("%s: %s\n", name, (hostFailures == 0) ? "OK" : "FAILED");
+	return (hostFailures == 0) ? 0 : 1;
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
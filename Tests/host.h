@@ -0,0 +1,86 @@
+/*
+ * host.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Host build of firmware sources which touch the Cortex core. HAL and CMSIS
+ * headers are the real ones, only core peripherals (DWT, SCB, NVIC) are
+ * redirected to plain structures and intrinsics are done in C, so the code
+ * runs on PC. Makefile includes it first in every source (-include), tests
+ * which need statics include firmware source (#include "../Core/Src/x.c").
+ * Peripheral handles (SPI, DMA) are pointed to fake registers by the test.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "main.h"
+
+/* Fake core -----------------------------------------------------------------*/
+
+extern DWT_Type hostDwt;
+extern SCB_Type hostScb;
+extern NVIC_Type hostNvic;
+extern uint32_t hostPrimask;
+extern uint32_t hostTick;
+
+#undef DWT
+#define DWT					(&hostDwt)
+#undef SCB
+#define SCB					(&hostScb)
+#undef NVIC
+#define NVIC				(&hostNvic)
+
+#define __get_PRIMASK()		(hostPrimask)
+#define __set_PRIMASK(x)	(hostPrimask = (x))
+#define __disable_irq()		(hostPrimask = 1u)
+#define __enable_irq()		(hostPrimask = 0u)
+#define __DMB()				__sync_synchronize()
+#define __DSB()				__sync_synchronize()
+#define __ISB()				__sync_synchronize()
+#undef __NOP
+#define __NOP()				((void)0)
+
+// optimize attributes of firmware functions (main.h), host build has its own
+#undef _OPT_OFF
+#define _OPT_OFF
+#undef _OPT_O2
+#define _OPT_O2
+#undef _OPT_O3
+#define _OPT_O3
+
+/* Test helpers --------------------------------------------------------------*/
+
+extern uint32_t hostFailures;
+
+/*
+ * Counts failed condition and prints where it is, test goes on.
+ */
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) \
+		{ \
+			hostFailures++; \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		} \
+	} while (0)
+
+/*
+ * @return	exit code of the test: 0 if nothing failed
+ */
+int hostResult(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
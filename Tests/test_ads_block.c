@@ -0,0 +1,342 @@
+/*
+ * test_ads_block.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Block acquisition (DMA circular buffer, processing deferred to PendSV) has
+ * to deliver the same samples as the per-sample path (one blocking read per
+ * DRDY): values, DRDY timestamps, lost samples and CRC errors.
+ */
+
+#include "host.h"
+#include "../Drivers/ADS131M0x/ads131m0x.c"
+
+#define FRAMES			(64)
+#define PERIOD			(40960u)	// DWT cycles at 1953 SPS
+
+/* Fake SPI and DMA ----------------------------------------------------------*/
+
+SPI_HandleTypeDef hspi1;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
+static SPI_TypeDef fakeSpi;
+static DMA_TypeDef fakeDma;
+static DMA_Channel_TypeDef fakeRx;
+static DMA_Channel_TypeDef fakeTx;
+
+static const uint8_t *spiFrame;		// frame clocked out by the next transfer
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout)
+{
+	(void)hspi;
+	(void)pTxData;
+	(void)Timeout;
+	memcpy(pRxData, spiFrame, Size);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_IT(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+	return HAL_SPI_TransmitReceive(hspi, pTxData, pRxData, Size, 0);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+	return HAL_SPI_TransmitReceive(hspi, pTxData, pRxData, Size, 0);
+}
+
+HAL_StatusTypeDef HAL_SPI_DMAStop(SPI_HandleTypeDef *hspi)					{ (void)hspi; return HAL_OK; }
+HAL_StatusTypeDef HAL_SPI_Abort_IT(SPI_HandleTypeDef *hspi)					{ (void)hspi; return HAL_OK; }
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi)						{ (void)hspi; return HAL_OK; }
+HAL_StatusTypeDef HAL_SPIEx_FlushRxFifo(SPI_HandleTypeDef *hspi)			{ (void)hspi; return HAL_OK; }
+void adsSetCS(const bool state)												{ (void)state; }
+void adsSyncPulse(void)														{ }
+int adsResetHard(void)														{ return 0; }
+
+static uint32_t initCount;
+static float callbackRate;
+
+void InitADC(void)
+{
+	initCount++;
+	System.ads.ready = true;
+}
+
+void adsDataRateCallback(float sampleRate)
+{
+	callbackRate = sampleRate;
+}
+
+void delay_us(uint32_t us)													{ (void)us; }
+uint8_t spiSendReceiveByte(const uint8_t dataTx)							{ (void)dataTx; return 0; }
+void spiSendReceiveArrays(const uint8_t DataTx[], uint8_t DataRx[], const uint8_t byteLength)
+{
+	(void)DataTx;
+	memset(DataRx, 0, byteLength);
+}
+
+/* Test ----------------------------------------------------------------------*/
+
+static uint8_t frames[FRAMES][4 * ADS_FRAME_WORDS];
+static const uint32_t badFrames[] = { 0, 5, 13, 14, 30, 62 };
+
+static adsChannelData_t expected[FRAMES];
+static uint32_t expectedCount;
+static uint32_t expectedCrcErrors;
+
+static adsChannelData_t received[FRAMES];
+static uint32_t receivedCount;
+static uint32_t receivedCrcErrors;
+
+
+
+void adsReadDataBlockCallback(const adsChannelData_t data[], uint32_t count, uint32_t crcErrors)
+{
+	CHECK(receivedCount + count <= FRAMES);
+	memcpy(&received[receivedCount], data, count * sizeof(adsChannelData_t));
+	receivedCount += count;
+	receivedCrcErrors += crcErrors;
+}
+
+
+
+/*
+ * Frames of 24 bit words: status, channels (ramps of different slopes and
+ * signs) and CRC, the chosen ones get wrong CRC.
+ */
+static void makeFrames(void)
+{
+	for (uint32_t i = 0; i < FRAMES; i++)
+	{
+		uint8_t *f = frames[i];
+		uint16_t crc;
+
+		memset(f, 0, sizeof(frames[i]));
+		f[0] = 0x05;
+		for (uint32_t ch = 0; ch < CHANNEL_COUNT; ch++)
+		{
+			int32_t v = (int32_t)((ch + 1) * 104729u * i) * ((ch & 1) ? -1 : 1);
+			f[3 * (ch + 1) + 0] = (uint8_t)(v >> 16);
+			f[3 * (ch + 1) + 1] = (uint8_t)(v >> 8);
+			f[3 * (ch + 1) + 2] = (uint8_t)v;
+		}
+		crc = adsCalculateCRC(f, adsFrame.crcIndex, 0xFFFF);
+		f[adsFrame.crcIndex] = (uint8_t)(crc >> 8);
+		f[adsFrame.crcIndex + 1] = (uint8_t)crc;
+
+		for (uint32_t k = 0; k < sizeof(badFrames) / sizeof(badFrames[0]); k++)
+		{
+			if (badFrames[k] == i)
+				f[3] ^= 0x40;
+		}
+	}
+}
+
+
+
+/*
+ * Driver state as after adsStartup(), ADS is running.
+ */
+static void reset(void)
+{
+	hspi1.Instance = &fakeSpi;
+	hdma_spi1_rx.Instance = &fakeRx;
+	hdma_spi1_rx.DmaBaseAddress = &fakeDma;
+	hdma_spi1_rx.ChannelIndex = 4;		// DMA1 channel 2
+	hdma_spi1_tx.Instance = &fakeTx;
+	hdma_spi1_tx.DmaBaseAddress = &fakeDma;
+	hdma_spi1_tx.ChannelIndex = 8;		// DMA1 channel 3
+
+	hostDwt.CYCCNT = 0;
+	adsTimingReset();
+	bDrdyFirst = true;
+	bLastSampleValid = false;
+	adsPeriodCycles = PERIOD;
+	memset(&adsRecovery, 0, sizeof(adsRecovery));
+	adsFrameLayoutUpdate(ADS_CHANNEL_MASK);
+	System.ads.sample = NULL;
+	System.ads.ready = true;
+}
+
+
+
+static void drdy(uint32_t n)
+{
+	hostDwt.CYCCNT = 1000u + n * PERIOD;
+	adsDrdyTimestamp();
+}
+
+
+
+/*
+ * Per-sample path: blocking read of every frame in DRDY interrupt.
+ */
+static void runPerSample(void)
+{
+	reset();
+	expectedCount = 0;
+	expectedCrcErrors = 0;
+
+	for (uint32_t n = 0; n < FRAMES; n++)
+	{
+		const adsSample_t *sample;
+
+		drdy(n);
+		spiFrame = frames[n];
+		sample = adsReadDataOptimized();
+		if (sample != NULL)
+			expected[expectedCount++] = sample->data;
+		else
+			expectedCrcErrors++;
+	}
+}
+
+
+
+/*
+ * Rate change with running acquisition is spread over main loop passes.
+ */
+static void runRateChange(void)
+{
+	enum eAdsRate old = adsGetDataRate();
+
+	reset();
+	initCount = 0;
+	callbackRate = 0.0f;
+	hostTick = 100;
+
+	adsSetDataRate(ADS_RATE_MAX);
+	CHECK(System.ads.ready);			// nothing done yet
+	CHECK(adsGetDataRate() == old);
+
+	adsRecoveryWatchdog();				// stop
+	CHECK(!System.ads.ready);
+	CHECK(callbackRate == 0.0f);
+	adsRecoveryWatchdog();				// last frame still may be read
+	CHECK(callbackRate == 0.0f);
+
+	hostTick += 2;
+	adsSetDataRate(ADS_RATE_DEFAULT);	// the newer request wins
+	adsRecoveryWatchdog();				// retune
+	CHECK(adsGetDataRate() == ADS_RATE_DEFAULT);
+	CHECK(callbackRate == adsRateToHz(ADS_RATE_DEFAULT));
+	CHECK(initCount == 0);
+
+	adsSetDataRate(ADS_RATE_MAX);		// between retune and restart
+	adsRecoveryWatchdog();
+	CHECK(adsGetDataRate() == ADS_RATE_MAX);
+	CHECK(initCount == 0);
+	adsRecoveryWatchdog();				// restart
+	CHECK(initCount == 1);
+	CHECK(System.ads.ready);
+	adsRecoveryWatchdog();
+	CHECK(initCount == 1);
+
+	// stopped acquisition (init): at once, no restart
+	System.ads.ready = false;
+	adsSetDataRate(ADS_RATE_DEFAULT);
+	CHECK(adsGetDataRate() == ADS_RATE_DEFAULT);
+	adsRecoveryWatchdog();
+	CHECK(initCount == 1);
+}
+
+
+
+/*
+ * Block path: DMA fills the circular buffer frame by frame, the interrupt
+ * pends PendSV, which runs pendsvDelay frames later.
+ */
+static void runBlock(uint32_t pendsvDelay)
+{
+	uint32_t pendsvAt = UINT32_MAX;
+
+	reset();
+	adsReadDataBlockStart();
+	receivedCount = 0;
+	receivedCrcErrors = 0;
+
+	for (uint32_t n = 0; n < FRAMES; n++)
+	{
+		drdy(n);
+		adsReadDataBlockDMA();
+		CHECK(fakeRx.CCR & DMA_CCR_EN);
+		CHECK(fakeRx.CNDTR == adsFrame.frameBytes);
+
+		// transfer done
+		memcpy(adsBlockRx[adsBlockIndex], frames[n], adsFrame.frameBytes);
+		fakeDma.ISR = (DMA_ISR_GIF1 | DMA_ISR_TCIF1) << hdma_spi1_rx.ChannelIndex;
+		adsReadDataBlockIRQHandler();
+		CHECK(!(fakeRx.CCR & DMA_CCR_EN));
+
+		if (hostScb.ICSR & SCB_ICSR_PENDSVSET_Msk)
+		{
+			hostScb.ICSR = 0;
+			if (pendsvAt == UINT32_MAX)
+				pendsvAt = n + pendsvDelay;
+		}
+		if (n >= pendsvAt)
+		{
+			CHECK(hostPrimask == 0);
+			adsReadDataBlockProcess();
+			pendsvAt = UINT32_MAX;
+		}
+	}
+	adsReadDataBlockProcess();
+}
+
+
+
+static bool sameSample(const adsChannelData_t *a, const adsChannelData_t *b)
+{
+	return (a->channel0 == b->channel0) && (a->channel1 == b->channel1)
+		&& (a->channel2 == b->channel2) && (a->channel3 == b->channel3)
+		&& (a->channel4 == b->channel4) && (a->channel5 == b->channel5)
+		&& (a->response == b->response) && (a->timestamp == b->timestamp)
+		&& (a->lost == b->lost);
+}
+
+
+
+int main(void)
+{
+	reset();
+	makeFrames();
+	runPerSample();
+	CHECK(expectedCrcErrors == sizeof(badFrames) / sizeof(badFrames[0]));
+	CHECK(expectedCount == FRAMES - expectedCrcErrors);
+	CHECK(adsTiming.lost == expectedCrcErrors - 1);	// nothing before frame 0 to count it
+
+	// PendSV right away or preempted up to the whole half of the buffer
+	for (uint32_t delay = 0; delay < ADS_BLOCK_HALF; delay++)
+	{
+		runBlock(delay);
+		CHECK(receivedCount == expectedCount);
+		CHECK(receivedCrcErrors == expectedCrcErrors);
+		for (uint32_t i = 0; (i < receivedCount) && (i < expectedCount); i++)
+			CHECK(sameSample(&received[i], &expected[i]));
+
+		CHECK(System.ads.sample != NULL);
+		if (System.ads.sample != NULL)
+			CHECK(sameSample(&System.ads.sample->data, &expected[expectedCount - 1]));
+		CHECK(adsRecovery.state == ADS_RECOVERY_IDLE);
+		CHECK(System.ads.ready);
+	}
+
+	// PendSV late: the half DMA writes again is dropped, the rest goes on in
+	// order with lost samples counted
+	runBlock(ADS_BLOCK_HALF + 1);
+	CHECK(receivedCount < expectedCount);
+	for (uint32_t i = 1; i < receivedCount; i++)
+	{
+		uint32_t gap = (received[i].timestamp - received[i - 1].timestamp) / PERIOD;
+		CHECK(received[i].timestamp > received[i - 1].timestamp);
+		CHECK(received[i].lost == gap - 1);
+	}
+
+	runRateChange();
+
+	return hostResult("ads_block");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,88 @@
+/*
+ * test_ads_unpack.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Fast unpacking kernels against the reference ones on pseudo-random frame
+ * stream of every length up to three whole frames, so every tail after the
+ * unrolled iterations is covered, and their time per frame on host.
+ */
+
+#include <string.h>
+#include <time.h>
+#include "host.h"
+#include "ads131m0x.h"
+#include "ads_unpack.h"
+
+#define BENCH_LOOPS		(200000u)
+
+static uint8_t stream[3 * 4 * ADS_FRAME_WORDS];
+static int32_t fast[sizeof(stream) / 2];
+static int32_t ref[sizeof(stream) / 2];
+
+
+
+/*
+ * @return	ns per call of unpack on one frame of 24 bit words
+ */
+static double bench(void (*unpack)(const uint8_t*, int32_t*, uint32_t))
+{
+	struct timespec t0, t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t i = 0; i < BENCH_LOOPS; i++)
+	{
+		unpack(stream, fast, ADS_FRAME_WORDS);
+		__asm__ volatile ("" : : "r" (fast) : "memory");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return ((double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec)) / BENCH_LOOPS;
+}
+
+
+
+int main(void)
+{
+	uint32_t seed = 0x87654321;
+	// full scale and sign boundaries
+	const uint8_t edges[] = { 0x7F, 0xFF, 0xFF,  0x80, 0x00, 0x00,  0xFF, 0xFF, 0xFF,  0x00, 0x00, 0x01 };
+	const int32_t edges24[] = { 0x7FFFFF, -0x800000, -1, 1 };
+	const int32_t edges16[] = { 0x7FFF00, -0x8000, 0, -0x100, -0x10000, 0x100 };
+
+	for (uint32_t i = 0; i < sizeof(stream); i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		stream[i] = (uint8_t)(seed >> 24);
+	}
+
+	for (uint32_t count = 0; count <= sizeof(stream) / 3; count++)
+	{
+		adsUnpack24(stream, fast, count);
+		adsUnpack24Ref(stream, ref, count);
+		CHECK(memcmp(fast, ref, count * sizeof(int32_t)) == 0);
+		// unaligned source too
+		adsUnpack24(&stream[1], fast, (count > 0) ? count - 1 : 0);
+		adsUnpack24Ref(&stream[1], ref, (count > 0) ? count - 1 : 0);
+		CHECK(memcmp(fast, ref, ((count > 0) ? count - 1 : 0) * sizeof(int32_t)) == 0);
+	}
+
+	for (uint32_t count = 0; count <= sizeof(stream) / 2; count++)
+	{
+		adsUnpack16(stream, fast, count);
+		adsUnpack16Ref(stream, ref, count);
+		CHECK(memcmp(fast, ref, count * sizeof(int32_t)) == 0);
+	}
+
+	adsUnpack24(edges, fast, 4);
+	CHECK(memcmp(fast, edges24, sizeof(edges24)) == 0);
+	adsUnpack16(edges, fast, 6);
+	CHECK(memcmp(fast, edges16, sizeof(edges16)) == 0);
+
+	printf("unpack24 frame on host: fast %.1f ns, ref %.1f ns\n", bench(adsUnpack24), bench(adsUnpack24Ref));
+
+	return hostResult("ads_unpack");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,114 @@
+/*
+ * test_crc.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Table backends of crc.c against the bit-by-bit reference implementations
+ * (the loops used before, from ADS library and utilities.c) for all lengths,
+ * so every split is covered, and their time per ADS frame on host. Hardware
+ * engine is checked by crcInit() on target.
+ */
+
+#include <time.h>
+#include "host.h"
+#include "../Core/Src/crc.c"
+
+#define MAX_LENGTH		(64)
+#define BENCH_LOOPS		(200000u)
+
+static uint16_t crc16ccittRef(const uint8_t *data, uint32_t length)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		crc ^= (uint16_t)data[i] << 8;
+		for (uint32_t bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+
+
+static uint8_t crc8Ref(const uint8_t *data, uint32_t length)
+{
+	uint8_t crc = 0x00;
+	uint8_t extract;
+	uint8_t sum;
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		extract = data[i];
+		for (uint32_t tempI = 8; tempI; tempI--)
+		{
+			sum = (crc ^ extract) & 0x01;
+			crc >>= 1;
+			if (sum)
+				crc ^= 0x8C;
+			extract >>= 1;
+		}
+	}
+	return crc;
+}
+
+
+
+/*
+ * @return	ns per call of crc16 on 21 bytes (ADS frame: response + 6 channels)
+ */
+static double bench(uint16_t (*crc16)(const uint8_t*, uint32_t), const uint8_t *data)
+{
+	struct timespec t0, t1;
+	volatile uint16_t sink = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t i = 0; i < BENCH_LOOPS; i++)
+		sink ^= crc16(data, 21);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	(void)sink;
+
+	return ((double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec)) / BENCH_LOOPS;
+}
+
+
+
+int main(void)
+{
+	const uint8_t *check = (const uint8_t*)"123456789";
+	uint8_t buff[MAX_LENGTH];
+	uint32_t seed = 0x12345678;
+
+	// known check values of both CRCs
+	CHECK(crc16ccittRef(check, 9) == 0x29B1);
+	CHECK(crc8Ref(check, 9) == 0xA1);
+	CHECK(crc16ccittTable(check, 9) == 0x29B1);
+	CHECK(crc8Table(check, 9) == 0xA1);
+
+	// public functions use tables until crcInit() finds the engine
+	CHECK(crc16ccitt(check, 9) == 0x29B1);
+	CHECK(crc8(check, 9) == 0xA1);
+
+	for (uint32_t i = 0; i < sizeof(buff); i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		buff[i] = (uint8_t)(seed >> 24);
+	}
+
+	for (uint32_t len = 0; len <= sizeof(buff); len++)
+	{
+		CHECK(crc16ccittTable(buff, len) == crc16ccittRef(buff, len));
+		CHECK(crc8Table(buff, len) == crc8Ref(buff, len));
+		// every start alignment too
+		if (len > 0)
+			CHECK(crc16ccittTable(&buff[sizeof(buff) - len], len) == crc16ccittRef(&buff[sizeof(buff) - len], len));
+	}
+
+	printf("crc16 21 B on host: table %.1f ns, ref %.1f ns\n",
+			bench(crc16ccittTable, buff), bench(crc16ccittRef, buff));
+
+	return hostResult("crc");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
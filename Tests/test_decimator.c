@@ -0,0 +1,172 @@
+/*
+ * test_decimator.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Decimator chain at every ADS rate: frequency response from decimResponse()
+ * (passband, everything from 50 Hz up, which would alias at the regulator
+ * rate 100 Hz), the same measured on sines run through the filter, DC gain
+ * at full scale and group delay from step response.
+ */
+
+#include <math.h>
+#include "host.h"
+#include "decimator.h"
+
+#define RATES			(8)			// lowest ADS rate, then every next one doubled
+#define STOP_FREQ		(50.0f)		// [Hz] Nyquist of the regulator rate
+#define STOP_GAIN		(0.01f)		// -40 dB
+#define PASS_FREQ		(5.0f)		// [Hz]
+#define PASS_GAIN		(0.06f)		// 0.5 dB
+#define SINE_OUTPUTS	(4000u)		// FIR outputs the amplitude is fitted on, many periods
+
+static decimator_t d;
+
+static const int32_t fullScale = 0x7FFFFF;
+
+
+
+static float inputRateOf(uint32_t n)
+{
+	return DECIM_MID_RATE / 2.0f * (float)(1u << n);
+}
+
+
+
+/*
+ * decimResponse() at the passband and over the whole stopband, up to Nyquist
+ * of the input.
+ */
+static void checkResponse(float inputRate)
+{
+	if (inputRate >= DECIM_MID_RATE)	// FIR at the lowest rate has it halved
+		CHECK(fabsf(decimResponse(inputRate, PASS_FREQ) - 1.0f) < PASS_GAIN);
+
+	for (float f = STOP_FREQ; f <= 100.0f; f += 0.5f)
+		CHECK(decimResponse(inputRate, f) < STOP_GAIN);
+
+	for (float f = 100.0f; f < inputRate / 2.0f; f += 1.0f)
+		CHECK(decimResponse(inputRate, f) < STOP_GAIN);
+}
+
+
+
+/*
+ * Amplitude of sine of frequency f after the chain, fitted on FIR outputs
+ * (it's aliased there, but the phase at output instants follows the input).
+ */
+static float sineGain(float inputRate, float f)
+{
+	uint32_t ratio = decimRatio(inputRate);
+	const float amplitude = 0.5f * (float)fullScale;
+	double re = 0.0, im = 0.0;
+	uint32_t outputs = 0;
+	uint32_t n = 0;
+
+	decimInit(&d, ratio);
+	while (outputs < SINE_OUTPUTS + DECIM_FIR_TAPS)
+	{
+		double t = (double)n / inputRate;
+		int32_t x = (int32_t)lround(amplitude * sin(2.0 * M_PI * f * t));
+		float out;
+
+		decimProcessBlock(&d, &x, 1);
+		n++;
+		if ((d.phase != 0) || !decimOutput(&d, &out))
+			continue;
+		if (++outputs <= DECIM_FIR_TAPS)
+			continue;	// settling
+
+		// output of the sample just taken, delayed by the chain
+		t -= (double)decimGroupDelay(inputRate);
+		re += out * sin(2.0 * M_PI * f * t);
+		im += out * cos(2.0 * M_PI * f * t);
+	}
+
+	return (float)(2.0 * hypot(re, im) / SINE_OUTPUTS / amplitude);
+}
+
+
+
+static void checkSines(float inputRate)
+{
+	const float freqs[] = { 5.0f, 10.0f, 20.0f, 50.0f, 60.0f, 75.0f, 90.0f, 100.0f };
+
+	for (uint32_t i = 0; i < sizeof(freqs) / sizeof(freqs[0]); i++)
+	{
+		float gain = sineGain(inputRate, freqs[i]);
+
+		CHECK(fabsf(gain - decimResponse(inputRate, freqs[i])) < 0.005f);
+		if (freqs[i] >= STOP_FREQ)
+			CHECK(gain < STOP_GAIN);
+	}
+}
+
+
+
+/*
+ * Step response: 50 % crossing at group delay, within one CIC period, DC gain
+ * 1 at both ends of the range without overflow.
+ */
+static void checkStep(float inputRate)
+{
+	uint32_t ratio = decimRatio(inputRate);
+	float delay = decimGroupDelay(inputRate) * inputRate;	// [samples]
+	float out = 0.0f, prev = 0.0f, crossing = -1.0f;
+	int32_t x;
+
+	decimInit(&d, ratio);
+	CHECK(!decimOutput(&d, &out));
+
+	x = 0;
+	for (uint32_t i = 0; i < ratio * (DECIM_FIR_TAPS + DECIM_CIC_ORDER); i++)
+		decimProcessBlock(&d, &x, 1);
+	CHECK(decimOutput(&d, &out));
+
+	x = fullScale;
+	for (uint32_t i = 0; i < ratio * 2 * (DECIM_FIR_TAPS + DECIM_CIC_ORDER); i++)
+	{
+		decimProcessBlock(&d, &x, 1);
+		if ((d.phase != 0) || !decimOutput(&d, &out))
+			continue;
+		if ((crossing < 0.0f) && (out >= 0.5f * (float)fullScale))
+		{	// output is known every ratio samples, interpolate between
+			crossing = (float)i - (float)ratio * (out - 0.5f * (float)fullScale) / (out - prev);
+		}
+		prev = out;
+	}
+
+	CHECK(crossing >= 0.0f);
+	CHECK(fabsf(crossing - delay) <= (float)ratio);
+	CHECK(fabsf(out - (float)fullScale) <= 1e-5f * (float)fullScale);
+
+	x = -fullScale - 1;
+	for (uint32_t i = 0; i < ratio * 2 * (DECIM_FIR_TAPS + DECIM_CIC_ORDER); i++)
+		decimProcessBlock(&d, &x, 1);
+	CHECK(decimOutput(&d, &out));
+	CHECK(fabsf(out - (float)x) <= 1e-5f * (float)fullScale);
+}
+
+
+
+int main(void)
+{
+	for (uint32_t n = 0; n < RATES; n++)
+	{
+		float inputRate = inputRateOf(n);
+
+		checkResponse(inputRate);
+		checkSines(inputRate);
+		checkStep(inputRate);
+	}
+
+	printf("decimator at 2 kSPS: delay %.1f ms, %.1f dB at 10 Hz, %.1f dB at 50 Hz\n",
+			1000.0f * decimGroupDelay(inputRateOf(3)),
+			20.0f * log10f(decimResponse(inputRateOf(3), 10.0f)),
+			20.0f * log10f(decimResponse(inputRateOf(3), STOP_FREQ)));
+
+	return hostResult("decimator");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,95 @@
+/*
+ * test_gain_schedule.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Gain schedule tables: gains at grid entries, between them and outside of
+ * the grid, 1x1 table and replacing of entries.
+ */
+
+#include <math.h>
+#include "host.h"
+#include "gain_schedule.h"
+
+static gschedTable_t t =
+{
+	.setpoints = 3,
+	.loads = 2,
+	.setpoint = { 100.0f, 1000.0f, 3000.0f },
+	.load = { 0.0f, 200e-9f },
+	.gains =
+	{
+		{ { 1.0f, 10.0f, 0.0f }, { 2.0f, 20.0f, 0.0f } },
+		{ { 3.0f, 30.0f, 1.0f }, { 4.0f, 40.0f, 1.0f } },
+		{ { 5.0f, 50.0f, 2.0f }, { 8.0f, 80.0f, 2.0f } },
+	},
+};
+
+static gschedTable_t fixed =
+{
+	.setpoints = 1,
+	.loads = 1,
+	.gains = { { { 7.0f, 70.0f, 0.5f } } },
+};
+
+
+
+static bool gainsEqual(const gschedGains_t *a, float kp, float ki, float kd)
+{
+	const float tolerance = 1e-6f;
+
+	return (fabsf(a->kp - kp) <= tolerance * fabsf(kp))
+		&& (fabsf(a->ki - ki) <= tolerance * fabsf(ki))
+		&& (fabsf(a->kd - kd) <= tolerance * fabsf(kd));
+}
+
+
+
+int main(void)
+{
+	gschedGains_t g;
+	const gschedGains_t tuned = { 6.0f, 60.0f, 3.0f };
+	const gschedGains_t negative = { -1.0f, 0.0f, 0.0f };
+
+	// grid entries
+	for (uint32_t s = 0; s < t.setpoints; s++)
+	{
+		for (uint32_t l = 0; l < t.loads; l++)
+		{
+			gschedEval(&t, t.setpoint[s], t.load[l], &g);
+			CHECK(gainsEqual(&g, t.gains[s][l].kp, t.gains[s][l].ki, t.gains[s][l].kd));
+		}
+	}
+
+	// middle of the cell, then along one axis only
+	gschedEval(&t, 2000.0f, 100e-9f, &g);
+	CHECK(gainsEqual(&g, 5.0f, 50.0f, 1.5f));
+	gschedEval(&t, 550.0f, 0.0f, &g);
+	CHECK(gainsEqual(&g, 2.0f, 20.0f, 0.5f));
+
+	// held outside of the grid
+	gschedEval(&t, 10.0f, -50e-9f, &g);
+	CHECK(gainsEqual(&g, 1.0f, 10.0f, 0.0f));
+	gschedEval(&t, 5000.0f, 1e-6f, &g);
+	CHECK(gainsEqual(&g, 8.0f, 80.0f, 2.0f));
+
+	// 1x1 table doesn't schedule, tuning replaces its only entry
+	gschedEval(&fixed, 1234.0f, 100e-9f, &g);
+	CHECK(gainsEqual(&g, 7.0f, 70.0f, 0.5f));
+	CHECK(gschedEntrySet(&fixed, 0.0f, 0.0f, &tuned));
+	gschedEval(&fixed, 3000.0f, 0.0f, &g);
+	CHECK(gainsEqual(&g, tuned.kp, tuned.ki, tuned.kd));
+
+	// nearest entry is replaced, negative gains refused
+	CHECK(gschedEntrySet(&t, 2200.0f, 150e-9f, &tuned));
+	CHECK(!gschedEntrySet(&t, 2200.0f, 150e-9f, &negative));
+	gschedEval(&t, 3000.0f, 200e-9f, &g);
+	CHECK(gainsEqual(&g, tuned.kp, tuned.ki, tuned.kd));
+	gschedEval(&t, 1000.0f, 200e-9f, &g);
+	CHECK(gainsEqual(&g, 4.0f, 40.0f, 1.0f));
+
+	return hostResult("gain_schedule");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
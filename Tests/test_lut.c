@@ -0,0 +1,150 @@
+/*
+ * test_lut.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Lookup tables compiled for the calibration ranges (calibration.h) against
+ * the linear model they replace (gain * code) over the whole range, and
+ * non-linear tables against their exact piecewise linear function, with
+ * breakpoints on the grid and off it.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "host.h"
+#include "calibration.h"
+#include "lut.h"
+
+#define TOLERANCE		(1e-6)		// of full scale, fixed-point rounding
+
+static lut_t lut;
+static lutTable_t table;
+
+
+
+/*
+ * Exact value of the table at x, end segments extrapolated.
+ */
+static double pwl(const lutTable_t *t, int32_t x)
+{
+	uint32_t j = 0;
+
+	while ((j + 2 < t->count) && (x >= t->point[j + 1].x))
+		j++;
+
+	return t->point[j].y + ((double)t->point[j + 1].y - t->point[j].y)
+			* ((double)x - t->point[j].x) / ((double)t->point[j + 1].x - t->point[j].x);
+}
+
+
+
+/*
+ * Linear default of every table, as calibTableCompile() builds it.
+ */
+static void checkLinear(float gain, int32_t xMin, uint32_t log2Range)
+{
+	int32_t xMax = (int32_t)((int64_t)xMin + ((int64_t)1 << log2Range) - 1);
+	double fullScale = fmax(fabs(gain * (double)xMin), fabs(gain * (double)xMax));
+
+	lutLinear(&table, gain, xMin, log2Range);
+	CHECK(lutCompile(&lut, &table, xMin, log2Range));
+	CHECK(lut.xMin == xMin);
+	CHECK(lut.xMax == xMax);
+
+	for (int64_t x = xMin; x <= xMax; x += 4099)
+		CHECK(fabs(lutEval(&lut, (int32_t)x) - gain * (double)x) <= TOLERANCE * fullScale);
+	CHECK(fabs(lutEval(&lut, xMax) - gain * (double)xMax) <= TOLERANCE * fullScale);
+
+	// clamped outside of the range
+	CHECK(lutEval(&lut, INT32_MIN) == lutEval(&lut, xMin));
+	CHECK(lutEval(&lut, INT32_MAX) == lutEval(&lut, xMax));
+}
+
+
+
+/*
+ * @return	the largest error against exact table, relative to full scale
+ */
+static double maxError(int32_t xMin, uint32_t log2Range, uint32_t step)
+{
+	int32_t xMax = (int32_t)((int64_t)xMin + ((int64_t)1 << log2Range) - 1);
+	double fullScale = fmax(fabs(pwl(&table, xMin)), fabs(pwl(&table, xMax)));
+	double error = 0.0;
+
+	for (int64_t x = xMin; x <= xMax; x += step)
+		error = fmax(error, fabs(lutEval(&lut, (int32_t)x) - pwl(&table, (int32_t)x)));
+
+	return error / fullScale;
+}
+
+
+
+int main(void)
+{
+	// gains of ADS channels [A/bit], [V/bit] and of the pump [duty/mV]
+	const float codeGains[] = { -5.97e-12f, 7.95e-4f, 7.77e-4f };
+	const float pumpGain = 1.6e-7f;
+	const uint32_t segment = 1u << (CALIB_CODE_LOG2_RANGE - LUT_SEGMENTS_LOG2);
+	double error;
+
+	for (uint32_t n = 0; n < sizeof(codeGains) / sizeof(codeGains[0]); n++)
+		checkLinear(codeGains[n], CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE);
+	checkLinear(pumpGain, CALIB_PUMP_MIN, CALIB_PUMP_LOG2_RANGE);
+
+	// ADS codes fit in the range, offset moves only saturated ones out
+	CHECK(CALIB_CODE_MIN <= -(1 << 23));
+	CHECK((int64_t)CALIB_CODE_MIN + ((int64_t)1 << CALIB_CODE_LOG2_RANGE) - 1 >= (1 << 23) - 1);
+
+	// non-linear, breakpoints on the grid: exact
+	table.count = 4;
+	table.point[0] = (lutPoint_t){ 0, 0.0f };
+	table.point[1] = (lutPoint_t){ 1024, 0.05f };
+	table.point[2] = (lutPoint_t){ 32768, 0.6f };
+	table.point[3] = (lutPoint_t){ 61440, 0.95f };
+	CHECK(lutCompile(&lut, &table, 0, 16));
+	for (uint32_t j = 0; j < table.count; j++)
+		CHECK(fabsf(lutEval(&lut, table.point[j].x) - table.point[j].y) <= TOLERANCE);
+	CHECK(fabsf(lutEval(&lut, (1024 + 32768) / 2) - (0.05f + 0.6f) / 2.0f) <= TOLERANCE);
+	// extrapolated with the last segment
+	CHECK(fabs(lutEval(&lut, 65535) - pwl(&table, 65535)) <= TOLERANCE);
+	CHECK(maxError(0, 16, 1) <= TOLERANCE);
+
+	// Uc divider, steeper at both ends, breakpoints where they were measured:
+	// kink within a segment is cut off, by less than slope change * segment / 4
+	table.count = 5;
+	table.point[0] = (lutPoint_t){ -7654321, -6120.0f };
+	table.point[1] = (lutPoint_t){ -6012345, -4790.0f };
+	table.point[2] = (lutPoint_t){ -123457, -98.0f };
+	table.point[3] = (lutPoint_t){ -1, 0.0f };
+	table.point[4] = (lutPoint_t){ 8388607, 6700.0f };
+	CHECK(lutCompile(&lut, &table, CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE));
+	for (uint32_t j = 0; j < table.count; j++)
+	{
+		double before = (j > 0) ? ((double)table.point[j].y - table.point[j - 1].y) / ((double)table.point[j].x - table.point[j - 1].x) : 0.0;
+		double after = (j + 1 < table.count) ? ((double)table.point[j + 1].y - table.point[j].y) / ((double)table.point[j + 1].x - table.point[j].x) : before;
+		if (j == 0)
+			before = after;
+		CHECK(fabs(lutEval(&lut, table.point[j].x) - table.point[j].y) <= fabs(after - before) * segment / 4.0 + TOLERANCE * 6700.0);
+	}
+	error = maxError(CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE, 997);
+	CHECK(error < 2e-4);
+	printf("lut: %u segments of %u codes, Uc divider table max error %.1e of full scale\n", LUT_SEGMENTS, segment, error);
+
+	// invalid: not ascending, too few points, wrong range - lut unchanged
+	lut_t copy = lut;
+	table.point[2].x = table.point[1].x;
+	CHECK(!lutCompile(&lut, &table, CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE));
+	table.point[2].x = -123457;
+	table.count = 1;
+	CHECK(!lutCompile(&lut, &table, CALIB_CODE_MIN, CALIB_CODE_LOG2_RANGE));
+	table.count = 5;
+	CHECK(!lutCompile(&lut, &table, CALIB_CODE_MIN, LUT_SEGMENTS_LOG2 - 1));
+	CHECK(!lutCompile(&lut, &table, 0, 31 + 1));
+	CHECK(!lutCompile(&lut, &table, 1, 31));
+	CHECK(memcmp(&lut, &copy, sizeof(lut)) == 0);
+
+	return hostResult("lut");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,151 @@
+/*
+ * test_pid_batch.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Batch of loops with different setup (direction, saturation, anti-windup,
+ * setpoint weight, filtered derivative, manual mode) and a cascade against
+ * the same PIDControl loops with PIDCompute(), and time of the batch against
+ * PIDCompute() of every loop on host.
+ */
+
+#include <math.h>
+#include <time.h>
+#include "host.h"
+#include "pid_batch.h"
+
+#define BENCH_LOOPS		(1000000u)
+
+static pidBatch_t b;
+static PIDControl ref[PIDB_LOOPS_MAX];
+
+// loop 3 is slave of loop 2, so it goes last
+static const uint8_t order[PIDB_LOOPS_MAX] = { 1, 0, 2, 3 };
+
+
+
+static void setup(void)
+{
+	// Uc like: reverse, anti-windup, saturates on setpoint steps
+	PIDInit(&ref[0], 0.0002025f, 0.00486f, 0.0f, 0.01f, 0.0f, 0.3f, AUTOMATIC, REVERSE);
+	PIDAntiWindupSet(&ref[0], 0.05f);
+	// PID with filtered derivative and setpoint weight
+	PIDInit(&ref[1], 0.00017f, 0.0027f, 0.00001f, 0.01f, 0.0f, 0.9f, AUTOMATIC, DIRECT);
+	PIDDerivativeFilterSet(&ref[1], 0.02f);
+	PIDSetpointWeightSet(&ref[1], 0.5f);
+	// Ia like cascade master, Ue like slave
+	PIDInit(&ref[2], 15750000.0f, 42000000.0f, 0.0f, 0.01f, 100.0f, 2500.0f, AUTOMATIC, DIRECT);
+	PIDAntiWindupSet(&ref[2], 0.3f);
+	PIDInit(&ref[3], 0.000135f, 0.0010125f, 0.0f, 0.01f, 0.0f, 0.5f, AUTOMATIC, DIRECT);
+
+	pidBatchInit(&b, order, PIDB_LOOPS_MAX);
+	for (uint32_t i = 0; i < PIDB_LOOPS_MAX; i++)
+		pidBatchLoad(&b, i, &ref[i]);
+}
+
+
+
+/*
+ * Setpoint steps with saturation, loop 1 in manual for a while, plants take
+ * batch outputs, so differences don't hide each other.
+ */
+static void checkTrajectory(void)
+{
+	float plant[PIDB_LOOPS_MAX] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const float gain[PIDB_LOOPS_MAX] = { -7000.0f, 7000.0f, 1e-9f, 7000.0f };
+
+	setup();
+	for (uint32_t n = 0; n < 600; n++)
+	{
+		float sp = (n < 300) ? 1.0f : 0.3f;
+
+		// loop 1 off for a while and driven by hand, then back bumpless
+		if (n == 100)
+		{
+			PIDModeSet(&ref[1], MANUAL);
+			pidBatchModeSet(&b, 1, MANUAL);
+		}
+		if ((n >= 100) && (n < 150))
+		{
+			PIDOutputTrack(&ref[1], 0.2f);
+			pidBatchOutputTrack(&b, 1, 0.2f);
+		}
+		if (n == 150)
+		{
+			PIDModeSet(&ref[1], AUTOMATIC);
+			pidBatchModeSet(&b, 1, AUTOMATIC);
+		}
+
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			float setpoint = (i == 2) ? (sp * 1e-6f) : (sp * ((i == 0) ? -3000.0f : 3000.0f));
+			PIDInputSet(&ref[i], plant[i]);
+			PIDSetpointSet(&ref[i], setpoint);
+			PIDCompute(&ref[i]);
+			b.input[i] = plant[i];
+			b.setpoint[i] = setpoint;
+		}
+		pidBatchCompute(&b, 0, 3, 0xF);
+
+		// slave setpoint is master output
+		PIDInputSet(&ref[3], plant[3]);
+		PIDSetpointSet(&ref[3], PIDOutputGet(&ref[2]));
+		PIDCompute(&ref[3]);
+		b.input[3] = plant[3];
+		b.setpoint[3] = b.output[2];
+		pidBatchCompute(&b, 3, 4, 0xF);
+
+		for (uint32_t i = 0; i < PIDB_LOOPS_MAX; i++)
+		{
+			float range = ref[i].outMax - ref[i].outMin;
+
+			CHECK(fabsf(b.output[i] - PIDOutputGet(&ref[i])) <= 1e-5f * range);
+			plant[i] += (gain[i] * b.output[i] - plant[i]) * 0.2f;
+		}
+		plant[2] = 1e-9f * plant[3];	// Ia follows Ue
+	}
+}
+
+
+
+static double elapsed(const struct timespec *t0, const struct timespec *t1)
+{
+	return ((double)(t1->tv_sec - t0->tv_sec) * 1e9 + (double)(t1->tv_nsec - t0->tv_nsec)) / BENCH_LOOPS;
+}
+
+
+
+int main(void)
+{
+	struct timespec t0, t1;
+	double nsBatch, nsSingle;
+
+	checkTrajectory();
+
+	// all loops with error, so no path is trivial
+	for (uint32_t i = 0; i < PIDB_LOOPS_MAX; i++)
+	{
+		PIDInputSet(&ref[i], 0.99f * ref[i].setpoint);
+		b.input[i] = ref[i].input;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t n = 0; n < BENCH_LOOPS; n++)
+		pidBatchCompute(&b, 0, PIDB_LOOPS_MAX, 0xF);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	nsBatch = elapsed(&t0, &t1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t n = 0; n < BENCH_LOOPS; n++)
+		for (uint32_t i = 0; i < PIDB_LOOPS_MAX; i++)
+			PIDCompute(&ref[i]);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	nsSingle = elapsed(&t0, &t1);
+
+	printf("pid_batch %u loops on host: batch %.1f ns, PIDCompute() %.1f ns\n", PIDB_LOOPS_MAX, nsBatch, nsSingle);
+
+	return hostResult("pid_batch");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
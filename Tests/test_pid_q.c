@@ -0,0 +1,131 @@
+/*
+ * test_pid_q.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Fixed-point PID (pid_controller_q) against the float one on closed loop
+ * trajectories of Uc loop (at PID_PERIOD and 2 kHz, CCR output) and Ia loop
+ * (0.1 V output LSB), and time of both on host.
+ */
+
+#include <math.h>
+#include <time.h>
+#include "host.h"
+#include "pid_controller.h"
+#include "pid_controller_q.h"
+
+#define BENCH_LOOPS		(1000000u)
+
+// regulator.c
+#define PID_PERIOD		(0.01f)		// [s]
+#define UC_KP			(0.000171f)
+#define UC_KI			(0.0020938f)
+#define UC_OUT_MAX		(0.9f)		// PID_OUT_MAX_UC
+#define IA_KP			(15750000.0f)
+#define IA_KI			(42000000.0f)
+#define CCR				(1.0f / 65535.0f)	// [duty/LSB]
+
+static PIDControl pidF;
+static PIDControlQ pidQ;
+
+
+
+/*
+ * Drives first order plant (gain [unit/output], time constant tau) with float
+ * PID through setpoint steps and saturation, fixed-point one gets the same
+ * quantized inputs.
+ * @return max difference of outputs [output LSB]
+ */
+static float checkLoop(const PIDControl *config, float inScale, float outScale, float plantGain, float tau, float setpoint)
+{
+	const uint32_t steps = 2000;
+	float y = 0.0f;
+	float maxDiff = 0.0f;
+
+	pidF = *config;
+	PIDQInit(&pidQ, config->dispKp, config->dispKi, config->dispKd, config->sampleTime,
+			(int32_t)(config->outMin / outScale + 0.5f), (int32_t)(config->outMax / outScale + 0.5f),
+			inScale, outScale, AUTOMATIC, config->controllerDirection);
+
+	for (uint32_t i = 0; i < steps; i++)
+	{
+		float sp = (i < steps / 2) ? setpoint : 0.5f * setpoint;
+		if ((i > steps / 4) && (i < steps / 4 + 20))
+			sp = 3.0f * setpoint;	// output saturated
+
+		int32_t in = PIDQInputScale(&pidQ, y);
+		int32_t spQ = PIDQInputScale(&pidQ, sp);
+
+		PIDInputSet(&pidF, (float)in * inScale);
+		PIDSetpointSet(&pidF, (float)spQ * inScale);
+		PIDCompute(&pidF);
+		PIDQInputSet(&pidQ, in);
+		PIDQSetpointSet(&pidQ, spQ);
+		PIDQCompute(&pidQ);
+
+		float diff = fabsf((float)PIDQOutputGet(&pidQ) - PIDOutputGet(&pidF) / outScale);
+		if (diff > maxDiff)
+			maxDiff = diff;
+
+		y += (plantGain * PIDOutputGet(&pidF) - y) * config->sampleTime / tau;
+	}
+
+	return maxDiff;
+}
+
+
+
+static double elapsed(const struct timespec *t0, const struct timespec *t1)
+{
+	return ((double)(t1->tv_sec - t0->tv_sec) * 1e9 + (double)(t1->tv_nsec - t0->tv_nsec)) / BENCH_LOOPS;
+}
+
+
+
+int main(void)
+{
+	static PIDControl pid;
+	struct timespec t0, t1;
+	float diffUc, diffUcFast, diffIa;
+	double ns, nsQ;
+
+	// outputs within 4 LSB, Uc directly in CCR
+	PIDInit(&pid, UC_KP, UC_KI, 0.0f, PID_PERIOD, 0.0f, UC_OUT_MAX, AUTOMATIC, REVERSE);
+	diffUc = checkLoop(&pid, 0.001f, CCR, -7000.0f, 0.05f, -3000.0f);
+	PIDSampleTimeSet(&pid, 1.0f / 2000.0f);		// REGULATOR_SYNC_RATE_MAX
+	diffUcFast = checkLoop(&pid, 0.001f, CCR, -7000.0f, 0.05f, -3000.0f);
+
+	PIDInit(&pid, IA_KP, IA_KI, 0.0f, PID_PERIOD, 100.0f, 2500.0f, AUTOMATIC, DIRECT);
+	diffIa = checkLoop(&pid, 1e-12f, 0.1f, 1e-9f, 0.05f, 1e-6f);
+
+	CHECK(diffUc <= 4.0f);
+	CHECK(diffUcFast <= 4.0f);
+	CHECK(diffIa <= 4.0f);
+
+	// Ia loop with error, so it isn't a trivial path
+	PIDQInit(&pidQ, IA_KP, IA_KI, 0.0f, PID_PERIOD, 1000, 25000, 1e-12f, 0.1f, AUTOMATIC, DIRECT);
+	PIDQSetpointSet(&pidQ, 1000000);
+	PIDQInputSet(&pidQ, 999000);
+	PIDSetpointSet(&pid, 1e-6f);
+	PIDInputSet(&pid, 0.999e-6f);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t n = 0; n < BENCH_LOOPS; n++)
+		PIDCompute(&pid);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = elapsed(&t0, &t1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t n = 0; n < BENCH_LOOPS; n++)
+		PIDQCompute(&pidQ);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	nsQ = elapsed(&t0, &t1);
+
+	printf("pid_q: diff Uc %.2f, Uc 2 kHz %.2f, Ia %.2f LSB, PIDQCompute() %.1f ns, PIDCompute() %.1f ns\n",
+			diffUc, diffUcFast, diffIa, nsQ, ns);
+
+	return hostResult("pid_q");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/
@@ -0,0 +1,121 @@
+/*
+ * test_trajectory.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Lukasz Sitarek
+ *
+ * Setpoint trajectories: profile limits, time of the move and no overshoot,
+ * also with target reversed on the way. Then PI loop on a model of HV
+ * multiplier follows a step through the generator, which must not overshoot
+ * unlike the raw step.
+ */
+
+#include <math.h>
+#include "host.h"
+#include "trajectory.h"
+
+static traj_t t;
+
+
+
+/*
+ * Moves from 0 to target and back to 0 midway if reverseAt > 0 (step number).
+ * @return 0 - limits exceeded, overshoot or the move took longer than time
+ */
+static bool checkMove(float slew, float accel, float target, float dt, uint32_t reverseAt, float time)
+{
+	float last = 0.0f, lastVelocity = 0.0f;
+	float goal = target;
+	float tolerance = 1e-4f * fabsf(target);
+	uint32_t steps = (uint32_t)(time / dt + 0.5f);
+	uint32_t n;
+
+	trajInit(&t, slew, accel, 0.0f);
+	for (n = 0; n < steps; n++)
+	{
+		if ((reverseAt > 0) && (n == reverseAt))
+			goal = 0.0f;
+		float y = trajStep(&t, goal, dt);
+
+		// velocity and acceleration within limits, the last step may brake harder
+		float v = (y - last) / dt;
+		if (fabsf(v) > slew * 1.001f)
+			return false;
+		if (!trajDone(&t) && (fabsf(v - lastVelocity) > accel * dt * 1.01f + tolerance / dt))
+			return false;
+		// never beyond the range of the move
+		if ((target > 0.0f) ? ((y > target + tolerance) || (y < -tolerance))
+							: ((y < target - tolerance) || (y > tolerance)))
+			return false;
+
+		last = y;
+		lastVelocity = v;
+		if (trajDone(&t) && (t.position == goal))
+			break;
+	}
+
+	return (n < steps);
+}
+
+
+
+/*
+ * Multiplier with ZN PI from unloaded Uc notes in regulator.c, first order lag
+ * with dead time of the measurement. Output duty 0 .. 0.9.
+ * @return	max overshoot [V] of the step through the generator, or the raw one
+ */
+static float checkLoop(bool bGenerator)
+{
+	const float gain = 7000.0f;		// [V/duty]
+	const float tau = 0.05f;		// [s]
+	const float dt = 0.01f;			// PID_PERIOD
+	const float kp = 0.0002025f, ki = 0.00486f;
+	const float target = 2500.0f;
+	float delay[2] = { 0.0f, 0.0f };	// 20 ms
+	float y = 0.0f, iTerm = 0.0f, overshoot = 0.0f;
+
+	trajInit(&t, 2500.0f, 10000.0f, 0.0f);
+	for (uint32_t n = 0; n < 300; n++)
+	{
+		float sp = bGenerator ? trajStep(&t, target, dt) : target;
+		float error = sp - delay[1];
+
+		iTerm = fminf(fmaxf(iTerm + ki * dt * error, 0.0f), 0.9f);
+		float u = fminf(fmaxf(kp * error + iTerm, 0.0f), 0.9f);
+
+		delay[1] = delay[0];
+		delay[0] = y;
+		for (uint32_t k = 0; k < 10; k++)
+			y += (gain * u - y) * (dt / 10.0f) / tau;
+
+		if (y - target > overshoot)
+			overshoot = y - target;
+	}
+
+	return overshoot;
+}
+
+
+
+int main(void)
+{
+	// 2500 V at 2500 V/s, 10000 V/s^2: 1.25 s, then at 2 kHz rate
+	CHECK(checkMove(2500.0f, 10000.0f, -2500.0f, 0.01f, 0, 1.3f));
+	CHECK(checkMove(2500.0f, 10000.0f, 2500.0f, 0.0005f, 0, 1.3f));
+	// short move, triangular velocity: 2 * sqrt(100 / 10000) = 0.2 s
+	CHECK(checkMove(2500.0f, 10000.0f, 100.0f, 0.01f, 0, 0.25f));
+	// target back to 0 in the middle of the ramp
+	CHECK(checkMove(2500.0f, 10000.0f, 2500.0f, 0.01f, 50, 2.0f));
+
+	// loop through the generator: under 1 % overshoot, raw step worse
+	float overshoot = checkLoop(true);
+	float overshootRaw = checkLoop(false);
+
+	CHECK(overshoot < 25.0f);
+	CHECK(overshootRaw > overshoot);
+	printf("trajectory: 2500 V step overshoot %.1f V, raw step %.1f V\n", overshoot, overshootRaw);
+
+	return hostResult("trajectory");
+}
+
+/************************ (C) COPYRIGHT LSITA ******************END OF FILE****/